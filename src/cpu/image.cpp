@@ -51,6 +51,8 @@ struct ImplementationBase : public Image {
             const float* src = reinterpret_cast<const float*>(__builtin_assume_aligned(data, sizeof(float)));
             return src[(y * rowWidth + x) * channels + channel];
         }
+        case DataType::FLOAT16:
+            return getNative<Half>(x, y, channel);
         #define X(type, name) case name: return static_cast<double>(getNative<type>(x, y, channel));
         ACCELERATED_IMAGE_FOR_EACH_NON_FLOAT_NAMED_TYPE(X)
         #undef X
@@ -67,6 +69,9 @@ struct ImplementationBase : public Image {
             target[(y * rowWidth + x) * channels + channel] = value;
             return;
         }
+        case DataType::FLOAT16:
+            setNative<Half>(x, y, channel, Half(value));
+            return;
         #define X(type, name) case name: setNative<type>(x, y, channel, type(value)); return;
         ACCELERATED_IMAGE_FOR_EACH_NON_FLOAT_NAMED_TYPE(X)
         #undef X
@@ -80,10 +85,17 @@ private:
     std::vector<std::uint8_t> dataVec;
 
 public:
-    ImageWithData(int w, int h, int channels, DataType dtype) :
+    ImageWithData(int w, int h, int channels, DataType dtype, Processor *allocator) :
         ImplementationBase(w, h, channels, dtype)
     {
-        dataVec.resize(size());
+        if (allocator && !allocator->inWorkerThread()) {
+            // zero-initialization "first touches" the pages in the allocator
+            // thread, which places them on its NUMA node on Linux. From its
+            // own worker, waiting could deadlock, but the node is the same
+            allocator->enqueue([this]() { dataVec.resize(size()); }).wait();
+        } else {
+            dataVec.resize(size());
+        }
         data = dataVec.data();
     }
 };
@@ -104,9 +116,14 @@ public:
 };
 
 class ImageFactory final : public Image::Factory {
+private:
+    Processor *allocator;
+
 public:
+    ImageFactory(Processor *allocator) : allocator(allocator) {}
+
     std::unique_ptr<::accelerated::Image> create(int w, int h, int channels, ImageTypeSpec::DataType dtype) final {
-        return std::unique_ptr<::accelerated::Image>(new ImageWithData(w, h, channels, dtype));
+        return std::unique_ptr<::accelerated::Image>(new ImageWithData(w, h, channels, dtype, allocator));
     }
 
     ImageTypeSpec getSpec(int channels, ImageTypeSpec::DataType dtype) final {
@@ -190,6 +207,7 @@ template<> void Image::set<dtype>(int x, int y, int channel, dtype value) { \
     reinterpret_cast<ImplementationBase&>(*this).setNative<dtype>(x, y, channel, value); \
 }
 ACCELERATED_IMAGE_FOR_EACH_NON_FLOAT_TYPE(X)
+X(Half)
 #undef X
 
 template<> float Image::get<float>(int x, int y, int channel) const {
@@ -209,7 +227,11 @@ ImageTypeSpec Image::getSpec(int channels, DataType dtype) {
 }
 
 std::unique_ptr<Image::Factory> Image::createFactory() {
-    return std::unique_ptr<Image::Factory>(new ImageFactory());
+    return std::unique_ptr<Image::Factory>(new ImageFactory(nullptr));
+}
+
+std::unique_ptr<Image::Factory> Image::createFactory(Processor &allocator) {
+    return std::unique_ptr<Image::Factory>(new ImageFactory(&allocator));
 }
 
 std::unique_ptr<Image> Image::createReference(int w, int h, int channels, DataType dtype, std::uint8_t *data) {
@@ -85,6 +85,13 @@ public:
 
     static std::unique_ptr<Factory> createFactory();
 
+    /**
+     * Create a factory whose images are allocated (first touched) in the given
+     * processor, e.g., one of Processor::createNumaThreadPools, so that their
+     * memory is local to the NUMA node the processor runs on
+     */
+    static std::unique_ptr<Factory> createFactory(Processor &allocator);
+
     /** Create a cpu::Image which as a reference to existing data */
     static std::unique_ptr<Image> createReference(
         int w, int h, int channels, DataType dtype, std::uint8_t *data);
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <iostream>
 
 #include "operations.hpp"
@@ -15,6 +16,7 @@ typedef ::accelerated::operations::swizzle::Spec SwizzleSpec;
 typedef ::accelerated::operations::pixelwiseAffineCombination::Spec PixelwiseAffineCombinationSpec;
 typedef ::accelerated::operations::channelwiseAffine::Spec ChannelwiseAffineSpec;
 using ::accelerated::operations::Function;
+using ::accelerated::operations::ParameterizedFunction;
 
 void checkSpec(const ImageTypeSpec &spec) {
     (void)spec;
@@ -176,7 +178,38 @@ template <class T> Unary pixelwiseAffineUnary(const PixelwiseAffineCombinationSp
     };
 }
 
+bool isFloatOrHalf(const ImageTypeSpec &spec) {
+    return spec.dataType == ImageTypeSpec::DataType::FLOAT32 || spec.dataType == ImageTypeSpec::DataType::FLOAT16;
+}
+
+// whole rows at a time through a float buffer, which uses the vectorized
+// half-float conversions
+Unary channelwiseAffineFloatRows(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+    return [spec, inSpec, outSpec](Image &input, Image &output) {
+        aa_assert(input == inSpec);
+        aa_assert(output == outSpec);
+        aa_assert(input.width == output.width && input.height == output.height);
+        const std::size_t n = std::size_t(input.width) * input.channels;
+        const bool halfIn = inSpec.dataType == ImageTypeSpec::DataType::FLOAT16;
+        const bool halfOut = outSpec.dataType == ImageTypeSpec::DataType::FLOAT16;
+        std::vector<float> row(n);
+        const float scale = spec.scale, bias = spec.bias;
+        for (int y = 0; y < input.height; ++y) {
+            const std::uint8_t *inRow = input.getDataRaw() + y * input.bytesPerRow();
+            std::uint8_t *outRow = output.getDataRaw() + y * output.bytesPerRow();
+            if (halfIn) convertHalfToFloat(reinterpret_cast<const Half*>(inRow), row.data(), n);
+            else std::memcpy(row.data(), inRow, n * sizeof(float));
+            for (float &v : row) v = scale * v + bias;
+            if (halfOut) convertFloatToHalf(row.data(), reinterpret_cast<Half*>(outRow), n);
+            else std::memcpy(outRow, row.data(), n * sizeof(float));
+        }
+    };
+}
+
 Unary channelwiseAffine(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+    if (isFloatOrHalf(inSpec) && isFloatOrHalf(outSpec) && inSpec.channels == outSpec.channels) {
+        return channelwiseAffineFloatRows(spec, inSpec, outSpec);
+    }
     return [spec, inSpec, outSpec](Image &input, Image &output) {
         aa_assert(output.channels == input.channels);
         aa_assert(input == inSpec);
@@ -219,6 +252,62 @@ class CpuFactory : public Factory {
 private:
     Processor &processor;
 
+    template <class T> static NAry body(const T &func) {
+        return ::accelerated::operations::sync::convert(func);
+    }
+
+    NAry createBody(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return body<Unary>(impl::fixedConvolution2D(spec, inSpec, outSpec));
+    }
+
+    NAry createBody(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return body<Unary>(impl::rescale(spec, inSpec, outSpec));
+    }
+
+    NAry createBody(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        if (spec.linear.size() == 1 && inSpec.dataType == outSpec.dataType) {
+            #define X(type, name) if (inSpec.dataType == name) \
+                return body<Unary>(impl::pixelwiseAffineUnary<type>(spec, inSpec, outSpec));
+            ACCELERATED_IMAGE_FOR_EACH_NAMED_TYPE(X)
+            #undef X
+        }
+        return impl::pixelwiseAffineCombination(spec, inSpec, outSpec);
+    }
+
+    NAry createBody(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return body<Unary>(impl::channelwiseAffine(spec, inSpec, outSpec));
+    }
+
+    // Like the uniforms in the OpenGL implementation, the body is replaced
+    // in the processor so that the change is ordered with respect to the
+    // Function calls (and recorded in CommandLists)
+    template <class Spec> ParameterizedFunction<Spec> createRebuilding(const Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+        typedef std::shared_ptr<const NAry> BodyPtr;
+        auto current = std::make_shared<BodyPtr>(std::make_shared<const NAry>(createBody(spec, inSpec, outSpec)));
+        ParameterizedFunction<Spec> r;
+        r.function = wrapNAry([current](Image **inputs, int nInputs, Image &output) {
+            // atomic: a thread pool may run the calls in other workers
+            const BodyPtr f = std::atomic_load(current.get());
+            (*f)(inputs, nInputs, output);
+        });
+        Processor &p = processor;
+        r.setParameters = [this, current, &p, inSpec, outSpec](const Spec &newSpec) -> Future {
+            const BodyPtr next = std::make_shared<const NAry>(createBody(newSpec, inSpec, outSpec));
+            return ::accelerated::operations::sync::enqueue(p, [current, next]() {
+                std::atomic_store(current.get(), next);
+            });
+        };
+        return r;
+    }
+
 public:
     CpuFactory(Processor &processor) : processor(processor) {}
 
@@ -227,9 +316,7 @@ public:
     }
 
     Function create(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
-        checkSpec(inSpec);
-        checkSpec(outSpec);
-        return wrap<Unary>(impl::fixedConvolution2D(spec, inSpec, outSpec));
+        return wrapNAry(createBody(spec, inSpec, outSpec));
     }
 
     Function create(const FillSpec &spec, const ImageTypeSpec &imageSpec) final {
@@ -238,9 +325,7 @@ public:
     }
 
     Function create(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
-        checkSpec(inSpec);
-        checkSpec(outSpec);
-        return wrap<Unary>(impl::rescale(spec, inSpec, outSpec));
+        return wrapNAry(createBody(spec, inSpec, outSpec));
     }
 
     Function create(const SwizzleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
@@ -256,21 +341,27 @@ public:
     }
 
     Function create(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
-        checkSpec(inSpec);
-        checkSpec(outSpec);
-        if (spec.linear.size() == 1 && inSpec.dataType == outSpec.dataType) {
-            #define X(type, name) if (inSpec.dataType == name) \
-                return wrap<Unary>(impl::pixelwiseAffineUnary<type>(spec, inSpec, outSpec));
-            ACCELERATED_IMAGE_FOR_EACH_NAMED_TYPE(X)
-            #undef X
-        }
-        return wrapNAry(impl::pixelwiseAffineCombination(spec, inSpec, outSpec));
+        return wrapNAry(createBody(spec, inSpec, outSpec));
     }
 
     Function create(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
-        checkSpec(inSpec);
-        checkSpec(outSpec);
-        return wrap<Unary>(impl::channelwiseAffine(spec, inSpec, outSpec));
+        return wrapNAry(createBody(spec, inSpec, outSpec));
+    }
+
+    ParameterizedFunction<FixedConvolution2DSpec> createParameterized(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        return createRebuilding(spec, inSpec, outSpec);
+    }
+
+    ParameterizedFunction<PixelwiseAffineCombinationSpec> createParameterized(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        return createRebuilding(spec, inSpec, outSpec);
+    }
+
+    ParameterizedFunction<ChannelwiseAffineSpec> createParameterized(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        return createRebuilding(spec, inSpec, outSpec);
+    }
+
+    ParameterizedFunction<RescaleSpec> createParameterized(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        return createRebuilding(spec, inSpec, outSpec);
     }
 };
 }
@@ -5,6 +5,37 @@
 
 namespace accelerated {
 namespace operations {
+struct CommandListRecorder {
+    Processor *processor = nullptr;
+    std::vector< std::function<void()> > commands;
+
+    void add(Processor &p, const std::function<void()> &body) {
+        if (processor == nullptr) processor = &p;
+        aa_assert(processor == &p && "all commands in a CommandList must use the same Processor");
+        commands.push_back(body);
+    }
+
+    void appendTo(CommandList &list) {
+        if (commands.empty()) return;
+        if (list.processor == nullptr) list.processor = processor;
+        aa_assert(list.processor == processor && "all commands in a CommandList must use the same Processor");
+        // copy-on-write so that pending submits are not affected
+        std::vector< std::function<void()> > all;
+        if (list.commands) all = *list.commands;
+        all.insert(all.end(), commands.begin(), commands.end());
+        list.commands = std::make_shared< const std::vector< std::function<void()> > >(std::move(all));
+    }
+};
+
+namespace {
+thread_local CommandListRecorder *activeRecorder = nullptr;
+
+// uninstalls the recorder even if the recorded calls throw
+struct RecorderScope {
+    RecorderScope(CommandListRecorder &recorder) { activeRecorder = &recorder; }
+    ~RecorderScope() { activeRecorder = nullptr; }
+};
+}
 
 Function convert(const Nullary &f) {
     return [f](Image** inputs, int nInputs, Image &output) -> Future {
@@ -45,5 +76,59 @@ Future callBinary(const Function &f, Image &a, Image &b, Image &output) {
     return call(f, arr, output);
 }
 
+Future callNullary(const Function &f, Image &output, const CancellationToken &token) {
+    CancellationToken::Scope scope(token);
+    return callNullary(f, output);
+}
+
+Future callUnary(const Function &f, Image &input, Image &output, const CancellationToken &token) {
+    CancellationToken::Scope scope(token);
+    return callUnary(f, input, output);
+}
+
+Future callBinary(const Function &f, Image &a, Image &b, Image &output, const CancellationToken &token) {
+    CancellationToken::Scope scope(token);
+    return callBinary(f, a, b, output);
+}
+
+Future callMultiOutput(const MultiOutputFunction &f, const std::vector<Image*> &inputs, const std::vector<Image*> &outputs) {
+    return f(const_cast<Image**>(inputs.data()), inputs.size(), const_cast<Image**>(outputs.data()), outputs.size());
+}
+
+void CommandList::record(const std::function<void()> &calls) {
+    aa_assert(activeRecorder == nullptr && "nested CommandList::record is not supported");
+    CommandListRecorder recorder;
+    {
+        RecorderScope scope(recorder);
+        calls();
+    }
+    recorder.appendTo(*this);
+}
+
+Future CommandList::submit() const {
+    if (empty()) return Future::instantlyResolved();
+    auto cmds = commands;
+    return processor->enqueue([cmds]() {
+        for (const auto &cmd : *cmds) cmd();
+    }, CancellationToken::current());
+}
+
+void CommandList::clear() {
+    processor = nullptr;
+    commands.reset();
+}
+
+bool CommandList::empty() const {
+    return !commands || commands->empty();
+}
+
+Future sync::enqueue(Processor &p, const std::function<void()> &body) {
+    if (activeRecorder != nullptr) {
+        activeRecorder->add(p, body);
+        return Future::instantlyResolved();
+    }
+    return p.enqueue(body, CancellationToken::current());
+}
+
 }
 }
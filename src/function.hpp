@@ -28,7 +28,59 @@ template <std::size_t N> Future call(const Function &f, std::array<Image*, N> &i
     return f(reinterpret_cast<Image**>(&inputs), N, output);
 }
 
+/**
+ * A Function that writes several output images in a single pass, e.g.,
+ * an OpenGL operation with multiple render targets
+ */
+typedef std::function< Future(Image** inputs, int nInputs, Image** outputs, int nOutputs) > MultiOutputFunction;
+
+Future callMultiOutput(const MultiOutputFunction &f, const std::vector<Image*> &inputs, const std::vector<Image*> &outputs);
+
+/**
+ * Cancellable versions of the above: if the token is cancelled before the
+ * operation starts, it is skipped and the returned Future isCancelled()
+ */
+Future callNullary(const Function &f, Image &output, const CancellationToken &token);
+Future callUnary(const Function &f, Image &input, Image &output, const CancellationToken &token);
+Future callBinary(const Function &f, Image &a, Image &b, Image &output, const CancellationToken &token);
+
+template <std::size_t N> Future call(const Function &f, std::array<Image*, N> &inputs, Image &output, const CancellationToken &token) {
+    CancellationToken::Scope scope(token);
+    return call(f, inputs, output);
+}
+
+/**
+ * A recorded sequence of Function calls (with their image bindings) that is
+ * submitted to the processor as a single task. Can be submitted repeatedly,
+ * e.g., once per frame, without re-recording. The images must stay alive
+ * as long as the list is used.
+ */
+class CommandList {
+public:
+    /**
+     * Record the Function calls made in the given callback instead of
+     * running them. All recorded Functions must use the same Processor.
+     * The Futures returned by the calls are meaningless.
+     */
+    void record(const std::function<void()> &calls);
+    /** Run the recorded calls, in order, as one task */
+    Future submit() const;
+    void clear();
+    bool empty() const;
+
+private:
+    friend struct CommandListRecorder;
+    Processor *processor = nullptr;
+    std::shared_ptr< const std::vector< std::function<void()> > > commands;
+};
+
 namespace sync {
+/**
+ * Enqueue the body of a Function call to the processor, or record it if
+ * called inside CommandList::record. Used by wrapBody
+ */
+Future enqueue(Processor &p, const std::function<void()> &body);
+
 typedef std::function< void(Image **inputs, int nInputs, Image &output) > Function;
 typedef std::function< void(Image &output) > Nullary;
 typedef std::function< void(Image &input, Image &output) > Unary;
@@ -41,10 +93,10 @@ template <class T, int N> Future wrapNAryBody(
 {
     (void)nInputs;
     aa_assert(nInputs == N);
-    std::array<T*, N> args;
+    std::array<T*, N> args = {};
     for (int i = 0; i < nInputs; ++i) args[i] = &T::castFrom(*inputs[i]);
     auto &out = T::castFrom(output);
-    return p.enqueue([syncFunc, args, &out]() {
+    return enqueue(p, [syncFunc, args, &out]() {
         syncFunc(const_cast<T**>(reinterpret_cast<T* const*>(&args)), N, out);
     });
 }
@@ -65,7 +117,7 @@ template <class T> Future wrapBody(
     args.reserve(nInputs);
     for (int i = 0; i < nInputs; ++i) args.push_back(&T::castFrom(*inputs[i]));
     auto &out = T::castFrom(output);
-    return p.enqueue([syncFunc, args, &out]() {
+    return enqueue(p, [syncFunc, args, &out]() {
         syncFunc(const_cast<T**>(reinterpret_cast<T* const*>(args.data())), args.size(), out);
     });
 }
@@ -78,6 +130,19 @@ wrap(const std::function<void(T **inputs, int nInputs, T &output)> &syncFunc, Pr
     };
 }
 
+template <class T>
+::accelerated::operations::MultiOutputFunction
+wrapMultiOutput(const std::function<void(T **inputs, int nInputs, T **outputs, int nOutputs)> &syncFunc, Processor &p) {
+    return [syncFunc, &p](Image **inputs, int nInputs, Image **outputs, int nOutputs) -> Future {
+        std::vector<T*> ins, outs;
+        for (int i = 0; i < nInputs; ++i) ins.push_back(&T::castFrom(*inputs[i]));
+        for (int i = 0; i < nOutputs; ++i) outs.push_back(&T::castFrom(*outputs[i]));
+        return enqueue(p, [syncFunc, ins, outs]() {
+            syncFunc(const_cast<T**>(ins.data()), ins.size(), const_cast<T**>(outs.data()), outs.size());
+        });
+    };
+}
+
 template <class T>
 std::function<void(T **inputs, int nInputs, T &output)>
 convert(const std::function<void(T &output)> &syncFunc) {
@@ -1,29 +1,79 @@
 #include <future>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "future.hpp"
 #include "assert.hpp"
 
 namespace accelerated {
 namespace {
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// true if the state became ready before the spin & yield budget ran out
+bool spinUntilReady(const Future::State &state, const WaitPolicy &policy) {
+    for (int i = 0; i < policy.spinIterations; ++i) {
+        if (state.isReady()) return true;
+        cpuRelax();
+    }
+    for (int i = 0; i < policy.yieldIterations; ++i) {
+        if (state.isReady()) return true;
+        std::this_thread::yield();
+    }
+    return false;
+}
+
 struct InstantState : Future::State {
     void wait() final {};
+    void wait(const WaitPolicy &) final {};
+    bool isReady() const final { return true; }
 };
 
 class StdWrapper : public Future::State {
 private:
     std::promise<void> p;
     std::future<void> f;
+    std::atomic<bool> cancelled, ready;
+    const WaitPolicy defaultPolicy;
 
 public:
-    StdWrapper() : f(p.get_future()) {}
+    StdWrapper(const WaitPolicy &policy) : f(p.get_future()), cancelled(false), ready(false), defaultPolicy(policy) {}
 
     void resolve() {
+        // before set_value so that isReady() is true once wait() returns
+        ready.store(true, std::memory_order_release);
         p.set_value();
     }
 
+    void cancel() {
+        cancelled.store(true);
+        resolve();
+    }
+
     void wait() final {
+        wait(defaultPolicy);
+    }
+
+    void wait(const WaitPolicy &policy) final {
+        if (spinUntilReady(*this, policy)) return;
         f.wait();
     }
+
+    bool isReady() const final {
+        return ready.load(std::memory_order_acquire);
+    }
+
+    bool isCancelled() const final {
+        return cancelled.load();
+    }
 };
 
 class PromiseImplementation : public Promise {
@@ -31,12 +81,16 @@ private:
     std::shared_ptr<StdWrapper> wrapper;
 
 public:
-    PromiseImplementation() : wrapper(new StdWrapper) {}
+    PromiseImplementation(const WaitPolicy &policy) : wrapper(new StdWrapper(policy)) {}
 
     void resolve() final {
         wrapper->resolve();
     }
 
+    void cancel() final {
+        wrapper->cancel();
+    }
+
     Future getFuture() final {
         return Future(wrapper);
     }
@@ -45,7 +99,11 @@ public:
 
 Promise::~Promise() = default;
 std::unique_ptr<Promise> Promise::create() {
-    return std::unique_ptr<Promise>(new PromiseImplementation);
+    return create(WaitPolicy::park());
+}
+
+std::unique_ptr<Promise> Promise::create(const WaitPolicy &defaultWaitPolicy) {
+    return std::unique_ptr<Promise>(new PromiseImplementation(defaultWaitPolicy));
 }
 
 Future::Future(std::shared_ptr<State> state) : state(state) {}
@@ -60,5 +118,83 @@ void Future::wait() {
     return state->wait();
 }
 
+void Future::wait(const WaitPolicy &policy) {
+    aa_assert(state);
+    return state->wait(policy);
+}
+
+bool Future::isReady() const {
+    aa_assert(state);
+    return state->isReady();
+}
+
+void Future::State::wait(const WaitPolicy &policy) {
+    if (spinUntilReady(*this, policy)) return;
+    wait();
+}
+
+bool Future::State::isReady() const {
+    return false;
+}
+
+bool Future::State::isCancelled() const {
+    return false;
+}
+
+bool Future::isCancelled() const {
+    aa_assert(state);
+    return state->isCancelled();
+}
+
+namespace { thread_local CancellationToken currentToken; }
+
+CancellationToken CancellationToken::create() {
+    return CancellationToken { std::make_shared< std::atomic<bool> >(false) };
+}
+
+void CancellationToken::cancel() {
+    aa_assert(flag);
+    flag->store(true);
+}
+
+bool CancellationToken::isCancelled() const {
+    return flag && flag->load();
+}
+
+CancellationToken::Scope::Scope(const CancellationToken &token) : previous(currentToken.flag) {
+    currentToken = token;
+}
+
+CancellationToken::Scope::~Scope() {
+    currentToken.flag = previous;
+}
+
+CancellationToken CancellationToken::current() {
+    return currentToken;
+}
+
 Processor::~Processor() = default;
+
+void Processor::setDefaultWaitPolicy(const WaitPolicy &policy) {
+    (void)policy;
+}
+
+bool Processor::inWorkerThread() const {
+    return false;
+}
+
+Future Processor::enqueue(const std::function<void()> &op, const CancellationToken &token) {
+    if (token.empty()) return enqueue(op);
+    // generic fallback: the cancellation is checked when the task would run
+    std::shared_ptr<Promise> promise = Promise::create();
+    enqueue([op, token, promise]() {
+        if (token.isCancelled()) {
+            promise->cancel();
+        } else {
+            op();
+            promise->resolve();
+        }
+    });
+    return promise->getFuture();
+}
 }
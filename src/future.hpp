@@ -1,10 +1,39 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace accelerated {
 
+/**
+ * How a thread waits for a Future: first busy-spin (with a CPU pause/yield
+ * instruction) while polling the Future, then yield the thread, and finally
+ * park (sleep until woken up). Spinning avoids the sleep & wake-up latency
+ * for short operations at the cost of burning CPU while waiting
+ */
+struct WaitPolicy {
+    int spinIterations = 0;
+    int yieldIterations = 0;
+
+    WaitPolicy setSpin(int n) {
+        spinIterations = n;
+        return *this;
+    }
+
+    WaitPolicy setYield(int n) {
+        yieldIterations = n;
+        return *this;
+    }
+
+    /** Always park immediately (the default) */
+    static WaitPolicy park() { return WaitPolicy {}; }
+    /** Reasonable values for waiting operations that take tens of microseconds */
+    static WaitPolicy spinThenPark() { return WaitPolicy {}.setSpin(1000).setYield(16); }
+};
+
 // Allows implementing both syncrhonous and asynchronus operations conveniently
 // Smart pointer stuff is encapsulated here for convenience and avoiding the
 // ambiguity of future.get() (smart->raw pointer conversion vs wait)
@@ -12,6 +41,11 @@ struct Future {
     struct State {
         virtual ~State();
         virtual void wait() = 0;
+        /** Spin & yield according to the policy while !isReady(), then wait() */
+        virtual void wait(const WaitPolicy &policy);
+        /** Non-blocking check. May return false negatives (but not false positives) */
+        virtual bool isReady() const;
+        virtual bool isCancelled() const;
     };
 
     std::shared_ptr<State> state;
@@ -19,6 +53,15 @@ struct Future {
 
     /** Block & wait until the operation is ready */
     void wait();
+    /** Wait using a custom policy instead of the default of the Processor */
+    void wait(const WaitPolicy &policy);
+    bool isReady() const;
+
+    /**
+     * True if the operation was dropped without running because its
+     * CancellationToken was cancelled. Only meaningful after wait()
+     */
+    bool isCancelled() const;
 
     static Future instantlyResolved();
 };
@@ -27,18 +70,127 @@ struct Future {
 struct Promise {
     virtual ~Promise();
     static std::unique_ptr<Promise> create();
+    /** Create a Promise whose Future::wait() uses the given policy by default */
+    static std::unique_ptr<Promise> create(const WaitPolicy &defaultWaitPolicy);
 
     virtual void resolve() = 0;
+    /** Resolve in the cancelled state */
+    virtual void cancel() = 0;
     virtual Future getFuture() = 0;
 };
 
+/**
+ * Shared flag for revoking enqueued tasks. Copies refer to the same flag.
+ * Tasks that have not started when cancel() is called are dropped and their
+ * Futures resolve in the cancelled state. Running tasks are not interrupted.
+ * A default-constructed token is empty and can never be cancelled.
+ */
+struct CancellationToken {
+    std::shared_ptr< std::atomic<bool> > flag;
+
+    static CancellationToken create();
+
+    void cancel();
+    bool isCancelled() const;
+    bool empty() const { return !flag; }
+
+    /**
+     * Token for the operations::Function calls made by this thread while
+     * the Scope is alive. Used by the call(..., token) helpers in function.hpp
+     */
+    struct Scope {
+        Scope(const CancellationToken &token);
+        ~Scope();
+    private:
+        std::shared_ptr< std::atomic<bool> > previous;
+    };
+
+    /** The token of the innermost active Scope in this thread, or empty */
+    static CancellationToken current();
+};
+
+/**
+ * Thread pool configuration for Processor::createThreadPool. The default
+ * values only differ from the plain createThreadPool(nThreads) in the
+ * number of threads. Unsupported options are ignored with a warning.
+ */
+struct ThreadPoolSpec {
+    int nThreads = 1;
+    /** CPU (core) indices the worker threads may run on. Empty: no pinning */
+    std::vector<int> cpus;
+    /** If true, worker i is pinned to the single CPU cpus[i % cpus.size()] */
+    bool pinEachThread = false;
+    /** Thread name prefix, suffixed with the worker index. Empty: not set */
+    std::string name;
+    /** Nice value (Linux semantics, higher is lower priority). 0: not set */
+    int niceness = 0;
+
+    ThreadPoolSpec setThreads(int n) {
+        nThreads = n;
+        return *this;
+    }
+
+    ThreadPoolSpec setCpus(const std::vector<int> &c, bool pinEach = false) {
+        cpus = c;
+        pinEachThread = pinEach;
+        return *this;
+    }
+
+    ThreadPoolSpec setName(const std::string &n) {
+        name = n;
+        return *this;
+    }
+
+    ThreadPoolSpec setNiceness(int n) {
+        niceness = n;
+        return *this;
+    }
+
+    /** Apply the affinity, name and priority to the calling thread */
+    void applyToCurrentThread(int workerIndex) const;
+
+    /**
+     * CPUs with the highest maximum clock frequency, e.g., the "big" cores
+     * on a big.LITTLE system. Empty if this cannot be determined
+     */
+    static std::vector<int> fastestCpus();
+    /** CPUs on the given NUMA node. Empty if there is no such node */
+    static std::vector<int> numaNodeCpus(int node);
+    /** Ids of the online NUMA nodes, which may have gaps. Empty if unknown */
+    static std::vector<int> numaNodes();
+    static int numaNodeCount();
+};
+
 struct Queue;
 struct Processor {
     virtual ~Processor();
     virtual Future enqueue(const std::function<void()> &op) = 0;
+    /** Enqueue a task that is dropped if the token is cancelled before it runs */
+    virtual Future enqueue(const std::function<void()> &op, const CancellationToken &token);
+
+    /**
+     * Set the WaitPolicy used by Future::wait() for the Futures returned by
+     * subsequent enqueue calls. Should be called before enqueuing anything
+     * (not synchronized). Ignored by processors that do not support it
+     */
+    virtual void setDefaultWaitPolicy(const WaitPolicy &policy);
+
+    /**
+     * True if called from a thread that runs the tasks of this processor,
+     * where waiting for a newly enqueued task may deadlock. Only known for
+     * thread pools (false for other processors)
+     */
+    virtual bool inWorkerThread() const;
 
     static std::unique_ptr<Processor> createInstant();
     static std::unique_ptr<Processor> createThreadPool(int nThreads);
+    static std::unique_ptr<Processor> createThreadPool(const ThreadPoolSpec &spec);
+    /**
+     * Create one thread pool per NUMA node, each with spec.nThreads workers
+     * pinned to the CPUs of that node (spec.cpus is ignored). Combine with
+     * cpu::Image::createFactory(Processor&) for node-local images.
+     */
+    static std::vector< std::unique_ptr<Processor> > createNumaThreadPools(const ThreadPoolSpec &spec);
     static std::unique_ptr<Queue> createQueue();
 };
 
@@ -0,0 +1,205 @@
+#include <map>
+#include <tuple>
+
+#include "graph.hpp"
+#include "log.hpp"
+
+namespace accelerated {
+namespace operations {
+namespace {
+class VirtualImage final : public Image {
+public:
+    const int index;
+
+    VirtualImage(int index, int w, int h, const ImageTypeSpec &spec) :
+        Image(w, h, spec), index(index)
+    {}
+
+    Future readRaw(std::uint8_t *outputData) final {
+        (void)outputData;
+        aa_assert(false && "intermediate graph images cannot be read");
+        return Future::instantlyResolved();
+    }
+
+    Future writeRaw(const std::uint8_t *inputData) final {
+        (void)inputData;
+        aa_assert(false && "intermediate graph images cannot be written");
+        return Future::instantlyResolved();
+    }
+
+    std::unique_ptr<Image> createROI(int x0, int y0, int w, int h) final {
+        (void)x0; (void)y0; (void)w; (void)h;
+        aa_assert(false && "ROIs of intermediate graph images are not supported");
+        return {};
+    }
+};
+
+class GraphImplementation final : public Graph {
+private:
+    struct Call {
+        Function function;
+        std::vector<Image*> inputs;
+        Image *output;
+    };
+
+    // images of the same size and type are interchangeable
+    typedef std::tuple<int, int, int, ImageTypeSpec::DataType> PoolKey;
+
+    Image::Factory &factory;
+    std::vector< std::unique_ptr<VirtualImage> > intermediates;
+    std::vector< Call > calls;
+
+    std::vector< std::unique_ptr<Image> > pool;
+    std::multimap< PoolKey, Image* > freeImages;
+    std::unique_ptr<CommandList> plan;
+    std::size_t nLiveCalls = 0;
+
+    VirtualImage *asIntermediate(Image *image) const {
+        for (const auto &im : intermediates) {
+            if (im.get() == image) return im.get();
+        }
+        return nullptr;
+    }
+
+    static PoolKey keyOf(const Image &image) {
+        return PoolKey(image.width, image.height, image.channels, image.dataType);
+    }
+
+    // backwards pass: a call is live if it writes a sink or an intermediate
+    // that is read by a later live call before being overwritten
+    std::vector<bool> findLiveCalls() const {
+        std::vector<bool> live(calls.size(), false);
+        std::vector<bool> needed(intermediates.size(), false);
+        for (int i = int(calls.size()) - 1; i >= 0; --i) {
+            const auto &c = calls.at(i);
+            auto *out = asIntermediate(c.output);
+            if (out == nullptr) {
+                live[i] = true;
+            } else if (needed.at(out->index)) {
+                live[i] = true;
+                needed[out->index] = false;
+            }
+            if (!live[i]) continue;
+            for (auto *in : c.inputs) {
+                if (auto *v = asIntermediate(in)) needed[v->index] = true;
+            }
+        }
+        for (std::size_t j = 0; j < needed.size(); ++j) {
+            aa_assert(!needed[j] && "intermediate image read before it was written");
+        }
+        return live;
+    }
+
+    Image *allocate(const VirtualImage &v) {
+        const auto key = keyOf(v);
+        auto itr = freeImages.find(key);
+        if (itr != freeImages.end()) {
+            Image *img = itr->second;
+            freeImages.erase(itr);
+            return img;
+        }
+        pool.push_back(factory.create(v.width, v.height, v.channels, v.dataType));
+        return pool.back().get();
+    }
+
+    void buildPlan() {
+        const auto live = findLiveCalls();
+
+        // last live call reading each intermediate
+        std::vector<int> lastUse(intermediates.size(), -1);
+        for (std::size_t i = 0; i < calls.size(); ++i) {
+            if (!live[i]) continue;
+            for (auto *in : calls[i].inputs) {
+                if (auto *v = asIntermediate(in)) lastUse[v->index] = int(i);
+            }
+        }
+
+        // greedy linear-scan assignment of intermediates to pooled images.
+        // The existing pool is recycled so replanning does not reallocate
+        freeImages.clear();
+        for (auto &img : pool) freeImages.emplace(keyOf(*img), img.get());
+        std::vector<Image*> assigned(intermediates.size(), nullptr);
+        std::vector< std::vector<Image*> > bound;
+        nLiveCalls = 0;
+
+        for (std::size_t i = 0; i < calls.size(); ++i) {
+            if (!live[i]) continue;
+            nLiveCalls++;
+            const auto &c = calls[i];
+            std::vector<Image*> args;
+            for (auto *in : c.inputs) {
+                auto *v = asIntermediate(in);
+                args.push_back(v ? assigned.at(v->index) : in);
+            }
+            Image *out = c.output;
+            if (auto *v = asIntermediate(c.output)) {
+                if (assigned.at(v->index) == nullptr) assigned[v->index] = allocate(*v);
+                out = assigned[v->index];
+            }
+            args.push_back(out);
+            bound.push_back(args);
+
+            // release intermediates whose last reader is this call. They can
+            // be the outputs of subsequent calls (but not this one)
+            for (auto *in : c.inputs) {
+                auto *v = asIntermediate(in);
+                if (v && lastUse[v->index] == int(i) && assigned[v->index] != nullptr) {
+                    freeImages.emplace(keyOf(*v), assigned[v->index]);
+                    assigned[v->index] = nullptr;
+                    lastUse[v->index] = -1;
+                }
+            }
+        }
+        LOG_TRACE("graph plan: %zu/%zu live calls, %zu pooled images", nLiveCalls, calls.size(), pool.size());
+
+        plan.reset(new CommandList);
+        plan->record([this, &live, &bound]() {
+            std::size_t b = 0;
+            for (std::size_t i = 0; i < calls.size(); ++i) {
+                if (!live[i]) continue;
+                auto &args = bound.at(b++);
+                calls[i].function(args.data(), int(args.size()) - 1, *args.back());
+            }
+        });
+    }
+
+public:
+    GraphImplementation(Image::Factory &factory) : factory(factory) {}
+
+    Image &createIntermediate(int w, int h, int channels, ImageTypeSpec::DataType dtype) final {
+        plan.reset();
+        const int index = int(intermediates.size());
+        intermediates.emplace_back(new VirtualImage(index, w, h, factory.getSpec(channels, dtype)));
+        return *intermediates.back();
+    }
+
+    void call(const Function &f, const std::vector<Image*> &inputs, Image &output) final {
+        plan.reset();
+        calls.push_back(Call { f, inputs, &output });
+    }
+
+    Future run() final {
+        if (!plan) buildPlan();
+        return plan->submit();
+    }
+
+    std::size_t intermediateBytes() const final {
+        std::size_t bytes = 0;
+        for (const auto &img : pool) bytes += img->size();
+        return bytes;
+    }
+
+    std::size_t liveCallCount() final {
+        if (!plan) buildPlan();
+        return nLiveCalls;
+    }
+};
+}
+
+Graph::~Graph() = default;
+
+std::unique_ptr<Graph> Graph::create(Image::Factory &factory) {
+    return std::unique_ptr<Graph>(new GraphImplementation(factory));
+}
+}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "function.hpp"
+#include "image.hpp"
+
+namespace accelerated {
+namespace operations {
+/**
+ * Deferred execution of Function calls. Calls are added to a DAG whose
+ * intermediate images are "virtual": they are only allocated from the
+ * factory when the graph is run, and intermediates whose lifetimes do not
+ * overlap share the same underlying image. Calls whose outputs never reach
+ * a regular (non-intermediate) image are pruned.
+ *
+ * All Functions in a graph must use the same Processor and the graph is
+ * executed as a single task (see CommandList). Not thread-safe.
+ */
+class Graph {
+public:
+    virtual ~Graph();
+    static std::unique_ptr<Graph> create(Image::Factory &factory);
+
+    /**
+     * Create a virtual intermediate image. The returned reference is only
+     * valid as an argument to call() and build() in this graph and cannot
+     * be read or written directly
+     */
+    virtual Image &createIntermediate(int w, int h, int channels, ImageTypeSpec::DataType dtype) = 0;
+
+    template <class T, int Channels> Image &createIntermediate(int w, int h) {
+        return createIntermediate(w, h, Channels, ImageTypeSpec::getType<T>());
+    }
+
+    Image &createIntermediateLike(const Image &image) {
+        return createIntermediate(image.width, image.height, image.channels, image.dataType);
+    }
+
+    /**
+     * Add a Function call to the graph. The inputs and the output may be
+     * intermediate or regular images. Regular output images are the sinks
+     * of the graph. Calls are executed in the order they were added
+     */
+    virtual void call(const Function &f, const std::vector<Image*> &inputs, Image &output) = 0;
+
+    /**
+     * Execute all calls that contribute to the sinks. The execution plan
+     * is computed on the first run after the graph has changed and then
+     * replayed as is
+     */
+    virtual Future run() = 0;
+
+    /** Number of bytes currently allocated for intermediate images */
+    virtual std::size_t intermediateBytes() const = 0;
+    /** Number of calls executed by run(), i.e., excluding pruned calls */
+    virtual std::size_t liveCallCount() = 0;
+};
+}
+}
@@ -0,0 +1,43 @@
+#include "half.hpp"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace accelerated {
+static_assert(sizeof(Half) == 2, "Half must be binary compatible with GL_HALF_FLOAT");
+
+void convertHalfToFloat(const Half *in, float *out, std::size_t n) {
+    std::size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        const float16x4_t h = vreinterpret_f16_u16(vld1_u16(&in[i].bits));
+        vst1q_f32(out + i, vcvt_f32_f16(h));
+    }
+#endif
+    for (; i < n; ++i) out[i] = in[i];
+}
+
+void convertFloatToHalf(const float *in, Half *out, std::size_t n) {
+    std::size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        const float16x4_t h = vcvt_f16_f32(vld1q_f32(in + i));
+        vst1_u16(&out[i].bits, vreinterpret_u16_f16(h));
+    }
+#endif
+    for (; i < n; ++i) out[i].bits = Half::fromFloat(in[i]);
+}
+}
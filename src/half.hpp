@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 binary16, the storage format of GL_R16F etc. textures.
+// Arithmetic is done in 32-bit floats
+namespace accelerated {
+struct Half {
+    std::uint16_t bits;
+
+    Half() : bits(0) {}
+    Half(double f) : bits(fromFloat(float(f))) {}
+    // only one conversion so that, e.g., std::abs(half) is not ambiguous
+    operator float() const { return toFloat(bits); }
+
+    static Half fromBits(std::uint16_t b) {
+        Half h;
+        h.bits = b;
+        return h;
+    }
+
+    // Round to nearest even, cf. https://gist.github.com/rygorous/2156668
+    static std::uint16_t fromFloat(float value) {
+        std::uint32_t f = floatBits(value);
+        const std::uint32_t sign = f & 0x80000000u;
+        f ^= sign;
+
+        std::uint32_t o;
+        if (f >= (127u + 16u) << 23) {
+            // overflow to infinity, NaN stays NaN
+            o = f > (255u << 23) ? 0x7e00u : 0x7c00u;
+        } else if (f < (113u << 23)) {
+            // subnormal or zero: let the FPU do the rounding
+            const std::uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+            o = floatBits(bitsToFloat(f) + bitsToFloat(denormMagic)) - denormMagic;
+        } else {
+            const std::uint32_t mantissaOdd = (f >> 13) & 1u;
+            f += ((15u - 127u) << 23) + 0xfffu;
+            f += mantissaOdd;
+            o = f >> 13;
+        }
+        return std::uint16_t(o | (sign >> 16));
+    }
+
+    static float toFloat(std::uint16_t h) {
+        const std::uint32_t shiftedExp = 0x7c00u << 13;
+        std::uint32_t o = std::uint32_t(h & 0x7fffu) << 13;
+        const std::uint32_t exp = shiftedExp & o;
+        o += (127u - 15u) << 23;
+        if (exp == shiftedExp) {
+            // infinity or NaN
+            o += (128u - 16u) << 23;
+        } else if (exp == 0) {
+            // zero or subnormal: renormalize
+            o += 1u << 23;
+            o = floatBits(bitsToFloat(o) - bitsToFloat(113u << 23));
+        }
+        return bitsToFloat(o | (std::uint32_t(h & 0x8000u) << 16));
+    }
+
+    #define X(sym) inline Half operator sym(const Half &other) const \
+        { return Half(float(*this) sym float(other)); }
+    X(*)
+    X(-)
+    X(+)
+    X(/)
+    #undef X
+
+    #define X(sym) inline Half &operator sym(const Half &other) \
+        { float v = *this; v sym float(other); bits = fromFloat(v); return *this; }
+    X(*=)
+    X(-=)
+    X(+=)
+    X(/=)
+    #undef X
+
+    inline Half operator -() const { return fromBits(bits ^ 0x8000u); }
+
+    // bitwise: NaN == NaN and -0 != +0, which is what the tests need
+    inline bool operator ==(const Half &other) const { return bits == other.bits; }
+    inline bool operator !=(const Half &other) const { return bits != other.bits; }
+
+private:
+    static std::uint32_t floatBits(float f) {
+        std::uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        return u;
+    }
+
+    static float bitsToFloat(std::uint32_t u) {
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+};
+
+/**
+ * Convert arrays of n values. Vectorized with F16C on x86 (if enabled in
+ * the compiler flags, e.g., -mf16c or -march=native) and NEON on AArch64
+ */
+void convertHalfToFloat(const Half *in, float *out, std::size_t n);
+void convertFloatToHalf(const float *in, Half *out, std::size_t n);
+}
@@ -50,6 +50,7 @@ bool ImageTypeSpec::isIntegerType(DataType dtype) {
         case DataType::SINT32: return true;
 
         case DataType::FLOAT32: return false;
+        case DataType::FLOAT16: return false;
         case DataType::UFIXED8: return false;
         case DataType::SFIXED8: return false;
         case DataType::UFIXED16: return false;
@@ -65,6 +66,7 @@ bool ImageTypeSpec::isIntegerType(DataType dtype) {
 bool ImageTypeSpec::isSigned(DataType dtype) {
     switch (dtype) {
         case DataType::FLOAT32: return true;
+        case DataType::FLOAT16: return true;
 
         case DataType::UINT8: return false;
         case DataType::SINT8: return true;
@@ -92,6 +94,7 @@ bool ImageTypeSpec::isFixedPoint(DataType dtype) {
         case DataType::UINT32: return false;
         case DataType::SINT32: return false;
         case DataType::FLOAT32: return false;
+        case DataType::FLOAT16: return false;
 
         case DataType::UFIXED8: return true;
         case DataType::SFIXED8: return true;
@@ -105,7 +108,7 @@ bool ImageTypeSpec::isFixedPoint(DataType dtype) {
 }
 
 bool ImageTypeSpec::isFloat(DataType dtype) {
-    return dtype == DataType::FLOAT32;
+    return dtype == DataType::FLOAT32 || dtype == DataType::FLOAT16;
 }
 
 }
@@ -6,6 +6,7 @@
 
 #include "future.hpp"
 #include "fixed_point.hpp"
+#include "half.hpp"
 #include "assert.hpp"
 
 namespace accelerated {
@@ -32,7 +33,8 @@ struct ImageTypeSpec {
         UFIXED16,
         SFIXED16,
         UFIXED32,
-        SFIXED32
+        SFIXED32,
+        FLOAT16
     } dataType;
 
     /**
@@ -41,7 +43,11 @@ struct ImageTypeSpec {
     const enum class StorageType {
         CPU,
         GPU_OPENGL,
-        GPU_OPENGL_EXTERNAL
+        GPU_OPENGL_EXTERNAL,
+        // grid of textures, see opengl::TiledImage
+        GPU_OPENGL_TILED,
+        // GL_TEXTURE_2D_ARRAY, see opengl::Image::Factory::createArray
+        GPU_OPENGL_ARRAY
     } storageType;
 
     std::size_t bytesPerChannel() const;
@@ -181,9 +187,13 @@ struct Image : ImageTypeSpec {
     x(FixedPoint<std::uint32_t>) \
     x(FixedPoint<std::int32_t>)
 
+#define ACCELERATED_IMAGE_FOR_EACH_FLOAT_TYPE(x) \
+    x(Half) \
+    x(float)
+
 #define ACCELERATED_IMAGE_FOR_EACH_TYPE(x) \
     ACCELERATED_IMAGE_FOR_EACH_NON_FLOAT_TYPE(x) \
-    x(float)
+    ACCELERATED_IMAGE_FOR_EACH_FLOAT_TYPE(x)
 
 #define ACCELERATED_IMAGE_FOR_EACH_TYPE_WITH_EXTRAS(x, extra) \
     x(std::uint8_t, extra) \
@@ -198,7 +208,8 @@ struct Image : ImageTypeSpec {
     x(FixedPoint<std::uint16_t>, extra) \
     x(FixedPoint<std::int16_t>, extra) \
     x(FixedPoint<std::uint32_t>, extra) \
-    x(FixedPoint<std::int32_t>, extra)
+    x(FixedPoint<std::int32_t>, extra) \
+    x(Half, extra)
 
 // quite heavy, use sparingly
 #define ACCELERATED_IMAGE_FOR_EACH_TYPE_PAIR(x) \
@@ -214,7 +225,8 @@ struct Image : ImageTypeSpec {
     ACCELERATED_IMAGE_FOR_EACH_TYPE_WITH_EXTRAS(x, FixedPoint<std::uint16_t>) \
     ACCELERATED_IMAGE_FOR_EACH_TYPE_WITH_EXTRAS(x, FixedPoint<std::int16_t>) \
     ACCELERATED_IMAGE_FOR_EACH_TYPE_WITH_EXTRAS(x, FixedPoint<std::uint32_t>) \
-    ACCELERATED_IMAGE_FOR_EACH_TYPE_WITH_EXTRAS(x, FixedPoint<std::int32_t>)
+    ACCELERATED_IMAGE_FOR_EACH_TYPE_WITH_EXTRAS(x, FixedPoint<std::int32_t>) \
+    ACCELERATED_IMAGE_FOR_EACH_TYPE_WITH_EXTRAS(x, Half)
 
 #define ACCELERATED_IMAGE_FOR_EACH_NON_FLOAT_NAMED_TYPE(x) \
     x(std::uint8_t, ImageTypeSpec::DataType::UINT8) \
@@ -230,9 +242,13 @@ struct Image : ImageTypeSpec {
     x(FixedPoint<std::uint32_t>, ImageTypeSpec::DataType::UFIXED32) \
     x(FixedPoint<std::int32_t>, ImageTypeSpec::DataType::SFIXED32)
 
+#define ACCELERATED_IMAGE_FOR_EACH_FLOAT_NAMED_TYPE(x) \
+    x(Half, ImageTypeSpec::DataType::FLOAT16) \
+    x(float, ImageTypeSpec::DataType::FLOAT32)
+
 #define ACCELERATED_IMAGE_FOR_EACH_NAMED_TYPE(x) \
     ACCELERATED_IMAGE_FOR_EACH_NON_FLOAT_NAMED_TYPE(x) \
-    x(float, ImageTypeSpec::DataType::FLOAT32)
+    ACCELERATED_IMAGE_FOR_EACH_FLOAT_NAMED_TYPE(x)
 
 #define Y(dtype, n) \
     template <> std::unique_ptr<Image> Image::Factory::create<dtype, n>(int w, int h); \
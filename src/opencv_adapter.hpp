@@ -82,6 +82,9 @@ struct opencv {
             case DataType::SFIXED16: return CV_16S;
             case DataType::UFIXED32: aa_assert(false && "UINT32 (fixed-point) type is not supported by OpenCV"); return 0;
             case DataType::SFIXED32: return CV_32S;
+        #ifdef CV_16F // OpenCV 4+
+            case DataType::FLOAT16: return CV_16F;
+        #endif
             default: aa_assert(false);
         }
         return 0;
@@ -108,6 +111,10 @@ struct opencv {
                 else return DataType::SINT32;
             case CV_32F:
                 return DataType::FLOAT32;
+        #ifdef CV_16F
+            case CV_16F:
+                return DataType::FLOAT16;
+        #endif
             default:
                 aa_assert(false && "unsupported OpenCV data type");
                 break;
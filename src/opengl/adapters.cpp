@@ -1,7 +1,17 @@
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 
 #include "adapters.hpp"
+#include "gl_state.hpp"
 #include "../image.hpp"
 #include "../log.hpp"
 
@@ -70,6 +80,59 @@ public:
     }
 };
 
+bool supportsTextureStorage() {
+#if defined(__APPLE__)
+    // no glTexStorage* in OpenGL 3.3
+    return false;
+#elif defined(ACCELERATED_ARRAYS_USE_OPENGL_ES)
+    // core since OpenGL ES 3.0
+    return true;
+#else
+    // core since OpenGL 4.2, otherwise GL_ARB_texture_storage
+    thread_local int supported = -1;
+    if (supported < 0) {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        supported = (major > 4 || (major == 4 && minor >= 2)) ? 1 : 0;
+        GLint n = 0;
+        if (!supported) glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for (GLint i = 0; i < n && !supported; ++i) {
+            const GLubyte *ext = glGetStringi(GL_EXTENSIONS, GLuint(i));
+            if (ext != nullptr && std::strcmp(reinterpret_cast<const char*>(ext), "GL_ARB_texture_storage") == 0) supported = 1;
+        }
+        log_debug("glTexStorage* %s", supported ? "supported" : "not supported, using glTexImage*");
+    }
+    return supported == 1;
+#endif
+}
+
+// immutable storage (written with glTexSubImage*) if supported
+void allocateTexture2D(GLuint bindType, int width, int height, const ImageTypeSpec &spec) {
+    #ifndef __APPLE__
+    if (supportsTextureStorage()) {
+        glTexStorage2D(bindType, 1, getTextureInternalFormat(spec), width, height);
+        return;
+    }
+    #endif
+    glTexImage2D(bindType, 0,
+        getTextureInternalFormat(spec),
+        width, height, 0,
+        getCpuFormat(spec),
+        getCpuType(spec), nullptr);
+}
+
+void allocateTexture3D(GLuint bindType, int width, int height, int depth, const ImageTypeSpec &spec) {
+    #ifndef __APPLE__
+    if (supportsTextureStorage()) {
+        glTexStorage3D(bindType, 1, getTextureInternalFormat(spec), width, height, depth);
+        return;
+    }
+    #endif
+    glTexImage3D(bindType, 0, getTextureInternalFormat(spec), width, height, depth, 0,
+        getCpuFormat(spec), getCpuType(spec), nullptr);
+}
+
 class TextureImplementation : public Texture {
 private:
     const GLuint bindType;
@@ -84,11 +147,7 @@ public:
         // glActiveTexture(GL_TEXTURE0); // TODO: required?
 
         Binder binder(*this);
-        glTexImage2D(bindType, 0,
-            getTextureInternalFormat(spec),
-            width, height, 0,
-            getCpuFormat(spec),
-            getCpuType(spec), nullptr);
+        allocateTexture2D(bindType, width, height, spec);
 
         // set default texture parameters
         glTexParameteri(bindType, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -104,6 +163,7 @@ public:
         if (id != 0) {
             LOG_TRACE("deleting texture %d", id);
             glDeleteTextures(1, &id);
+            glState::deletedTexture(id);
         }
         id = 0;
     }
@@ -115,7 +175,7 @@ public:
     }
 
     void bind() final {
-        glBindTexture(bindType, id);
+        glState::bindTexture(bindType, id);
         LOG_TRACE("bound texture %d", id);
         CHECK_ERROR(__FUNCTION__);
     }
@@ -129,8 +189,10 @@ public:
         // However there is a little practical benefit in making this work
         // optimally in the middle of any other OpenGL processing. Usually
         // whatever other operation cares about the bound texture state will
-        // just overwrite this anyway.
-        glBindTexture(bindType, 0);
+        // just overwrite this anyway. With the state cache, this is skipped
+        // altogether.
+        if (glState::keepBindings()) return;
+        glState::bindTexture(bindType, 0);
         LOG_TRACE("unbound texture");
         CHECK_ERROR(__FUNCTION__);
     }
@@ -138,24 +200,71 @@ public:
     int getId() const { return id; }
 };
 
+// returns true and deletes the fence (setting it to null) if it has been
+// signaled. Does not return before that if block = true
+bool waitAndDeleteSync(GLsync &fence, bool block) {
+    if (block) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+            LOG_TRACE("still waiting for fence");
+        }
+    } else {
+        const GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) return false;
+        aa_assert(status != GL_WAIT_FAILED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+    return true;
+}
+
+// GL_PIXEL_PACK_BUFFER with a fence for one pending asynchronous read
+struct PixelPackBuffer {
+    GLuint id = 0;
+    GLsync fence = nullptr;
+    std::size_t size = 0;
+    uint8_t *target = nullptr;
+
+    bool isPending() const { return fence != nullptr; }
+
+    bool finishRead(bool block) {
+        if (!isPending()) return true;
+        if (!waitAndDeleteSync(fence, block)) return false;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, id);
+        const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        aa_assert(data);
+        std::memcpy(target, data, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        CHECK_ERROR(__FUNCTION__);
+        LOG_TRACE("finished asynchronous read from pixel pack buffer %d", id);
+        target = nullptr;
+        return true;
+    }
+
+    void destroy() {
+        finishRead(true);
+        if (id != 0) glDeleteBuffers(1, &id);
+        id = 0;
+    }
+};
+
 class FrameBufferImplementation : public FrameBuffer {
 private:
     int width, height;
     ImageTypeSpec spec;
     int id;
     std::shared_ptr<Texture> texture;
+    // grows on demand to the number of simultaneously pending reads
+    std::vector< std::shared_ptr<PixelPackBuffer> > packBufferRing;
+    static constexpr std::size_t UNPACK_BUFFER_RING_SIZE = 3;
+    std::vector<GLuint> unpackBufferRing;
+    std::size_t nextUnpackBuffer = 0;
 
     const struct Viewport {
         int x0, y0, width, height;
     } viewport;
 
-    bool fullViewport() const {
-        return viewport.x0 == 0 &&
-            viewport.y0 == 0 &&
-            viewport.width == width &&
-            viewport.height == height;
-    }
-
     bool isScreen() const {
         // hacky
         return id == 0;
@@ -167,7 +276,7 @@ public:
         texture(existingFboId < 0 ? new TextureImplementation(w, h, spec) : nullptr),
         viewport(viewportPtr == nullptr ? Viewport { 0, 0, w, h } : *viewportPtr)
     {
-        aa_assert(viewport.x0 >= 0 && viewport.y0 >= 0 && viewport.width <= width && viewport.height <= height);
+        aa_assert(viewport.x0 >= 0 && viewport.y0 >= 0 && viewport.x0 + viewport.width <= width && viewport.y0 + viewport.height <= height);
         if (existingFboId >= 0) {
             LOG_TRACE("creating a reference to an existing frame buffer object %d", existingFboId);
         } else {
@@ -192,6 +301,13 @@ public:
     }
 
     void destroy() final {
+        for (auto &pbo : packBufferRing) pbo->destroy();
+        packBufferRing.clear();
+        if (!unpackBufferRing.empty()) {
+            glDeleteBuffers(GLsizei(unpackBufferRing.size()), unpackBufferRing.data());
+            unpackBufferRing.clear();
+        }
+
         if (texture) {
             // this is a bit messy
             if (texture.unique()) {
@@ -199,6 +315,7 @@ public:
                     LOG_TRACE("destroying frame buffer %d", id);
                     GLuint uid = id;
                     glDeleteFramebuffers(1, &uid);
+                    glState::deletedFramebuffer(uid);
                 }
                 id = 0;
                 texture->destroy();
@@ -221,9 +338,10 @@ public:
     }
 
     std::unique_ptr<FrameBuffer> createROI(int x0, int y0, int w, int h) final {
-        Viewport view { x0, y0, w, h };
+        // relative to this viewport, which may also be an ROI
+        Viewport view { viewport.x0 + x0, viewport.y0 + y0, w, h };
         LOG_TRACE("creating a ROI from frame buffer %d", id);
-        auto *r = new FrameBufferImplementation(w, h, spec, id, &view);
+        auto *r = new FrameBufferImplementation(width, height, spec, id, &view);
         r->texture = texture;
         return std::unique_ptr<FrameBuffer>(r);
     }
@@ -231,27 +349,60 @@ public:
     void bind() final {
         // texture.bind();
         LOG_TRACE("bound frame buffer %d", id);
-        glBindFramebuffer(GL_FRAMEBUFFER, id);
+        glState::bindFramebuffer(id);
         CHECK_ERROR(__FUNCTION__);
     }
 
     void unbind() final {
         if (isScreen()) return; // skip, already bound 0
+        if (glState::keepBindings()) return;
 
         LOG_TRACE("unbound frame buffer");
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState::bindFramebuffer(0);
         // texture.unbind();
         CHECK_ERROR(__FUNCTION__);
     }
 
     void setViewport() final {
         LOG_TRACE("glViewport(%d, %d, %d, %d)", viewport.x0, viewport.y0, viewport.width, viewport.height);
-        glViewport(viewport.x0, viewport.y0, viewport.width, viewport.height);
+        glState::viewport(viewport.x0, viewport.y0, viewport.width, viewport.height);
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    std::function<bool(bool)> readPixelsAsync(uint8_t *pixels) final {
+        std::shared_ptr<PixelPackBuffer> pbo;
+        for (auto &candidate : packBufferRing) {
+            if (!candidate->isPending()) {
+                pbo = candidate;
+                break;
+            }
+        }
+        if (!pbo) {
+            pbo = std::make_shared<PixelPackBuffer>();
+            pbo->size = viewport.width * viewport.height * spec.bytesPerPixel();
+            glGenBuffers(1, &pbo->id);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo->id);
+            glBufferData(GL_PIXEL_PACK_BUFFER, pbo->size, nullptr, GL_STREAM_READ);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            CHECK_ERROR(__FUNCTION__);
+            packBufferRing.push_back(pbo);
+            LOG_TRACE("created pixel pack buffer %d (ring size %zu)", pbo->id, packBufferRing.size());
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo->id);
+        readPixels(nullptr); // offset 0 in the bound pack buffer
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pbo->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pbo->target = pixels;
         CHECK_ERROR(__FUNCTION__);
+
+        return [pbo](bool block) -> bool {
+            return pbo->finishRead(block);
+        };
     }
 
     void readPixels(uint8_t *pixels) final {
-        LOG_TRACE("reading frame buffer %d");
+        LOG_TRACE("reading frame buffer %d", id);
         Binder binder(*this);
 
         if (isScreen()) {
@@ -270,8 +421,9 @@ public:
         glPixelStorei(GL_PACK_ALIGNMENT, 1);
         CHECK_ERROR(__FUNCTION__);
 
-        // Note: check this
+        // Note: this blocks if no GL_PIXEL_PACK_BUFFER is bound, see
         // https://www.khronos.org/opengl/wiki/Common_Mistakes#Slow_pixel_transfer_performance
+        // and readPixelsAsync
         glReadPixels(viewport.x0, viewport.y0, viewport.width, viewport.height, getReadPixelFormat(spec), getCpuType(spec), pixels);
 
         if (!isScreen()) {
@@ -290,32 +442,49 @@ public:
         Binder binder(*texture);
 
         // our CPU data is tightly packed and not 4-byte aligned (default)
-        GLint origPackAlignment;
-        glGetIntegerv(GL_PACK_ALIGNMENT, &origPackAlignment);
-        aa_assert(origPackAlignment >= 1 && origPackAlignment <= 4);
+        GLint origUnpackAlignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &origUnpackAlignment);
+        aa_assert(origUnpackAlignment >= 1 && origUnpackAlignment <= 4);
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         CHECK_ERROR(__FUNCTION__);
 
-        if (fullViewport()) {
-            glTexImage2D(GL_TEXTURE_2D, 0,
-                getTextureInternalFormat(spec),
-                width, height, 0,
-                getCpuFormat(spec),
-                getCpuType(spec),
-                pixels);
-        } else {
-            LOG_TRACE("writing a sub image of frame buffer %d", id);
-            glTexSubImage2D(GL_TEXTURE_2D, 0,
-                viewport.x0, viewport.y0,
-                viewport.width, viewport.height,
-                getCpuFormat(spec),
-                getCpuType(spec),
-                pixels);
-        }
+        // the texture storage is never reallocated here, also for full writes
+        LOG_TRACE("writing to frame buffer %d", id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0,
+            viewport.x0, viewport.y0,
+            viewport.width, viewport.height,
+            getCpuFormat(spec),
+            getCpuType(spec),
+            pixels);
 
         CHECK_ERROR(__FUNCTION__);
 
-        glPixelStorei(GL_PACK_ALIGNMENT, origPackAlignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, origUnpackAlignment);
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    void writePixelsStreaming(const uint8_t *pixels) final {
+        const std::size_t size = viewport.width * viewport.height * spec.bytesPerPixel();
+        if (unpackBufferRing.empty()) {
+            unpackBufferRing.resize(UNPACK_BUFFER_RING_SIZE, 0);
+            glGenBuffers(GLsizei(unpackBufferRing.size()), unpackBufferRing.data());
+            CHECK_ERROR(__FUNCTION__);
+        }
+        const GLuint pbo = unpackBufferRing.at(nextUnpackBuffer);
+        nextUnpackBuffer = (nextUnpackBuffer + 1) % unpackBufferRing.size();
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        // "orphan" the previous contents so that the driver does not need to
+        // wait for a pending upload from this buffer to finish
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        void *data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        aa_assert(data);
+        std::memcpy(data, pixels, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        CHECK_ERROR(__FUNCTION__);
+
+        writePixels(nullptr); // offset 0 in the bound unpack buffer
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
         CHECK_ERROR(__FUNCTION__);
     }
 
@@ -323,9 +492,160 @@ public:
 
     int getTextureId() const final {
         aa_assert(texture && "cannot get texture ID of external frame buffer");
-        aa_assert(fullViewport() && "cannot use ROI as a texture");
         return texture->getId();
     }
+
+    TextureRegion getTextureRegion() const final {
+        return TextureRegion { viewport.x0, viewport.y0, viewport.width, viewport.height, width, height };
+    }
+
+    int getLayerCount() const final { return 1; }
+
+    FrameBuffer &getLayer(int index) final {
+        aa_assert(index == 0);
+        (void)index;
+        return *this;
+    }
+};
+
+class ArrayFrameBufferImplementation : public FrameBuffer {
+private:
+    const int width, height;
+    const ImageTypeSpec spec;
+    GLuint textureId = 0;
+    // references to a frame buffer object per layer
+    std::vector<GLuint> fbos;
+    std::vector< std::unique_ptr<FrameBuffer> > layers;
+
+public:
+    ArrayFrameBufferImplementation(int w, int h, int nLayers, const ImageTypeSpec &spec) :
+        width(w), height(h), spec(spec)
+    {
+        aa_assert(spec.storageType == Image::StorageType::GPU_OPENGL_ARRAY);
+        aa_assert(nLayers >= 1);
+        glGenTextures(1, &textureId);
+        glState::bindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+        allocateTexture3D(GL_TEXTURE_2D_ARRAY, w, h, nLayers, spec);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        CHECK_ERROR(__FUNCTION__);
+        LOG_TRACE("created texture array %d of size %d x %d x %d layers", textureId, w, h, nLayers);
+
+        // the layers look like normal frame buffers to everything else
+        const ImageTypeSpec layerSpec { spec.channels, spec.dataType, Image::StorageType::GPU_OPENGL };
+        fbos.resize(nLayers);
+        glGenFramebuffers(nLayers, fbos.data());
+        for (int i = 0; i < nLayers; ++i) {
+            glState::bindFramebuffer(fbos[i]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureId, 0, i);
+            aa_assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+            GLenum bufs[1] = { GL_COLOR_ATTACHMENT0 };
+            glDrawBuffers(1, bufs);
+            layers.push_back(FrameBuffer::createReference(fbos[i], w, h, layerSpec));
+        }
+        if (!glState::keepBindings()) {
+            glState::bindFramebuffer(0);
+            glState::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    ~ArrayFrameBufferImplementation() {
+        if (textureId != 0) log_warn("leaking texture array %d", textureId);
+    }
+
+    void destroy() final {
+        for (auto &layer : layers) layer->destroy();
+        layers.clear();
+        for (GLuint fbo : fbos) glState::deletedFramebuffer(fbo);
+        if (!fbos.empty()) glDeleteFramebuffers(GLsizei(fbos.size()), fbos.data());
+        fbos.clear();
+        if (textureId != 0) {
+            LOG_TRACE("deleting texture array %d", textureId);
+            glDeleteTextures(1, &textureId);
+            glState::deletedTexture(textureId);
+            textureId = 0;
+        }
+    }
+
+    std::unique_ptr<FrameBuffer> createROI(int x0, int y0, int w, int h) final {
+        (void)x0; (void)y0; (void)w; (void)h;
+        aa_assert(false && "ROIs of texture arrays are not supported");
+        return {};
+    }
+
+    int getViewportWidth() const final { return width; }
+    int getViewportHeight() const final { return height; }
+
+    void readPixels(uint8_t *pixels) final {
+        const std::size_t layerSize = width * height * spec.bytesPerPixel();
+        for (std::size_t i = 0; i < layers.size(); ++i) layers[i]->readPixels(pixels + i * layerSize);
+    }
+
+    std::function<bool(bool block)> readPixelsAsync(uint8_t *pixels) final {
+        const std::size_t layerSize = width * height * spec.bytesPerPixel();
+        std::shared_ptr< std::vector< std::function<bool(bool)> > > polls(new std::vector< std::function<bool(bool)> >);
+        for (std::size_t i = 0; i < layers.size(); ++i) {
+            polls->push_back(layers[i]->readPixelsAsync(pixels + i * layerSize));
+        }
+        return [polls](bool block) -> bool {
+            for (auto &poll : *polls) {
+                if (!poll) continue;
+                if (!poll(block)) return false;
+                poll = {};
+            }
+            return true;
+        };
+    }
+
+    void writePixels(const uint8_t *pixels) final {
+        glState::bindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+
+        // our CPU data is tightly packed and not 4-byte aligned (default)
+        GLint origUnpackAlignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &origUnpackAlignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        LOG_TRACE("writing to texture array %d", textureId);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+            width, height, GLsizei(layers.size()),
+            getCpuFormat(spec),
+            getCpuType(spec),
+            pixels);
+        CHECK_ERROR(__FUNCTION__);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, origUnpackAlignment);
+        if (!glState::keepBindings()) glState::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    void writePixelsStreaming(const uint8_t *pixels) final {
+        // the data has already been copied by the caller
+        writePixels(pixels);
+    }
+
+    void bind() final {
+        layers.at(0)->bind();
+    }
+
+    void unbind() final {
+        layers.at(0)->unbind();
+    }
+
+    void setViewport() final {
+        glState::viewport(0, 0, width, height);
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    int getId() const final { return layers.at(0)->getId(); }
+    int getTextureId() const final { return textureId; }
+    TextureRegion getTextureRegion() const final { return TextureRegion::full(width, height); }
+
+    int getLayerCount() const final { return int(layers.size()); }
+
+    FrameBuffer &getLayer(int index) final {
+        return *layers.at(index);
+    }
 };
 
 static GLuint loadShader(GLenum shaderType, const char* shaderSource) {
@@ -361,15 +681,14 @@ static GLuint loadShader(GLenum shaderType, const char* shaderSource) {
     return shader;
 }
 
-GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
-    const GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vertexSource);
-    const GLuint fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentSource);
+static GLuint linkProgram(const std::vector<GLuint> &shaders, bool retrievable) {
     const GLuint program = glCreateProgram();
     aa_assert(program);
-    glAttachShader(program, vertexShader);
-    CHECK_ERROR(__FUNCTION__);
-    glAttachShader(program, fragmentShader);
-    CHECK_ERROR(__FUNCTION__);
+    if (retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    for (GLuint shader : shaders) {
+        glAttachShader(program, shader);
+        CHECK_ERROR(__FUNCTION__);
+    }
     glLinkProgram(program);
     GLint linkStatus = GL_FALSE;
     glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
@@ -387,6 +706,18 @@ GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
     return program;
 }
 
+static GLuint compileProgram(const char* vertexSource, const char* fragmentSource, bool retrievable) {
+    const GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vertexSource);
+    const GLuint fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentSource);
+    return linkProgram({ vertexShader, fragmentShader }, retrievable);
+}
+
+GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
+    return getCachedProgram(vertexSource, fragmentSource, [vertexSource, fragmentSource](bool retrievable) -> int {
+        return compileProgram(vertexSource, fragmentSource, retrievable);
+    });
+}
+
 class GlslProgramImplementation : public GlslProgram {
 private:
     std::string vertSrc, fragSrc;
@@ -402,18 +733,20 @@ public:
 
     void bind() final {
         LOG_TRACE("activating shader: glUseProgram(%d)", program);
-        glUseProgram(program);
+        glState::useProgram(program);
     }
 
     void unbind() final {
+        if (glState::keepBindings()) return;
         LOG_TRACE("deactivating shader: glUseProgram(0)");
-        glUseProgram(0);
+        glState::useProgram(0);
     }
 
     void destroy() final {
         if (program != 0) {
             LOG_TRACE("deleting GL program %d", program);
             glDeleteProgram(program);
+            glState::deletedProgram(program);
             program = 0;
         }
     }
@@ -471,10 +804,9 @@ public:
     GlslFragmentShaderImplementation(const char *fragementShaderSource, bool withTexCoord = true)
     : program(vertexShaderSource(withTexCoord).c_str(), fragementShaderSource)
     {
+        aVertexData = glGetAttribLocation(program.getId(), "a_vertexData");
         glGenBuffers(1, &vertexBuffer);
         glGenBuffers(1, &vertexIndexBuffer);
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
 
         // Set up vertices
         float vertexData[] {
@@ -487,23 +819,40 @@ public:
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
 
-        // Set up indices
+        // Set up indices (the element array binding would be VAO state)
         GLuint indices[] { 2, 1, 0, 0, 3, 2 };
+        glBindBuffer(GL_ARRAY_BUFFER, vertexIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    // VAOs are not shared between contexts so the VAO is created in the
+    // context that draws, which may not be the one that built the program
+    void createVertexArray() {
+        glGenVertexArrays(1, &vao);
+        glState::bindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexIndexBuffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-        // Unbind evrything
-        glBindVertexArray(0); // Has to happen before unbinding other buffers
+        // The attribute setup and the element buffer binding are stored in
+        // the VAO so binding it is enough in bind()
+        glEnableVertexAttribArray(aVertexData);
+        glVertexAttribPointer(aVertexData, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-        aVertexData = glGetAttribLocation(program.getId(), "a_vertexData");
+        CHECK_ERROR(__FUNCTION__);
     }
 
     void destroy() final {
         if (vertexBuffer != 0) {
             glDeleteBuffers(1, &vertexBuffer);
             glDeleteBuffers(1, &vertexIndexBuffer);
+            vertexBuffer = 0;
+        }
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+            glState::deletedVertexArray(vao);
+            vao = 0;
         }
         program.destroy();
     }
@@ -513,42 +862,34 @@ public:
 
     void bind() final {
         program.bind();
-
-        glBindVertexArray(vao);
-        CHECK_ERROR(__FUNCTION__);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexIndexBuffer);
-        CHECK_ERROR(__FUNCTION__);
-
-        glEnableVertexAttribArray(aVertexData);
-        glVertexAttribPointer(aVertexData, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+        if (vao == 0) createVertexArray();
+        else glState::bindVertexArray(vao);
         CHECK_ERROR(__FUNCTION__);
     }
 
     void unbind() final {
-        glDisableVertexAttribArray(aVertexData);
-        CHECK_ERROR(__FUNCTION__);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        CHECK_ERROR(__FUNCTION__);
-        glBindVertexArray(0);
-        CHECK_ERROR(__FUNCTION__);
-
+        if (!glState::keepBindings()) {
+            glState::bindVertexArray(0);
+            CHECK_ERROR(__FUNCTION__);
+        }
         program.unbind();
     }
 
     void call(FrameBuffer &frameBuffer) final {
         LOG_TRACE("call with frame buffer %d", frameBuffer.getId());
+        Binder frameBufferBinder(frameBuffer);
+        frameBuffer.setViewport();
+        draw(frameBuffer.getId() == 0);
+    }
+
+    /** Draw to the currently bound frame buffer */
+    void draw(bool isScreen) {
         // might typically be enabled, thus checking
         GlFlagSetter<GL_DEPTH_TEST, false> noDepthTest;
         GlFlagSetter<GL_BLEND, false> noBlend;
         // GlFlagSetter<GL_ALPHA_TEST, false> noAlphaTest;
 
-        Binder frameBufferBinder(frameBuffer);
-        frameBuffer.setViewport();
-
-        if (frameBuffer.getId() == 0) {
+        if (isScreen) {
             #ifndef ACCELERATED_ARRAYS_USE_OPENGL_ES
                 // probably not changed, but good to set explicitly
                 GLint origDrawBuffer;
@@ -579,52 +920,94 @@ public:
     }
 };
 
+// suffixes of the uniforms of each input: the sampler and the ones that map
+// texture coordinates to the bound TextureRegion, see inputDeclarations
+constexpr const char *SAMPLER_SUFFIX = "Sampler";
+constexpr const char *REGION_SUFFIX = "Region";
+constexpr const char *BOUNDS_SUFFIX = "Bounds";
+constexpr const char *RECT_SUFFIX = "Rect";
+
 class TextureUniformBinder : public Binder::Target {
 public:
     const unsigned slot;
-    const GLuint bindType, uniformId;
+    const GLuint bindType;
+    const GLint uniformId, regionUniform, boundsUniform, rectUniform;
     int textureId = -1;
+    // all zeros: a full texture of unknown size
+    TextureRegion region = TextureRegion { 0, 0, 0, 0, 0, 0 };
     Image::Border border = Image::Border::UNDEFINED;
     Image::Interpolation interpolation = Image::Interpolation::NEAREST;
+    int uniformSlot = -1;
+    int uniformRegion[6] = { -1, -1, -1, -1, -1, -1 };
 
-    TextureUniformBinder(unsigned slot, GLuint bindType, GLuint uniformId)
-    : slot(slot), bindType(bindType), uniformId(uniformId) {
+    TextureUniformBinder(unsigned slot, GLuint bindType, GLuint program, const std::string &name)
+    :
+        slot(slot),
+        bindType(bindType),
+        uniformId(glGetUniformLocation(program, (name + SAMPLER_SUFFIX).c_str())),
+        regionUniform(glGetUniformLocation(program, (name + REGION_SUFFIX).c_str())),
+        boundsUniform(glGetUniformLocation(program, (name + BOUNDS_SUFFIX).c_str())),
+        rectUniform(glGetUniformLocation(program, (name + RECT_SUFFIX).c_str()))
+    {
         LOG_TRACE("got texture uniform %d for slot %u", uniformId, slot);
     }
 
     void bind() final {
         LOG_TRACE("bind texture / uniform at slot %u -> %d", slot, textureId);
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(bindType, textureId);
-
-        const int interpType = getGlInterpType();
-        if (interpType != 0) {
-            LOG_TRACE("set texture interpolation 0x%x", interpType);
-            glTexParameteri(bindType, GL_TEXTURE_MAG_FILTER, interpType);
-            glTexParameteri(bindType, GL_TEXTURE_MIN_FILTER, interpType);
-        }
-        const int borderType = getGlBorderType();
-        if (borderType != 0) {
-            LOG_TRACE("set border type 0x%x", borderType);
-            glTexParameteri(bindType, GL_TEXTURE_WRAP_S, borderType);
-            glTexParameteri(bindType, GL_TEXTURE_WRAP_T, borderType);
-        }
-
-        glUniform1i(uniformId, slot);
+        glState::activeTexture(slot);
+        glState::bindTexture(bindType, textureId);
+
+        // sampler objects override the texture parameters. Undefined ones
+        // use the defaults of textures created by this library
+        int interpType = getGlInterpType();
+        if (interpType == 0) interpType = GL_NEAREST;
+        int borderType = getGlBorderType();
+        if (borderType == 0) borderType = bindType == GL_TEXTURE_2D ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+        LOG_TRACE("texture interpolation 0x%x, border type 0x%x", interpType, borderType);
+        glState::bindSampler(slot, glState::getSampler(interpType, borderType));
+
+        const int s = int(slot);
+        if (glState::updateUniform(&uniformSlot, &s, 1)) glUniform1i(uniformId, slot);
+
+        const int r[6] = { region.x0, region.y0, region.width, region.height, region.textureWidth, region.textureHeight };
+        if (glState::updateUniform(uniformRegion, r, 6)) setRegionUniforms();
     }
 
     void unbind() final {
+        if (glState::keepBindings()) return;
         LOG_TRACE("unbind texture / uniform at slot %u", slot);
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(bindType, 0);
+        glState::activeTexture(slot);
+        glState::bindTexture(bindType, 0);
+        glState::bindSampler(slot, 0);
         // restore active texture to the default slot
-        glActiveTexture(GL_TEXTURE0);
+        glState::activeTexture(0);
     }
 
     // avoid clang warning
     virtual ~TextureUniformBinder() = default;
 
 private:
+    void setRegionUniforms() {
+        LOG_TRACE("texture region at slot %u: %d x %d at (%d, %d)", slot, region.width, region.height, region.x0, region.y0);
+        if (region.textureWidth == 0 || region.isFull()) {
+            // no clamping so that the border mode of the sampler applies
+            const float m = std::numeric_limits<float>::max();
+            glUniform4f(regionUniform, 0, 0, 1, 1);
+            glUniform4f(boundsUniform, -m, -m, m, m);
+        } else {
+            const float tw = region.textureWidth, th = region.textureHeight;
+            glUniform4f(regionUniform, region.x0 / tw, region.y0 / th, region.width / tw, region.height / th);
+            // the outermost pixel centers, like GL_CLAMP_TO_EDGE
+            glUniform4f(boundsUniform,
+                (region.x0 + 0.5f) / tw,
+                (region.y0 + 0.5f) / th,
+                (region.x0 + region.width - 0.5f) / tw,
+                (region.y0 + region.height - 0.5f) / th);
+        }
+        glUniform4i(rectUniform, region.x0, region.y0, region.width, region.height);
+        CHECK_ERROR(__FUNCTION__);
+    }
+
     int getGlBorderType() const {
         switch (border) {
             case Image::Border::UNDEFINED: return 0;
@@ -653,52 +1036,145 @@ private:
     }
 };
 
-class GlslPipelineImplementation : public GlslPipeline {
-private:
-    GLuint outSizeUniform;
-    GlslFragmentShaderImplementation program;
-    std::vector<TextureUniformBinder> textureBinders;
+// uniform names shared by GlslPipeline and GlslComputeShader
+static std::string textureName(unsigned index, unsigned nTextures) {
+    std::ostringstream oss;
+    aa_assert(index < nTextures);
+    oss << "u_texture";
+    if (nTextures >= 2 || index > 1) {
+        oss << (index + 1);
+    }
+    return oss.str();
+}
 
-    std::string textureName(unsigned index, unsigned nTextures) const {
-        std::ostringstream oss;
-        aa_assert(index < nTextures);
-        oss << "u_texture";
-        if (nTextures >= 2 || index > 1) {
-            oss << (index + 1);
-        }
-        return oss.str();
+static std::string outSizeName() {
+    return "u_outSize";
+}
+
+static std::string layerName() {
+    return "u_layer";
+}
+
+static bool hasStorageType(const std::vector<ImageTypeSpec> &inputs, ImageTypeSpec::StorageType stype) {
+    for (const auto &in : inputs)
+        if (in.storageType == stype) return true;
+    return false;
+}
+
+/**
+ * Declares the input samplers and overrides texture, textureLod, texelFetch
+ * and textureSize with functions that map the coordinates to the bound
+ * TextureRegion (see TextureUniformBinder) and read the layer u_layer of
+ * texture arrays, so that the same shader bodies work with all of them.
+ * aa_isRegion(sampler) is true if the input is only a part of a texture.
+ *
+ * GLSL ES has no token pasting, so each sampler name, e.g., u_texture, is
+ * a macro for the actual sampler and its region uniforms, which are passed
+ * on together. The samplers cannot be used with other functions
+ */
+static std::string inputDeclarations(const std::vector<ImageTypeSpec> &inputs) {
+    std::ostringstream oss;
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        const std::string name = textureName(i, inputs.size());
+        oss << "uniform "
+            << getGlslPrecision(inputs.at(i)) << " "
+            << getGlslSamplerType(inputs.at(i)) << " "
+            << name << SAMPLER_SUFFIX << ";\n";
+        // offset and scale of the texture coordinates, clamp range of
+        // texture() and the pixel rectangle (0 x 0: the full texture)
+        oss << "uniform vec4 " << name << REGION_SUFFIX << ";\n"
+            << "uniform vec4 " << name << BOUNDS_SUFFIX << ";\n"
+            << "uniform highp ivec4 " << name << RECT_SUFFIX << ";\n";
+        oss << "#define " << name << " "
+            << name << SAMPLER_SUFFIX << ", "
+            << name << REGION_SUFFIX << ", "
+            << name << BOUNDS_SUFFIX << ", "
+            << name << RECT_SUFFIX << "\n";
     }
+    if (inputs.empty()) return oss.str();
 
-    static std::string outSizeName() {
-        return "u_outSize";
+    if (hasStorageType(inputs, ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY)) {
+        oss << "uniform int " << layerName() << ";\n";
+    }
+    std::set<std::string> samplers;
+    for (const auto &in : inputs) {
+        const std::string sampler = getGlslSamplerType(in);
+        if (!samplers.insert(sampler).second) continue;
+        const std::string prefix = sampler.substr(0, sampler.find("sampler"));
+        // highp: the default int precision of fragment shaders is mediump
+        const std::string vec4 = "highp " + prefix + "vec4";
+        const std::string params = "highp " + sampler + " s, vec4 r, vec4 b, highp ivec4 p";
+        std::string coord = "c", pixel = "p.xy + c", size = "textureSize(s, l)";
+        if (in.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY) {
+            coord = "vec3(c, float(" + layerName() + "))";
+            pixel = "ivec3(p.xy + c, " + layerName() + ")";
+            size += ".xy";
+        }
+        oss << vec4 << " aa_texture(" << params << ", vec2 c) {\n"
+            << "    c = clamp(r.xy + c * r.zw, b.xy, b.zw);\n"
+            << "    return texture(s, " << coord << ");\n"
+            << "}\n"
+            << vec4 << " aa_texelFetch(" << params << ", highp ivec2 c, int l) { return texelFetch(s, " << pixel << ", l); }\n"
+            << "highp ivec2 aa_textureSize(" << params << ", int l) { return p.z > 0 ? p.zw : " << size << "; }\n"
+            // texture() clamps only parts of textures, whose bounds are positive
+            << "bool aa_isRegion(" << params << ") { return b.x >= 0.0; }\n";
+        // not defined for samplerExternalOES by GL_OES_EGL_image_external_essl3
+        if (in.storageType != ImageTypeSpec::StorageType::GPU_OPENGL_EXTERNAL) {
+            oss << vec4 << " aa_textureLod(" << params << ", vec2 c, float l) {\n"
+                << "    c = clamp(r.xy + c * r.zw, b.xy, b.zw);\n"
+                << "    return textureLod(s, " << coord << ", l);\n"
+                << "}\n";
+        }
     }
+    oss << "#define texture(s, c) aa_texture(s, c)\n"
+        << "#define textureLod(s, c, l) aa_textureLod(s, c, l)\n"
+        << "#define texelFetch(s, c, l) aa_texelFetch(s, c, l)\n"
+        << "#define textureSize(s, l) aa_textureSize(s, l)\n";
+    return oss.str();
+}
 
-    static bool hasExternal(const std::vector<ImageTypeSpec> &inputs) {
-        for (const auto &in : inputs)
-            if (getBindType(in) != GL_TEXTURE_2D) return true;
-        return false;
+class GlslPipelineImplementation : public GlslPipeline {
+private:
+    GLuint outSizeUniform;
+    int outSize[2] = { -1, -1 };
+    // -1 if there are no texture array inputs
+    GLint layerUniform = -1;
+    int layer = -1;
+    const std::size_t nOutputs;
+    GlslFragmentShaderImplementation program;
+    std::vector<TextureUniformBinder> textureBinders;
+    // frame buffer for multiple render targets, created on first use
+    GLuint multiTargetFbo = 0;
+    bool unclampedColor = false;
+    const std::vector<ImageTypeSpec> outputSpecs;
+
+    void setColorClamp() {
+        #if !defined(ACCELERATED_ARRAYS_USE_OPENGL_ES) && !defined(__APPLE__)
+            //constexpr int GL_CLAMP_FRAGMENT_COLOR = 0x891B;
+            if (unclampedColor) glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
+        #endif
     }
 
-    std::string buildShaderSource(const char *fragmentMain, const std::vector<ImageTypeSpec> &inputs, const ImageTypeSpec &output) const {
+    std::string buildShaderSource(const char *fragmentMain, const std::vector<ImageTypeSpec> &inputs, const std::vector<ImageTypeSpec> &outputs) const {
         std::ostringstream oss;
         #ifdef __APPLE__
             oss << "#version 330\n";
         #else
             oss << "#version 300 es\n";
         #endif // __APPLE__
-        if (hasExternal(inputs)) {
+        if (hasStorageType(inputs, ImageTypeSpec::StorageType::GPU_OPENGL_EXTERNAL)) {
             oss << "#extension GL_OES_EGL_image_external_essl3 : require\n";
         }
         oss << "precision highp float;\n";
-        oss << "layout(location = 0) out " << getGlslVecType(output) << " outValue;\n";
-
-        for (std::size_t i = 0; i < inputs.size(); ++i) {
-            oss << "uniform "
-                << getGlslPrecision(inputs.at(i)) << " "
-                << getGlslSamplerType(inputs.at(i)) << " "
-                << textureName(i, inputs.size()) << ";\n";
+        if (outputs.size() == 1) {
+            oss << "layout(location = 0) out " << getGlslVecType(outputs.at(0)) << " outValue;\n";
+        } else {
+            for (std::size_t i = 0; i < outputs.size(); ++i) {
+                oss << "layout(location = " << i << ") out " << getGlslVecType(outputs.at(i)) << " outValue" << i << ";\n";
+            }
         }
 
+        oss << inputDeclarations(inputs);
         oss << "uniform ivec2 " << outSizeName() << ";\n";
         oss << "in vec2 v_texCoord;\n";
         oss << fragmentMain;
@@ -708,22 +1184,32 @@ private:
     }
 
 public:
-    GlslPipelineImplementation(const char *fragmentMain, const std::vector<ImageTypeSpec> &inputs, const ImageTypeSpec &output)
+    GlslPipelineImplementation(const char *fragmentMain, const std::vector<ImageTypeSpec> &inputs, const std::vector<ImageTypeSpec> &outputs)
     :
         outSizeUniform(0),
-        program(buildShaderSource(fragmentMain, inputs, output).c_str())
+        nOutputs(outputs.size()),
+        program(buildShaderSource(fragmentMain, inputs, outputs).c_str()),
+        outputSpecs(outputs)
     {
+        aa_assert(!outputs.empty());
         outSizeUniform = glGetUniformLocation(program.getId(), outSizeName().c_str());
+        layerUniform = glGetUniformLocation(program.getId(), layerName().c_str());
         for (std::size_t i = 0; i < inputs.size(); ++i) {
             textureBinders.push_back(TextureUniformBinder(
                 i,
                 getBindType(inputs.at(i)),
-                glGetUniformLocation(program.getId(), textureName(i, inputs.size()).c_str())
+                program.getId(),
+                textureName(i, inputs.size())
             ));
         }
         CHECK_ERROR(__FUNCTION__);
 
-        if (ImageTypeSpec::isFixedPoint(output.dataType) && ImageTypeSpec::isSigned(output.dataType)) {
+        bool signedFixedPointOutput = false;
+        for (const auto &output : outputs) {
+            if (ImageTypeSpec::isFixedPoint(output.dataType) && ImageTypeSpec::isSigned(output.dataType))
+                signedFixedPointOutput = true;
+        }
+        if (signedFixedPointOutput) {
             // https://www.reddit.com/r/opengl/comments/bqe1jo/how_to_render_to_a_snorm_texture/
             #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
                 // NOTE: it is possible to tolerate this but then it's possible
@@ -739,16 +1225,22 @@ public:
                     assert(false);
                 #else
                     log_warn("SNORM render target requires GL bug fixes only found on Reddit. Use with caution.");
-                    //constexpr int GL_CLAMP_FRAGMENT_COLOR = 0x891B;
-                    glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
+                    // context state: set before drawing since the pipeline
+                    // may be built in another (shared) context
+                    unclampedColor = true;
                 #endif
             #endif
         }
     }
 
     Binder::Target &bindTexture(unsigned index, int textureId) final {
+        return bindTexture(index, textureId, TextureRegion { 0, 0, 0, 0, 0, 0 });
+    }
+
+    Binder::Target &bindTexture(unsigned index, int textureId, const TextureRegion &region) final {
         auto &binder = textureBinders.at(index);
         binder.textureId = textureId;
+        binder.region = region;
         return binder;
     }
 
@@ -760,16 +1252,97 @@ public:
         textureBinders.at(index).border = b;
     }
 
+    void setOutSize(int w, int h) {
+        const int size[2] = { w, h };
+        if (glState::updateUniform(outSize, size, 2)) {
+            LOG_TRACE("setting out size uniform to %d x %d", w, h);
+            glUniform2i(outSizeUniform, w, h);
+        }
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    void setLayer(int l) {
+        if (layerUniform >= 0 && glState::updateUniform(&layer, &l, 1)) {
+            glUniform1i(layerUniform, l);
+        }
+    }
+
     void call(FrameBuffer &frameBuffer) final {
-        const int w = frameBuffer.getViewportWidth(), h =  frameBuffer.getViewportHeight();
-        LOG_TRACE("setting out size uniform to %d x %d", w, h);
-        glUniform2i(outSizeUniform, w, h);
+        aa_assert(nOutputs == 1);
+        setOutSize(frameBuffer.getViewportWidth(), frameBuffer.getViewportHeight());
+        setColorClamp();
+        const int nLayers = frameBuffer.getLayerCount();
+        if (nLayers == 1) {
+            setLayer(0);
+            program.call(frameBuffer);
+            return;
+        }
+        // the program and the inputs stay bound for all the layers
+        for (int l = 0; l < nLayers; ++l) {
+            setLayer(l);
+            program.call(frameBuffer.getLayer(l));
+        }
+    }
+
+    void call(const std::vector<int> &outputTextureIds, int width, int height) final {
+        aa_assert(outputTextureIds.size() == nOutputs);
+        setOutSize(width, height);
+
+        if (multiTargetFbo == 0) {
+            glGenFramebuffers(1, &multiTargetFbo);
+            glState::bindFramebuffer(multiTargetFbo);
+            std::vector<GLenum> bufs;
+            for (std::size_t i = 0; i < nOutputs; ++i) bufs.push_back(GL_COLOR_ATTACHMENT0 + i);
+            glDrawBuffers(GLsizei(bufs.size()), bufs.data());
+            LOG_TRACE("generated multiple render target frame buffer %d", multiTargetFbo);
+        } else {
+            glState::bindFramebuffer(multiTargetFbo);
+        }
 
+        // always re-attached: the IDs of deleted textures may be reused
+        for (std::size_t i = 0; i < nOutputs; ++i) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, outputTextureIds.at(i), 0);
+        }
+        CHECK_ERROR(__FUNCTION__);
+        aa_assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+        glState::viewport(0, 0, width, height);
+        setColorClamp();
+        program.draw(false);
+        if (!glState::keepBindings()) glState::bindFramebuffer(0);
+    }
+
+    void warmUp() final {
+        std::vector< std::unique_ptr<FrameBuffer> > targets;
+        std::vector<int> targetIds;
+        for (const auto &spec : outputSpecs) {
+            const ImageTypeSpec targetSpec { spec.channels, spec.dataType, Image::StorageType::GPU_OPENGL };
+            targets.push_back(FrameBuffer::create(1, 1, targetSpec));
+            targetIds.push_back(targets.back()->getTextureId());
+        }
+        {
+            Binder binder(*this);
+            // texture 0 on each input slot so that the samplers of different
+            // types do not all point to the same unit
+            for (auto &t : textureBinders) {
+                t.textureId = 0;
+                t.bind();
+            }
+            call(targetIds, 1, 1);
+            for (auto &t : textureBinders) t.unbind();
+        }
+        for (auto &t : targets) t->destroy();
         CHECK_ERROR(__FUNCTION__);
-        program.call(frameBuffer);
     }
 
-    void destroy() final { program.destroy(); }
+    void destroy() final {
+        if (multiTargetFbo != 0) {
+            glDeleteFramebuffers(1, &multiTargetFbo);
+            glState::deletedFramebuffer(multiTargetFbo);
+            multiTargetFbo = 0;
+        }
+        program.destroy();
+    }
     void bind() final { program.bind(); }
     void unbind() final { program.unbind(); }
     int getId() const final { return program.getId(); }
@@ -777,6 +1350,307 @@ public:
     std::string getVertexShaderSource() const { return program.getVertexShaderSource(); }
 };
 
+#ifdef ACCELERATED_ARRAYS_OPENGL_COMPUTE
+class GlslComputeShaderImplementation : public GlslComputeShader {
+private:
+    const int groupWidth, groupHeight;
+    const GLenum outputFormat;
+    const ImageTypeSpec outputSpec;
+    std::string source;
+    GLuint program;
+    GLuint outSizeUniform, outOffsetUniform;
+    int outSize[2] = { -1, -1 };
+    int outOffset[2] = { -1, -1 };
+    std::vector<TextureUniformBinder> textureBinders;
+
+    static std::string outOffsetName() {
+        return "u_outOffset";
+    }
+
+    static std::string buildShaderSource(const char *computeMain, const std::vector<ImageTypeSpec> &inputs, const ImageTypeSpec &output, int groupWidth, int groupHeight) {
+        const std::string imageFormat = getGlslImageFormat(output);
+        aa_assert(!imageFormat.empty() && "output format not supported by compute shaders");
+
+        std::ostringstream oss;
+        #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+            oss << "#version 310 es\n";
+        #else
+            oss << "#version 430\n";
+        #endif
+        oss << "precision highp float;\n";
+        oss << "precision highp int;\n";
+        oss << "layout(local_size_x = " << groupWidth << ", local_size_y = " << groupHeight << ") in;\n";
+        oss << "layout(" << imageFormat << ", binding = 0) writeonly uniform highp "
+            << getGlslImageType(output) << " u_outImage;\n";
+
+        for (const auto &in : inputs) aa_assert(getBindType(in) == GL_TEXTURE_2D);
+        oss << inputDeclarations(inputs);
+
+        oss << "uniform ivec2 " << outSizeName() << ";\n";
+        // origin of the output region (ROI) in the output texture
+        oss << "uniform ivec2 " << outOffsetName() << ";\n";
+
+        // image stores always take 4-vectors. Only 1 and 4-channel formats
+        // are supported so this "broadcast" is correct for both
+        const std::string vec4Type = getGlslVecType(ImageTypeSpec { 4, output.dataType, output.storageType });
+        oss << "void storeOutValue(ivec2 coord, " << getGlslVecType(output) << " value) {\n"
+            << "    imageStore(u_outImage, " << outOffsetName() << " + coord, " << vec4Type << "(value));\n"
+            << "}\n";
+        oss << computeMain;
+        oss << std::endl;
+
+        return oss.str();
+    }
+
+public:
+    GlslComputeShaderImplementation(const char *computeMain, const std::vector<ImageTypeSpec> &inputs, const ImageTypeSpec &output, int groupWidth, int groupHeight)
+    :
+        groupWidth(groupWidth),
+        groupHeight(groupHeight),
+        outputFormat(getTextureInternalFormat(output)),
+        outputSpec(output),
+        source(buildShaderSource(computeMain, inputs, output, groupWidth, groupHeight)),
+        program(0),
+        outSizeUniform(0),
+        outOffsetUniform(0)
+    {
+        aa_assert(supportsComputeShaders());
+        aa_assert(groupWidth > 0 && groupHeight > 0);
+        // compute programs have no vertex shader, the empty string keeps
+        // their program binary cache keys distinct from the others
+        const char *src = source.c_str();
+        program = getCachedProgram("", src, [src](bool retrievable) -> int {
+            return linkProgram({ loadShader(GL_COMPUTE_SHADER, src) }, retrievable);
+        });
+        outSizeUniform = glGetUniformLocation(program, outSizeName().c_str());
+        outOffsetUniform = glGetUniformLocation(program, outOffsetName().c_str());
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            textureBinders.push_back(TextureUniformBinder(
+                i,
+                GL_TEXTURE_2D,
+                program,
+                textureName(i, inputs.size())
+            ));
+        }
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    ~GlslComputeShaderImplementation() {
+        if (program != 0) {
+            log_warn("leaking GL compute program %d", program);
+        }
+    }
+
+    Binder::Target &bindTexture(unsigned index, int textureId) final {
+        return bindTexture(index, textureId, TextureRegion { 0, 0, 0, 0, 0, 0 });
+    }
+
+    Binder::Target &bindTexture(unsigned index, int textureId, const TextureRegion &region) final {
+        auto &binder = textureBinders.at(index);
+        binder.textureId = textureId;
+        binder.region = region;
+        return binder;
+    }
+
+    void setTextureInterpolation(unsigned index, ::accelerated::Image::Interpolation i) final {
+        textureBinders.at(index).interpolation = i;
+    }
+
+    void setTextureBorder(unsigned index, ::accelerated::Image::Border b) final {
+        textureBinders.at(index).border = b;
+    }
+
+    void call(int outputTextureId, int width, int height) final {
+        call(outputTextureId, TextureRegion::full(width, height));
+    }
+
+    void call(int outputTextureId, const TextureRegion &outputRegion) final {
+        const int width = outputRegion.width, height = outputRegion.height;
+        const int size[2] = { width, height };
+        if (glState::updateUniform(outSize, size, 2)) glUniform2i(outSizeUniform, width, height);
+        const int offset[2] = { outputRegion.x0, outputRegion.y0 };
+        if (glState::updateUniform(outOffset, offset, 2)) glUniform2i(outOffsetUniform, offset[0], offset[1]);
+
+        glBindImageTexture(0, outputTextureId, 0, GL_FALSE, 0, GL_WRITE_ONLY, outputFormat);
+        glDispatchCompute(
+            (width + groupWidth - 1) / groupWidth,
+            (height + groupHeight - 1) / groupHeight,
+            1);
+        // make the image writes visible to whatever may read the output
+        // texture next: other shaders, glReadPixels or texture uploads
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+            GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+            GL_FRAMEBUFFER_BARRIER_BIT |
+            GL_PIXEL_BUFFER_BARRIER_BIT |
+            GL_TEXTURE_UPDATE_BARRIER_BIT);
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    void warmUp() final {
+        auto target = FrameBuffer::create(1, 1, outputSpec);
+        {
+            Binder binder(*this);
+            for (auto &t : textureBinders) {
+                t.textureId = 0;
+                t.bind();
+            }
+            call(target->getTextureId(), 1, 1);
+            for (auto &t : textureBinders) t.unbind();
+        }
+        target->destroy();
+        CHECK_ERROR(__FUNCTION__);
+    }
+
+    void bind() final {
+        glState::useProgram(program);
+    }
+
+    void unbind() final {
+        if (glState::keepBindings()) return;
+        glState::useProgram(0);
+    }
+
+    void destroy() final {
+        if (program != 0) {
+            LOG_TRACE("deleting GL compute program %d", program);
+            glDeleteProgram(program);
+            glState::deletedProgram(program);
+            program = 0;
+        }
+    }
+
+    int getId() const final { return program; }
+    std::string getComputeShaderSource() const final { return source; }
+};
+#endif
+
+// > 0 while a poll function is being called in this thread. If a re-enqueued
+// poll starts while this is set, the processor is synchronous
+thread_local int pollDepth = 0;
+
+// unsuccessful polls re-enqueued immediately, before backing off
+constexpr int POLL_SPIN_COUNT = 4;
+constexpr int MAX_POLL_BACKOFF_MICROS = 1000;
+
+// Runs the given functions after a delay in a helper thread, so that
+// waiting does not block the GL thread
+class DelayedCalls {
+private:
+    typedef std::chrono::steady_clock Clock;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::multimap< Clock::time_point, std::function<void()> > pending;
+    bool shouldQuit = false;
+    std::thread thread; // last: started after the other members
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!shouldQuit) {
+            if (pending.empty()) {
+                condition.wait(lock);
+                continue;
+            }
+            auto first = pending.begin();
+            if (Clock::now() < first->first) {
+                condition.wait_until(lock, first->first);
+                continue;
+            }
+            auto f = std::move(first->second);
+            pending.erase(first);
+            lock.unlock();
+            f();
+            lock.lock();
+        }
+    }
+
+    DelayedCalls() : thread([this]() { run(); }) {}
+
+public:
+    ~DelayedCalls() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shouldQuit = true;
+        }
+        condition.notify_all();
+        thread.join();
+    }
+
+    void add(std::chrono::microseconds delay, const std::function<void()> &f) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.emplace(Clock::now() + delay, f);
+        }
+        condition.notify_all();
+    }
+
+    static DelayedCalls &instance() {
+        static DelayedCalls calls;
+        return calls;
+    }
+};
+
+struct PollTask {
+    Processor &processor;
+    std::function<bool(bool)> poll;
+    std::unique_ptr<Promise> promise;
+    int misses = 0;
+
+    static void enqueue(std::shared_ptr<PollTask> task) {
+        task->processor.enqueue([task]() {
+            const bool block = pollDepth > 0;
+            pollDepth++;
+            const bool done = task->poll(block);
+            aa_assert(done || !block);
+            if (!done) {
+                if (++task->misses > POLL_SPIN_COUNT) {
+                    // do not spin in the GL thread if the GPU is slow, but
+                    // keep processing other tasks: re-enqueue after
+                    // 50us, 100us, ..., up to 1ms from the helper thread
+                    const int shift = std::min(task->misses - POLL_SPIN_COUNT - 1, 5);
+                    DelayedCalls::instance().add(
+                        std::chrono::microseconds(std::min(50 << shift, MAX_POLL_BACKOFF_MICROS)),
+                        [task]() { enqueue(task); });
+                } else {
+                    enqueue(task);
+                }
+            }
+            pollDepth--;
+            if (done) task->promise->resolve();
+        });
+    }
+};
+}
+
+Future pollInGlThread(Processor &processor, const std::function<bool(bool block)> &poll) {
+    std::shared_ptr<PollTask> task(new PollTask { processor, poll, Promise::create() });
+    auto future = task->promise->getFuture();
+    PollTask::enqueue(task);
+    return future;
+}
+
+bool supportsComputeShaders() {
+#ifdef ACCELERATED_ARRAYS_OPENGL_COMPUTE
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+        return major > 3 || (major == 3 && minor >= 1);
+    #else
+        return major > 4 || (major == 4 && minor >= 3);
+    #endif
+#else
+    return false;
+#endif
+}
+
+std::function<bool(bool block)> insertFence() {
+    std::shared_ptr<GLsync> fence(new GLsync(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)));
+    aa_assert(*fence);
+    CHECK_ERROR(__FUNCTION__);
+    return [fence](bool block) -> bool {
+        if (*fence == nullptr) return true;
+        return waitAndDeleteSync(*fence, block);
+    };
 }
 
 Binder::Binder(Target &target) : target(target) { target.bind(); }
@@ -801,6 +1675,10 @@ std::unique_ptr<FrameBuffer> FrameBuffer::createScreenReference(int w, int h) {
     return createReference(0, w, h, *spec);
 }
 
+std::unique_ptr<FrameBuffer> FrameBuffer::createArray(int w, int h, int layers, const ImageTypeSpec &spec) {
+    return std::unique_ptr<FrameBuffer>(new ArrayFrameBufferImplementation(w, h, layers, spec));
+}
+
 std::unique_ptr<GlslProgram> GlslProgram::create(const char *vs, const char *fs) {
     return std::unique_ptr<GlslProgram>(new GlslProgramImplementation(vs, fs));
 }
@@ -810,7 +1688,21 @@ std::unique_ptr<GlslFragmentShader> GlslFragmentShader::create(const char *frage
 }
 
 std::unique_ptr<GlslPipeline> GlslPipeline::create(const char *fragmentMain, const std::vector<ImageTypeSpec> &inputs, const ImageTypeSpec &output) {
-    return std::unique_ptr<GlslPipeline>(new GlslPipelineImplementation(fragmentMain, inputs, output));
+    return std::unique_ptr<GlslPipeline>(new GlslPipelineImplementation(fragmentMain, inputs, { output }));
+}
+
+std::unique_ptr<GlslPipeline> GlslPipeline::create(const char *fragmentMain, const std::vector<ImageTypeSpec> &inputs, const std::vector<ImageTypeSpec> &outputs) {
+    return std::unique_ptr<GlslPipeline>(new GlslPipelineImplementation(fragmentMain, inputs, outputs));
+}
+
+std::unique_ptr<GlslComputeShader> GlslComputeShader::create(const char *computeMain, const std::vector<ImageTypeSpec> &inputs, const ImageTypeSpec &output, int workGroupWidth, int workGroupHeight) {
+#ifdef ACCELERATED_ARRAYS_OPENGL_COMPUTE
+    return std::unique_ptr<GlslComputeShader>(new GlslComputeShaderImplementation(computeMain, inputs, output, workGroupWidth, workGroupHeight));
+#else
+    (void)computeMain; (void)inputs; (void)output; (void)workGroupWidth; (void)workGroupHeight;
+    aa_assert(false && "compiled without compute shader support");
+    return {};
+#endif
 }
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -9,6 +10,10 @@
 
 #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
     #include <GLES3/gl3.h>
+    #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES_3_1
+        #include <GLES3/gl31.h>
+        #define ACCELERATED_ARRAYS_OPENGL_COMPUTE
+    #endif
     #include <GLES3/gl3ext.h>
     // NDK bug workaround: https://stackoverflow.com/a/31025110
     #define __gl2_h_
@@ -20,6 +25,7 @@
         #include <OpenGL/gl3ext.h>
     #else
         #include <GL/gl.h>
+        #define ACCELERATED_ARRAYS_OPENGL_COMPUTE
     #endif // __APPLE__
 #endif
 
@@ -27,6 +33,8 @@
 
 namespace accelerated {
 namespace opengl {
+namespace operations { struct GpuTimingStatistics; }
+
 void checkError(const char *tag);
 int getTextureInternalFormat(const ImageTypeSpec &spec);
 int getCpuFormat(const ImageTypeSpec &spec);
@@ -37,8 +45,54 @@ std::string getGlslPrecision(const ImageTypeSpec &spec);
 std::string getGlslSamplerType(const ImageTypeSpec &spec);
 std::string getGlslScalarType(const ImageTypeSpec &spec);
 std::string getGlslVecType(const ImageTypeSpec &spec);
+/**
+ * Image load/store format qualifier (e.g., "rgba32f") or an empty string if
+ * the texture format of the spec cannot be used as a compute shader image.
+ * Only the formats guaranteed by OpenGL ES 3.1 are supported
+ */
+std::string getGlslImageFormat(const ImageTypeSpec &spec);
+std::string getGlslImageType(const ImageTypeSpec &spec);
+/**
+ * True if textures of this spec support GL_LINEAR filtering without
+ * extensions (e.g., not integer textures or 32-bit floats on OpenGL ES)
+ */
+bool isLinearFilterable(const ImageTypeSpec &spec);
 std::unique_ptr<ImageTypeSpec> getScreenImageTypeSpec();
 
+/**
+ * Call the poll function in the GL thread until it returns true. Between
+ * the calls, the function is re-enqueued so that the processor can run
+ * other tasks. After a few unsuccessful polls, the function is
+ * re-enqueued after a delay (up to 1 ms) by a helper thread, instead of
+ * spinning, while the GL thread keeps processing the other tasks. The
+ * processor must not be destroyed before the returned Future resolves.
+ * If the processor turns out to be synchronous, the poll function is
+ * called with block = true instead
+ */
+Future pollInGlThread(Processor &processor, const std::function<bool(bool block)> &poll);
+
+/**
+ * Insert a fence after the GL commands issued so far. Must be called in the
+ * GL thread. The returned poll function (see pollInGlThread) returns true
+ * once the GPU has finished executing those commands
+ */
+std::function<bool(bool block)> insertFence();
+
+/**
+ * Look up a program from the program binary cache or, if not found, build
+ * it with the given function and store it to the cache. If retrievable is
+ * true, the build function must set GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+ * before linking. Must be called in the GL thread
+ */
+int getCachedProgram(const char *vs, const char *fs, const std::function<int(bool retrievable)> &build);
+
+/**
+ * True if the current context supports compute shaders (OpenGL 4.3 or
+ * OpenGL ES 3.1) and the library was compiled with them. Must be called in
+ * the GL thread
+ */
+bool supportsComputeShaders();
+
 class Binder {
 public:
     struct Target {
@@ -74,10 +128,28 @@ struct Destroyable {
     virtual ~Destroyable();
 };
 
+/**
+ * The pixels [x0, x0 + width) x [y0, y0 + height) of a texture of size
+ * textureWidth x textureHeight, e.g., the part covered by an ROI
+ */
+struct TextureRegion {
+    int x0, y0, width, height;
+    int textureWidth, textureHeight;
+
+    static TextureRegion full(int w, int h) { return TextureRegion { 0, 0, w, h, w, h }; }
+    bool isFull() const { return x0 == 0 && y0 == 0 && width == textureWidth && height == textureHeight; }
+};
+
 struct FrameBuffer : Destroyable, Binder::Target {
     static std::unique_ptr<FrameBuffer> create(int w, int h, const ImageTypeSpec &spec);
     static std::unique_ptr<FrameBuffer> createReference(int existingFboId, int w, int h, const ImageTypeSpec &spec);
     static std::unique_ptr<FrameBuffer> createScreenReference(int w, int h);
+    /**
+     * Frame buffer of a GL_TEXTURE_2D_ARRAY texture with the given number of
+     * layers of size w x h. Pixel data is read and written for all layers at
+     * once, layer by layer. GlslPipeline::call draws to each layer
+     */
+    static std::unique_ptr<FrameBuffer> createArray(int w, int h, int layers, const ImageTypeSpec &spec);
 
     virtual std::unique_ptr<FrameBuffer> createROI(int x0, int y0, int w, int h) = 0;
 
@@ -88,12 +160,33 @@ struct FrameBuffer : Destroyable, Binder::Target {
     virtual void readPixels(uint8_t *pixels) = 0;
     virtual void writePixels(const uint8_t *pixels) = 0;
 
+    /**
+     * Start an asynchronous read to a pixel pack buffer. Returns a poll
+     * function that must be called in the GL thread until it returns true,
+     * after which the data has been copied to the given pointer. If the
+     * argument of the poll function is true, it blocks until the data is
+     * available. Pending reads are completed (blocking) in destroy()
+     */
+    virtual std::function<bool(bool block)> readPixelsAsync(uint8_t *pixels) = 0;
+
+    /**
+     * Upload through a ring of pixel unpack buffers. Like writePixels but
+     * the transfer to the texture is asynchronous in the GL driver
+     */
+    virtual void writePixelsStreaming(const uint8_t *pixels) = 0;
+
     /** set glViewport to the viewport defined for this frame buffer (reference) */
     virtual void setViewport() = 0;
 
     virtual int getId() const = 0;
     virtual int getTextureId() const = 0;
+    /** The part of the texture (getTextureId) covered by the viewport. ROIs share the texture of their parent */
+    virtual TextureRegion getTextureRegion() const = 0;
 
+    /** Number of texture array layers, 1 for normal frame buffers */
+    virtual int getLayerCount() const = 0;
+    /** Frame buffer of a single layer, owned by this frame buffer */
+    virtual FrameBuffer &getLayer(int index) = 0;
 };
 
 struct GlslProgram : Destroyable, Binder::Target {
@@ -118,7 +211,20 @@ struct GlslFragmentShader : GlslProgram {
 };
 
 /**
- * Default GlslFragmentShader with N input textures
+ * Default GlslFragmentShader with N input textures.
+ *
+ * Texture array inputs (StorageType::GPU_OPENGL_ARRAY) are sampled with the
+ * usual texture, texelFetch and textureSize calls, which read the layer
+ * u_layer. When called with a texture array frame buffer, the pipeline
+ * is drawn once for each output layer with u_layer set to its index.
+ *
+ * Inputs bound with a TextureRegion, like ROIs, are sampled relative to the
+ * region: texture coordinates [0, 1] and texelFetch pixels
+ * [0, textureSize) cover the region only. Coordinates outside the region
+ * are clamped to its edges in texture() regardless of the border mode
+ * (texelFetch does not handle borders anyway). For this, the input samplers
+ * can only be used with texture, textureLod (except external textures),
+ * texelFetch and textureSize, see operations::Factory::wrapShader
  */
 struct GlslPipeline : GlslFragmentShader {
     static std::unique_ptr<GlslPipeline> create(
@@ -126,7 +232,23 @@ struct GlslPipeline : GlslFragmentShader {
         const std::vector<ImageTypeSpec> &inputs,
         const ImageTypeSpec &output);
 
+    /**
+     * Pipeline with multiple render targets. The fragment shader writes
+     * to outValue0, ..., outValueN instead of outValue
+     */
+    static std::unique_ptr<GlslPipeline> create(
+        const char *fragmentMain,
+        const std::vector<ImageTypeSpec> &inputs,
+        const std::vector<ImageTypeSpec> &outputs);
+
+    using GlslFragmentShader::call;
+    /** Render to full textures of the same size, one for each output */
+    virtual void call(const std::vector<int> &outputTextureIds, int width, int height) = 0;
+
+    /** Bind a full texture */
     virtual Binder::Target &bindTexture(unsigned index, int textureId) = 0;
+    /** Bind a part of a texture, e.g., an ROI */
+    virtual Binder::Target &bindTexture(unsigned index, int textureId, const TextureRegion &region) = 0;
 
     // Note: different from how OpenGL works as the texture parameters are
     // part of the texture state, not the texture "slot / unit", but in this
@@ -134,6 +256,67 @@ struct GlslPipeline : GlslFragmentShader {
     // as part of the processing pipeline rather than the images themselves
     virtual void setTextureInterpolation(unsigned index, ::accelerated::Image::Interpolation i) = 0;
     virtual void setTextureBorder(unsigned index, ::accelerated::Image::Border b) = 0;
+
+    /**
+     * Render 1x1 pixel to temporary outputs, with no input textures, so
+     * that the driver finishes any compilation it defers to the first draw
+     */
+    virtual void warmUp() = 0;
+};
+
+/**
+ * Compute shader with N input textures, bound (also as regions) like in
+ * GlslPipeline, and one output image u_outImage, written with
+ * storeOutValue(ivec2, value). One invocation is dispatched for each
+ * output pixel (rounded up to full work groups), so the shader must check
+ * that gl_GlobalInvocationID is inside u_outSize. Requires
+ * supportsComputeShaders()
+ */
+struct GlslComputeShader : Destroyable, Binder::Target {
+    static std::unique_ptr<GlslComputeShader> create(
+        const char *computeMain,
+        const std::vector<ImageTypeSpec> &inputs,
+        const ImageTypeSpec &output,
+        int workGroupWidth,
+        int workGroupHeight);
+
+    virtual int getId() const = 0;
+    virtual std::string getComputeShaderSource() const = 0;
+
+    /** Dispatch over a full output texture and wait for the writes */
+    virtual void call(int outputTextureId, int width, int height) = 0;
+    /**
+     * Dispatch over a part of the output texture, e.g., an ROI. The
+     * coordinates of storeOutValue and u_outSize are relative to the region
+     */
+    virtual void call(int outputTextureId, const TextureRegion &outputRegion) = 0;
+
+    virtual Binder::Target &bindTexture(unsigned index, int textureId) = 0;
+    virtual Binder::Target &bindTexture(unsigned index, int textureId, const TextureRegion &region) = 0;
+    virtual void setTextureInterpolation(unsigned index, ::accelerated::Image::Interpolation i) = 0;
+    virtual void setTextureBorder(unsigned index, ::accelerated::Image::Border b) = 0;
+
+    /** Like GlslPipeline::warmUp, dispatches a single work group */
+    virtual void warmUp() = 0;
+};
+
+/**
+ * GPU time measurements with timer queries. The results of earlier
+ * measurements are collected (if available, without waiting) when a new one
+ * starts. Must be used in a single GL context
+ */
+struct GpuTimer : Destroyable {
+    static std::unique_ptr<GpuTimer> create();
+
+    /** Measure the GL commands issued by op. Must be called in the GL thread */
+    virtual void time(const std::string &name, const std::function<void()> &op) = 0;
+    /**
+     * Collect the available results without waiting. Also done by time().
+     * Must be called in the GL thread
+     */
+    virtual void collect() = 0;
+    /** Statistics of the collected results. Can be called in any thread */
+    virtual std::vector<operations::GpuTimingStatistics> getStatistics() = 0;
 };
 
 }
@@ -0,0 +1,207 @@
+#include "operations.hpp"
+#include "adapters.hpp"
+#include "gl_state.hpp"
+#include "../assert.hpp"
+#include "../log.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+#include <mutex>
+
+namespace accelerated {
+namespace opengl {
+namespace {
+bool hasExtension(EGLDisplay display, const char *name) {
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (extensions == nullptr) return false;
+    const std::size_t n = std::strlen(name);
+    for (const char *s = std::strstr(extensions, name); s != nullptr; s = std::strstr(s + n, name)) {
+        if ((s == extensions || s[-1] == ' ') && (s[n] == ' ' || s[n] == '\0')) return true;
+    }
+    return false;
+}
+
+// eglInitialize and eglTerminate are not reference counted by EGL itself
+// but all processors share the same display
+struct DisplayReference {
+    std::mutex mutex;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    int count = 0;
+
+    static DisplayReference &instance() {
+        static DisplayReference ref;
+        return ref;
+    }
+
+    EGLDisplay acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == 0) {
+            display = EGL_NO_DISPLAY;
+            // no windowing system needed with the Mesa surfaceless platform
+            if (hasExtension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+                auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                    eglGetProcAddress("eglGetPlatformDisplayEXT"));
+                if (getPlatformDisplay != nullptr) {
+                    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+                }
+            }
+            if (display == EGL_NO_DISPLAY) {
+                log_debug("EGL surfaceless platform not available, using the default display");
+                display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            }
+            aa_assert(display != EGL_NO_DISPLAY && "no EGL display");
+            EGLint major = 0, minor = 0;
+            const bool ok = eglInitialize(display, &major, &minor) == EGL_TRUE;
+            aa_assert(ok && "eglInitialize failed");
+            log_debug("initialized EGL %d.%d", major, minor);
+        }
+        count++;
+        return display;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        aa_assert(count > 0);
+        if (--count == 0) {
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+        }
+    }
+};
+
+struct EGLProcessor : Processor {
+    std::unique_ptr<Processor> processor;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLConfig config = nullptr;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+    // objects are deleted in the main context, which does not update the
+    // state cache of the shared contexts
+    const bool cacheState;
+
+    EGLProcessor(EGLProcessor *shareWith) : cacheState(shareWith == nullptr) {
+        log_debug("Initializing EGL processor with its own thread");
+        processor = Processor::createThreadPool(1);
+        if (shareWith != nullptr) {
+            // make sure the other context exists
+            shareWith->processor->enqueue([]() {}).wait();
+        }
+        processor->enqueue([this, shareWith]() { initialize(shareWith); });
+    }
+
+    void initialize(EGLProcessor *shareWith) {
+        display = DisplayReference::instance().acquire();
+        const EGLContext shareContext = shareWith == nullptr ? EGL_NO_CONTEXT : shareWith->context;
+
+        #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+            const EGLenum api = EGL_OPENGL_ES_API;
+            const EGLint renderableType = EGL_OPENGL_ES3_BIT_KHR;
+            #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES_3_1
+                const EGLint versions[][2] = { { 3, 1 } };
+            #else
+                const EGLint versions[][2] = { { 3, 0 } };
+            #endif
+        #else
+            const EGLenum api = EGL_OPENGL_API;
+            const EGLint renderableType = EGL_OPENGL_BIT;
+            // 4.3 for compute shaders, 3.3 core is the minimum otherwise
+            const EGLint versions[][2] = { { 4, 3 }, { 3, 3 } };
+        #endif
+
+        const bool apiOk = eglBindAPI(api) == EGL_TRUE;
+        aa_assert(apiOk && "eglBindAPI failed");
+
+        // all rendering goes to textures so no surface is needed if
+        // surfaceless contexts are supported. Otherwise use a dummy pbuffer
+        const bool surfaceless = hasExtension(display, "EGL_KHR_surfaceless_context");
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, surfaceless ? EGL_DONT_CARE : EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, renderableType,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_NONE
+        };
+        EGLint nConfigs = 0;
+        eglChooseConfig(display, configAttributes, &config, 1, &nConfigs);
+        aa_assert(nConfigs > 0 && "no suitable EGL config");
+
+        for (const auto &version : versions) {
+            const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, version[0],
+                EGL_CONTEXT_MINOR_VERSION, version[1],
+            #ifndef ACCELERATED_ARRAYS_USE_OPENGL_ES
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            #endif
+                EGL_NONE
+            };
+            context = eglCreateContext(display, config, shareContext, contextAttributes);
+            if (context != EGL_NO_CONTEXT) {
+                log_debug("created EGL context version %d.%d", version[0], version[1]);
+                break;
+            }
+        }
+        aa_assert(context != EGL_NO_CONTEXT && "could not create EGL context");
+
+        if (!surfaceless) {
+            const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+            aa_assert(surface != EGL_NO_SURFACE && "could not create EGL pbuffer");
+        }
+        makeCurrent();
+        log_debug("EGLProcessor initialized (%s)", surfaceless ? "surfaceless" : "pbuffer");
+    }
+
+    void makeCurrent() {
+        const bool ok = eglMakeCurrent(display, surface, surface, context) == EGL_TRUE;
+        aa_assert(ok && "eglMakeCurrent failed");
+        glState::selectContext(context, cacheState);
+    }
+
+    ~EGLProcessor() {
+        processor->enqueue([this]() {
+            if (context != EGL_NO_CONTEXT) {
+                makeCurrent();
+                glState::forgetContext(context);
+                eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+                eglDestroyContext(display, context);
+                log_debug("EGLProcessor destroyed context");
+            }
+            if (display != EGL_NO_DISPLAY) DisplayReference::instance().release();
+        }).wait();
+    }
+
+    Future enqueue(const std::function<void()> &op) final {
+        return enqueue(op, CancellationToken {});
+    }
+
+    Future enqueue(const std::function<void()> &op, const CancellationToken &token) final {
+        return processor->enqueue([this, op]() {
+            aa_assert(context != EGL_NO_CONTEXT);
+            // the context stays current in the worker thread, only the
+            // state cache needs to be selected
+            glState::selectContext(context, cacheState);
+            op();
+        }, token);
+    }
+
+    void setDefaultWaitPolicy(const WaitPolicy &policy) final {
+        processor->setDefaultWaitPolicy(policy);
+    }
+};
+}
+
+std::unique_ptr<Processor> createEGLProcessor() {
+    return std::unique_ptr<Processor>(new EGLProcessor(nullptr));
+}
+
+std::unique_ptr<Processor> createSharedEGLProcessor(Processor &eglProcessor) {
+    auto *shareWith = dynamic_cast<EGLProcessor*>(&eglProcessor);
+    aa_assert(shareWith && "not created with createEGLProcessor");
+    return std::unique_ptr<Processor>(new EGLProcessor(shareWith));
+}
+}
+}
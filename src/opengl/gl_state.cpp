@@ -0,0 +1,216 @@
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "gl_state.hpp"
+#include "operations.hpp"
+#include "../log.hpp"
+
+namespace accelerated {
+namespace opengl {
+namespace {
+constexpr GLint UNKNOWN = -1;
+
+struct ContextState {
+    bool enabled;
+    GLint program, vertexArray, framebuffer, readFramebuffer;
+    GLint activeUnit;
+    bool viewportKnown;
+    int viewport[4];
+    std::map< std::pair<GLint, GLenum>, GLint > textures;
+    std::map< GLint, GLint > samplerBindings;
+
+    // GL objects owned by the context, not invalidated
+    std::map< std::pair<GLint, GLint>, GLuint > samplers;
+
+    ContextState(bool enabled) : enabled(enabled) {
+        invalidate();
+    }
+
+    void invalidate() {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        framebuffer = UNKNOWN;
+        readFramebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        viewportKnown = false;
+        textures.clear();
+        samplerBindings.clear();
+    }
+};
+
+struct ThreadState {
+    ContextState unselected { false };
+    std::map< const void*, ContextState > contexts;
+    ContextState *current = &unselected;
+    StateCacheStatistics statistics;
+};
+
+thread_local ThreadState threadState;
+
+ContextState &current() {
+    return *threadState.current;
+}
+
+// returns true if the call is needed
+bool update(GLint &cached, GLint value) {
+    if (current().enabled && cached == value) {
+        threadState.statistics.skipped++;
+        return false;
+    }
+    threadState.statistics.issued++;
+    cached = value;
+    return true;
+}
+
+void resetIf(GLint &cached, GLuint deleted) {
+    if (cached == GLint(deleted)) cached = 0;
+}
+}
+
+namespace glState {
+void selectContext(const void *context, bool enableCache) {
+    auto itr = threadState.contexts.find(context);
+    if (itr == threadState.contexts.end()) {
+        itr = threadState.contexts.emplace(context, ContextState(enableCache)).first;
+    }
+    threadState.current = &itr->second;
+}
+
+void forgetContext(const void *context) {
+    auto itr = threadState.contexts.find(context);
+    if (itr == threadState.contexts.end()) return;
+    for (const auto &s : itr->second.samplers) glDeleteSamplers(1, &s.second);
+    if (threadState.current == &itr->second) threadState.current = &threadState.unselected;
+    threadState.contexts.erase(itr);
+}
+
+bool keepBindings() {
+    return current().enabled;
+}
+
+void useProgram(GLuint program) {
+    if (update(current().program, program)) glUseProgram(program);
+}
+
+void bindVertexArray(GLuint vao) {
+    if (update(current().vertexArray, vao)) glBindVertexArray(vao);
+}
+
+void bindFramebuffer(GLuint fbo) {
+    auto &s = current();
+    // GL_FRAMEBUFFER sets both the draw and the read binding
+    if (s.enabled && s.framebuffer == GLint(fbo) && s.readFramebuffer == GLint(fbo)) {
+        threadState.statistics.skipped++;
+        return;
+    }
+    threadState.statistics.issued++;
+    s.framebuffer = fbo;
+    s.readFramebuffer = fbo;
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void bindReadFramebuffer(GLuint fbo) {
+    if (update(current().readFramebuffer, fbo)) glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+}
+
+void viewport(int x0, int y0, int width, int height) {
+    auto &s = current();
+    if (s.enabled && s.viewportKnown &&
+        s.viewport[0] == x0 && s.viewport[1] == y0 &&
+        s.viewport[2] == width && s.viewport[3] == height)
+    {
+        threadState.statistics.skipped++;
+        return;
+    }
+    threadState.statistics.issued++;
+    s.viewportKnown = true;
+    s.viewport[0] = x0;
+    s.viewport[1] = y0;
+    s.viewport[2] = width;
+    s.viewport[3] = height;
+    glViewport(x0, y0, width, height);
+}
+
+void activeTexture(unsigned unit) {
+    if (update(current().activeUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void bindTexture(GLenum target, GLuint texture) {
+    auto &s = current();
+    // if the active unit is unknown, the bind is tracked under UNKNOWN,
+    // which stays valid until the next activeTexture call
+    auto itr = s.textures.emplace(std::make_pair(s.activeUnit, target), UNKNOWN).first;
+    if (update(itr->second, texture)) glBindTexture(target, texture);
+}
+
+void bindSampler(unsigned unit, GLuint sampler) {
+    auto itr = current().samplerBindings.emplace(unit, UNKNOWN).first;
+    if (update(itr->second, sampler)) glBindSampler(unit, sampler);
+}
+
+GLuint getSampler(GLint filter, GLint wrap) {
+    auto &samplers = current().samplers;
+    const auto key = std::make_pair(filter, wrap);
+    auto itr = samplers.find(key);
+    if (itr != samplers.end()) return itr->second;
+
+    GLuint sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrap);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrap);
+    checkError(__FUNCTION__);
+    LOG_TRACE("created sampler %d (filter 0x%x, wrap 0x%x)", sampler, filter, wrap);
+    // samplers of the unselected state are never deleted (but reused)
+    samplers[key] = sampler;
+    return sampler;
+}
+
+bool updateUniform(int *cached, const int *values, int n) {
+    bool changed = !current().enabled;
+    for (int i = 0; i < n; ++i) {
+        if (cached[i] != values[i]) changed = true;
+        cached[i] = values[i];
+    }
+    if (changed) threadState.statistics.issued++;
+    else threadState.statistics.skipped++;
+    return changed;
+}
+
+void deletedTexture(GLuint texture) {
+    for (auto &t : current().textures) resetIf(t.second, texture);
+}
+
+void deletedFramebuffer(GLuint fbo) {
+    resetIf(current().framebuffer, fbo);
+    resetIf(current().readFramebuffer, fbo);
+}
+
+void deletedVertexArray(GLuint vao) {
+    resetIf(current().vertexArray, vao);
+}
+
+void deletedProgram(GLuint program) {
+    // a deleted program stays in use until another one is selected, but
+    // make sure that the next useProgram call is not skipped anyway
+    if (current().program == GLint(program)) current().program = UNKNOWN;
+}
+}
+
+void setStateCacheEnabled(bool enabled) {
+    auto &s = current();
+    s.enabled = enabled;
+    s.invalidate();
+}
+
+void invalidateStateCache() {
+    current().invalidate();
+}
+
+StateCacheStatistics getStateCacheStatistics() {
+    return threadState.statistics;
+}
+}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "adapters.hpp"
+
+namespace accelerated {
+namespace opengl {
+/**
+ * Tracks the GL bindings set by this library in the current thread and
+ * skips the calls that would not change them. All binds done by the library
+ * must go through these functions. Must be called in the GL thread.
+ */
+namespace glState {
+/**
+ * Select the tracked state of the context that was just made current. The
+ * cache is enabled for contexts selected this way (i.e., contexts owned by
+ * a processor of this library) unless enableCache is false. Without this,
+ * there is a single state per thread on which the cache is disabled by
+ * default. The deleted* functions only update the current context, so the
+ * cache should be disabled in contexts that share objects deleted elsewhere
+ */
+void selectContext(const void *context, bool enableCache = true);
+/** Delete the cached GL objects (samplers) of the current context */
+void forgetContext(const void *context);
+
+/**
+ * If true, Binder targets should not unbind anything since the next bind
+ * will overwrite the state anyway
+ */
+bool keepBindings();
+
+void useProgram(GLuint program);
+void bindVertexArray(GLuint vao);
+/** Bind as both the draw and the read frame buffer */
+void bindFramebuffer(GLuint fbo);
+/** Only change the read frame buffer, e.g., for glBlitFramebuffer */
+void bindReadFramebuffer(GLuint fbo);
+void viewport(int x0, int y0, int width, int height);
+void activeTexture(unsigned unit);
+/** Bind to the active texture unit */
+void bindTexture(GLenum target, GLuint texture);
+void bindSampler(unsigned unit, GLuint sampler);
+/** Sampler object for the given parameters, created once per context */
+GLuint getSampler(GLint filter, GLint wrap);
+
+/**
+ * For uniforms, which are program state cached by the caller: updates the
+ * n cached values and returns true if the glUniform call is needed
+ */
+bool updateUniform(int *cached, const int *values, int n);
+
+// deleting bound objects resets the bindings to 0
+void deletedTexture(GLuint texture);
+void deletedFramebuffer(GLuint fbo);
+void deletedVertexArray(GLuint vao);
+void deletedProgram(GLuint program);
+}
+}
+}
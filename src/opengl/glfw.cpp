@@ -1,5 +1,6 @@
 #include "operations.hpp"
 #include "adapters.hpp"
+#include "gl_state.hpp"
 #include "../assert.hpp"
 #include "../log.hpp"
 
@@ -73,6 +74,8 @@ struct GLFWProcessor : Processor {
     ~GLFWProcessor() {
         processor->enqueue([this]() {
             if (window) {
+                glfwMakeContextCurrent(window);
+                glState::forgetContext(window);
                 glfwDestroyWindow(window);
                 glfwTerminate();
                 log_debug("GLFWProcessor destroyed window");
@@ -81,15 +84,24 @@ struct GLFWProcessor : Processor {
     }
 
     Future enqueue(const std::function<void()> &op) final {
+        return enqueue(op, CancellationToken {});
+    }
+
+    Future enqueue(const std::function<void()> &op, const CancellationToken &token) final {
         return processor->enqueue([this, op]() {
             aa_assert(window);
             // log_debug("op in GL thread");
             // not which of these are really required. It might be slow
             // to call them after each operation
             glfwMakeContextCurrent(window);
+            glState::selectContext(window);
             op();
             glfwPollEvents();
-        });
+        }, token);
+    }
+
+    void setDefaultWaitPolicy(const WaitPolicy &policy) final {
+        processor->setDefaultWaitPolicy(policy);
     }
 };
 
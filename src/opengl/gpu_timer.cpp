@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "adapters.hpp"
+#include "operations.hpp"
+#include "../log.hpp"
+
+#ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+#include <EGL/egl.h>
+#endif
+
+namespace accelerated {
+namespace opengl {
+namespace {
+#ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+constexpr GLenum TIME_ELAPSED = GL_TIME_ELAPSED_EXT;
+#else
+constexpr GLenum TIME_ELAPSED = GL_TIME_ELAPSED;
+#endif
+
+// latest results per name included in the statistics
+constexpr std::size_t MAX_SAMPLES = 1000;
+// if the results are not collected fast enough, skip measurements rather
+// than accumulate query objects
+constexpr std::size_t MAX_PENDING = 64;
+
+bool supportsTimerQueries() {
+#ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+    GLint n = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+    for (GLint i = 0; i < n; ++i) {
+        const GLubyte *ext = glGetStringi(GL_EXTENSIONS, GLuint(i));
+        if (ext != nullptr && std::strcmp(reinterpret_cast<const char*>(ext), "GL_EXT_disjoint_timer_query") == 0) return true;
+    }
+    return false;
+#else
+    // core since OpenGL 3.3
+    return true;
+#endif
+}
+
+class GpuTimerImplementation : public GpuTimer {
+private:
+    struct Pending {
+        GLuint query;
+        std::string name;
+    };
+
+    // GL thread only
+    int supported = -1;
+    std::deque<Pending> pending;
+    std::vector<GLuint> freeQueries;
+    #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+    // an extension function, not exported by all GLES libraries
+    PFNGLGETQUERYOBJECTUI64VEXTPROC getQueryObjectui64v = nullptr;
+    #endif
+
+    std::mutex mutex;
+    std::map< std::string, std::deque<double> > samples;
+
+    // 32 bits of nanoseconds overflow after 4.3 seconds
+    GLuint64 getResult(GLuint query) {
+        GLuint64 result = 0;
+        #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+        if (getQueryObjectui64v == nullptr) {
+            getQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(
+                eglGetProcAddress("glGetQueryObjectui64vEXT"));
+            aa_assert(getQueryObjectui64v != nullptr);
+        }
+        getQueryObjectui64v(query, GL_QUERY_RESULT_EXT, &result);
+        #else
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+        #endif
+        return result;
+    }
+
+public:
+    void collect() final {
+        if (supported != 1) return;
+        bool disjoint = false;
+        #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+            // e.g., a power state change: the pending results are garbage.
+            // Querying also clears the flag
+            GLint disjointFlag = 0;
+            glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjointFlag);
+            disjoint = disjointFlag != 0;
+        #endif
+
+        // the queries finish in order
+        while (!pending.empty()) {
+            const Pending &p = pending.front();
+            GLuint available = 0;
+            glGetQueryObjectuiv(p.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) break;
+            const GLuint64 nanoseconds = getResult(p.query);
+            if (!disjoint) {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto &s = samples[p.name];
+                s.push_back(nanoseconds * 1e-6);
+                if (s.size() > MAX_SAMPLES) s.pop_front();
+            }
+            freeQueries.push_back(p.query);
+            pending.pop_front();
+        }
+    }
+
+    ~GpuTimerImplementation() {
+        if (!pending.empty() || !freeQueries.empty()) {
+            log_warn("leaking %zu GL timer queries", pending.size() + freeQueries.size());
+        }
+    }
+
+    void time(const std::string &name, const std::function<void()> &op) final {
+        if (supported < 0) {
+            supported = supportsTimerQueries() ? 1 : 0;
+            if (!supported) log_warn("GPU timer queries not supported");
+        }
+        if (!supported) {
+            op();
+            return;
+        }
+
+        collect();
+        if (pending.size() >= MAX_PENDING) {
+            LOG_TRACE("too many pending timer queries, skipping %s", name.c_str());
+            op();
+            return;
+        }
+
+        GLuint query;
+        if (freeQueries.empty()) {
+            glGenQueries(1, &query);
+        } else {
+            query = freeQueries.back();
+            freeQueries.pop_back();
+        }
+        glBeginQuery(TIME_ELAPSED, query);
+        op();
+        glEndQuery(TIME_ELAPSED);
+        pending.push_back({ query, name });
+    }
+
+    std::vector<operations::GpuTimingStatistics> getStatistics() final {
+        std::vector<operations::GpuTimingStatistics> result;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &it : samples) {
+            std::vector<double> sorted(it.second.begin(), it.second.end());
+            if (sorted.empty()) continue;
+            std::sort(sorted.begin(), sorted.end());
+            operations::GpuTimingStatistics stats;
+            stats.name = it.first;
+            stats.count = int(sorted.size());
+            stats.minMilliseconds = sorted.front();
+            double sum = 0;
+            for (double v : sorted) sum += v;
+            stats.meanMilliseconds = sum / sorted.size();
+            // nearest rank
+            const std::size_t rank = (sorted.size() * 95 + 99) / 100;
+            stats.p95Milliseconds = sorted.at(rank - 1);
+            result.push_back(stats);
+        }
+        return result;
+    }
+
+    void destroy() final {
+        // no more measurements after this
+        supported = 0;
+        for (const auto &p : pending) freeQueries.push_back(p.query);
+        pending.clear();
+        if (!freeQueries.empty()) {
+            glDeleteQueries(GLsizei(freeQueries.size()), freeQueries.data());
+            freeQueries.clear();
+        }
+    }
+};
+}
+
+std::unique_ptr<GpuTimer> GpuTimer::create() {
+    return std::unique_ptr<GpuTimer>(new GpuTimerImplementation);
+}
+}
+}
@@ -1,7 +1,5 @@
 #include <atomic>
 #include <cassert>
-#include <mutex>
-#include <unordered_map>
 
 #include "adapters.hpp"
 #include "image.hpp"
@@ -16,6 +14,9 @@ private:
     Border border = Border::UNDEFINED;
     Interpolation interpolation = Interpolation::UNDEFINED;
 
+protected:
+    bool streamingWrites = false;
+
 protected:
     ImplementationBase(int w, int h, const ImageTypeSpec &spec) : Image(w, h, spec) {}
 
@@ -35,6 +36,14 @@ public:
     void setInterpolation(Interpolation i) final {
         interpolation = i;
     }
+
+    void setStreamingWrites(bool enabled) final {
+        streamingWrites = enabled;
+    }
+
+    int getLayerCount() const override {
+        return 1;
+    }
 };
 
 class ExternalImage : public ImplementationBase {
@@ -49,6 +58,10 @@ public:
         return textureId;
     }
 
+    TextureRegion getTextureRegion() const final {
+        return TextureRegion::full(width, height);
+    }
+
     Future readRaw(std::uint8_t *outputData) final {
         aa_assert(false && "not supported");
         (void)outputData;
@@ -87,117 +100,192 @@ class FrameBufferManager {
 public:
     class Reference;
 
+    /**
+     * The frame buffer of a Reference, created in the GL thread and then
+     * published with an atomic pointer so that resolving it needs no
+     * locking. Shared with the enqueued operations, which may outlive the
+     * Reference
+     */
+    struct Handle {
+        // set and reset in the GL thread. The upload thread copies it with
+        // std::atomic_load to keep the frame buffer alive while using it
+        std::shared_ptr<FrameBuffer> owner;
+        std::atomic<FrameBuffer*> frameBuffer { nullptr };
+
+        // with an upload processor: the frame buffers are created in the
+        // rendering context, which the uploads must wait for
+        Future created = Future::instantlyResolved();
+        std::shared_ptr< std::function<bool(bool)> > creationFence;
+
+        FrameBuffer *get() const {
+            return frameBuffer.load(std::memory_order_acquire);
+        }
+    };
+
 private:
-    std::mutex mutex;
-    std::unordered_map<const Reference*, std::shared_ptr<FrameBuffer> > frameBuffers;
     std::unique_ptr<operations::Factory> converterFactory;
 
 public:
     Processor &processor;
+    Processor *uploadProcessor;
     Image::Factory &imageFactory;
 
-    FrameBufferManager(Processor &p, Image::Factory &imageFactory)
-    : converterFactory(operations::createFactory(p)), processor(p), imageFactory(imageFactory) {}
-
-    Future enqueue(const Reference *ref, const std::function<void(FrameBuffer &)> &f) {
-        return processor.enqueue([this, f, ref]() {
-            std::shared_ptr<FrameBuffer> buf;
-            {
-                std::lock_guard<std::mutex> lock(mutex);
-                if (!frameBuffers.count(ref)) {
-                    log_warn("no reference %p found in enqueue (already destroyed?)", (void*)ref);
-                    return;
-                }
-                buf = frameBuffers.at(ref);
+    FrameBufferManager(Processor &p, Processor *uploadProcessor, Image::Factory &imageFactory)
+    : converterFactory(operations::createFactory(p)), processor(p), uploadProcessor(uploadProcessor), imageFactory(imageFactory) {}
+
+    static FrameBuffer *find(const Handle &handle) {
+        FrameBuffer *fb = handle.get();
+        if (!fb) log_warn("no frame buffer found for handle %p (already destroyed?)", (const void*)&handle);
+        return fb;
+    }
+
+    Future enqueue(const std::shared_ptr<Handle> &handle, const std::function<void(FrameBuffer &)> &f) {
+        return processor.enqueue([f, handle]() {
+            auto buf = find(*handle);
+            if (buf) f(*buf);
+        });
+    }
+
+    /**
+     * Run an upload in the shared context of the upload processor. The
+     * returned Future resolves when the GPU has finished the upload so that
+     * the result is visible in the rendering context
+     */
+    Future enqueueUpload(const std::shared_ptr<Handle> &handle, const std::function<void(FrameBuffer &)> &f) {
+        aa_assert(uploadProcessor);
+        std::shared_ptr< std::function<bool(bool)> > fence(new std::function<bool(bool)>);
+        uploadProcessor->enqueue([f, handle, fence]() {
+            waitForCreation(*handle);
+            // not a raw pointer: removeFrameBuffer runs in the GL thread
+            auto buf = std::atomic_load(&handle->owner);
+            if (!buf) {
+                log_warn("no frame buffer found for handle %p (already destroyed?)", (const void*)handle.get());
+                return;
             }
             f(*buf);
+            *fence = insertFence();
+        });
+        return pollInGlThread(*uploadProcessor, [fence](bool block) -> bool {
+            if (!*fence) return true;
+            return (*fence)(block);
         });
     }
 
-    void addFrameBuffer(const Reference *ref, const std::function<std::shared_ptr<FrameBuffer>()> &builder) {
+    // called in the upload thread, the only user of the creation fence
+    static void waitForCreation(Handle &handle) {
+        handle.created.wait();
+        if (*handle.creationFence) (*handle.creationFence)(true);
+    }
+
+    /** Start an operation in the GL thread and poll it until done */
+    Future enqueuePoll(const std::shared_ptr<Handle> &handle, const std::function<std::function<bool(bool)>(FrameBuffer &)> &start) {
+        std::shared_ptr< std::function<bool(bool)> > poll(new std::function<bool(bool)>);
+        return pollInGlThread(processor, [handle, start, poll](bool block) -> bool {
+            if (!*poll) {
+                auto buf = find(*handle);
+                if (!buf) return true;
+                *poll = start(*buf);
+            }
+            return (*poll)(block);
+        });
+    }
+
+    std::shared_ptr<Handle> addFrameBuffer(const std::function<std::shared_ptr<FrameBuffer>()> &builder) {
         // easier to implement with shared_ptr in the argument, even if it
         // "should" be unique_ptr and the Reference ctor effectively transfers
         // the ownership here
-        processor.enqueue([this, ref, builder]() {
+        std::shared_ptr<Handle> handle(new Handle);
+        const bool shared = uploadProcessor != nullptr;
+        if (shared) handle->creationFence.reset(new std::function<bool(bool)>);
+        Future created = processor.enqueue([handle, builder, shared]() {
             auto fb = builder();
             if (fb) {
-                std::lock_guard<std::mutex> lock(mutex);
-                aa_assert(!frameBuffers.count(ref));
-                LOG_TRACE("frame buffer for reference %p set to %d", (void*)ref, fb->getId());
-                frameBuffers[ref] = fb;
+                if (shared) {
+                    *handle->creationFence = insertFence();
+                    // the fence is waited for in the other context
+                    glFlush();
+                }
+                LOG_TRACE("frame buffer for handle %p set to %d", (void*)handle.get(), fb->getId());
+                std::atomic_store(&handle->owner, fb);
+                handle->frameBuffer.store(fb.get(), std::memory_order_release);
             } else {
                 log_warn("orphaned frame buffer reference");
             }
         });
+        // read in the upload thread only after the Reference is constructed
+        if (shared) handle->created = created;
+        return handle;
     }
 
-    void removeFrameBuffer(const Reference *ref) {
-        std::shared_ptr<FrameBuffer> buf;
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            if (!frameBuffers.count(ref)) {
-                log_warn("no reference %p found in removeFrameBuffer (already destroyed?)", (void*)ref);
+    void removeFrameBuffer(const std::shared_ptr<Handle> &handle) {
+        const auto remove = [handle]() {
+            auto buf = handle->owner;
+            if (!buf) {
+                log_warn("no frame buffer found in removeFrameBuffer (already destroyed?)");
                 return;
             }
-            buf = frameBuffers.at(ref);
-            frameBuffers.erase(ref);
-        }
-
-        processor.enqueue([buf, ref]() {
+            // operations enqueued later see a missing frame buffer
+            handle->frameBuffer.store(nullptr, std::memory_order_release);
+            std::atomic_store(&handle->owner, std::shared_ptr<FrameBuffer>());
             buf->destroy();
-            (void)ref;
-            LOG_TRACE("frame buffer for reference %p destroyed", (void*)ref);
-        });
-    }
-
-    std::shared_ptr<FrameBuffer> getFrameBuffer(const Reference *ref) {
-        std::lock_guard<std::mutex> lock(mutex);
-        return frameBuffers.at(ref);
+            LOG_TRACE("frame buffer for handle %p destroyed", (void*)handle.get());
+        };
+        if (uploadProcessor) {
+            // destroy only after the uploads already enqueued to the upload
+            // processor have been issued
+            Processor &p = processor;
+            uploadProcessor->enqueue([&p, remove]() { p.enqueue(remove); });
+        } else {
+            processor.enqueue(remove);
+        }
     }
 };
 
 class FrameBufferManager::Reference : public ImplementationBase {
 private:
     std::weak_ptr<FrameBufferManager> manager;
+    std::shared_ptr<Handle> handle;
     std::function<Future(std::uint8_t*)> readAdpater;
+    const int layers;
 
 public:
-    Reference(int w, int h, const ImageTypeSpec &spec, std::weak_ptr<FrameBufferManager> man, std::unique_ptr<FrameBuffer> existing)
-    : ImplementationBase(w, h, spec), manager(man)
+    // texture arrays: layers of size w x h stacked vertically
+    Reference(int w, int h, const ImageTypeSpec &spec, std::weak_ptr<FrameBufferManager> man, std::unique_ptr<FrameBuffer> existing, int layers = 1)
+    : ImplementationBase(w, h * layers, spec), manager(man), layers(layers)
     {
         ImageTypeSpec s = spec;
         std::shared_ptr<FrameBuffer> fb = std::move(existing);
         auto m = manager.lock();
         aa_assert(m);
         LOG_TRACE("created buffer reference %p", (void*)this);
-        m->addFrameBuffer(this, [w, h, s, fb]() {
+        handle = m->addFrameBuffer([w, h, s, fb, layers]() {
             if (fb) return fb;
+            if (s.storageType == StorageType::GPU_OPENGL_ARRAY) {
+                return std::shared_ptr<FrameBuffer>(FrameBuffer::createArray(w, h, layers, s));
+            }
             return std::shared_ptr<FrameBuffer>(FrameBuffer::create(w, h, s));
         });
     }
 
     // ROI
     Reference(int x0, int y0, int w, int h, std::weak_ptr<FrameBufferManager> man, Reference &existing)
-    : ImplementationBase(w, h, existing), manager(man)
+    : ImplementationBase(w, h, existing), manager(man), layers(1)
     {
+        aa_assert(existing.storageType != StorageType::GPU_OPENGL_ARRAY && "ROIs of texture arrays are not supported");
         auto m = manager.lock();
         aa_assert(m);
         LOG_TRACE("created buffer reference %p (ROI)", (void*)this);
-        m->addFrameBuffer(this, [this, x0, y0, w, h, man, &existing]() -> std::shared_ptr<FrameBuffer> {
-            if (auto m = man.lock()) {
-                auto targetFB = m->getFrameBuffer(&existing);
-                aa_assert(targetFB && "failed to create ROI frame buffer, target does not exist");
-                return std::shared_ptr<FrameBuffer>(targetFB->createROI(x0, y0, w, h));
-            } else {
-                log_warn("orphaned frame buffer reference in ROI creation %p", (void*)this);
-                return {};
-            }
+        std::shared_ptr<Handle> target = existing.handle;
+        handle = m->addFrameBuffer([x0, y0, w, h, target]() -> std::shared_ptr<FrameBuffer> {
+            auto targetFB = target->get();
+            aa_assert(targetFB && "failed to create ROI frame buffer, target does not exist");
+            return std::shared_ptr<FrameBuffer>(targetFB->createROI(x0, y0, w, h));
         });
     }
 
     ~Reference() {
         if (auto m = manager.lock()) {
-            m->removeFrameBuffer(this);
+            m->removeFrameBuffer(handle);
             LOG_TRACE("destroyed buffer reference %p", (void*)this);
         } else {
             log_warn("orphaned frame buffer reference %p", (void*)this);
@@ -205,10 +293,15 @@ public:
     }
 
     int getTextureId() const final {
-        auto m = const_cast<Reference&>(*this).manager.lock();
-        aa_assert(m && "frame buffer manager destroyed");
-        // TODO: not optimal
-        return m->getFrameBuffer(this)->getTextureId();
+        auto fb = handle->get();
+        aa_assert(fb && "frame buffer object not created yet");
+        return fb->getTextureId();
+    }
+
+    TextureRegion getTextureRegion() const final {
+        auto fb = handle->get();
+        aa_assert(fb && "frame buffer object not created yet");
+        return fb->getTextureRegion();
     }
 
     Future readRaw(std::uint8_t *outputData) final {
@@ -226,8 +319,8 @@ public:
             return readAdpater(outputData);
         }
         LOG_TRACE("reading frame buffer reference %p", (void*)this);
-        return m->enqueue(this, [outputData](FrameBuffer &fb) {
-            fb.readPixels(outputData);
+        return m->enqueuePoll(handle, [outputData](FrameBuffer &fb) {
+            return fb.readPixelsAsync(outputData);
         });
     }
 
@@ -236,20 +329,42 @@ public:
         auto m = manager.lock();
         aa_assert(m && "frame buffer manager destroyed");
         LOG_TRACE("writing frame buffer reference %p", (void*)this);
-        return m->enqueue(this, [inputData](FrameBuffer &fb) {
+        if (streamingWrites) {
+            std::shared_ptr< std::vector<std::uint8_t> > staging(
+                new std::vector<std::uint8_t>(inputData, inputData + size()));
+            const auto write = [staging](FrameBuffer &fb) {
+                fb.writePixelsStreaming(staging->data());
+            };
+            if (m->uploadProcessor) return m->enqueueUpload(handle, write);
+            return m->enqueue(handle, write);
+        }
+        const auto write = [inputData](FrameBuffer &fb) {
             fb.writePixels(inputData);
-        });
+        };
+        if (m->uploadProcessor) return m->enqueueUpload(handle, write);
+        return m->enqueue(handle, write);
     }
 
     virtual bool supportsDirectRead() const final {
-        // TODO: in OpenGL ES, only a limited subset of textures
-        // support reading & writing directly, but this is not the case in
-        // general in OpenGL
+        // In OpenGL ES, glReadPixels is only guaranteed to support RGBA with
+        // UNSIGNED_BYTE (normalized), INT, UNSIGNED_INT (integer) and FLOAT.
+        // Everything else goes through the read adapter, which packs the
+        // data to RGBA8 on the GPU
         #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+            if (channels != 4) return false;
             #ifdef ACCELERATED_ARRAYS_MAX_COMPATIBILITY_READS
-                if (channels != 4 || bytesPerChannel() != 1) return false;
+                return dataType == DataType::UFIXED8;
+            #else
+                switch (dataType) {
+                    case DataType::UFIXED8:
+                    case DataType::UINT32:
+                    case DataType::SINT32:
+                    case DataType::FLOAT32:
+                        return true;
+                    default:
+                        return false;
+                }
             #endif
-            return bytesPerChannel() != 2;
         #else
             #ifdef ACCELERATED_ARRAYS_DODGY_READS
                 return true;
@@ -264,13 +379,15 @@ public:
     }
 
     FrameBuffer &getFrameBuffer() final {
-        auto m = manager.lock();
-        aa_assert(m && "frame buffer manager destroyed");
-        auto fb = m->getFrameBuffer(this);
+        auto fb = handle->get();
         aa_assert(fb && "frame buffer object not created yet");
         return *fb;
     }
 
+    int getLayerCount() const final {
+        return layers;
+    }
+
     std::unique_ptr<::accelerated::Image> createROI(int x0, int y0, int roiWidth, int roiHeight) final {
         return std::unique_ptr<::accelerated::Image>(new Reference(x0, y0, roiWidth, roiHeight, manager, *this));
     }
@@ -281,7 +398,7 @@ private:
     std::shared_ptr<FrameBufferManager> manager;
 
 public:
-    GpuImageFactory(Processor &p) : manager(new FrameBufferManager(p, *this)) {}
+    GpuImageFactory(Processor &p, Processor *uploadProcessor) : manager(new FrameBufferManager(p, uploadProcessor, *this)) {}
 
     std::unique_ptr<Image> wrapTexture(int textureId, int w, int h, const ImageTypeSpec &spec) final {
         return std::unique_ptr<Image>(new ExternalImage(w, h, textureId, spec));
@@ -296,6 +413,12 @@ public:
             Image::getSpec(channels, dtype, ImageTypeSpec::StorageType::GPU_OPENGL), manager, {}));
     }
 
+    std::unique_ptr<Image> createArray(int w, int h, int layers, int channels, ImageTypeSpec::DataType dtype) final {
+        aa_assert(layers >= 1);
+        return std::unique_ptr<Image>(new FrameBufferManager::Reference(w, h,
+            Image::getSpec(channels, dtype, ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY), manager, {}, layers));
+    }
+
     std::unique_ptr<Image> wrapFrameBuffer(int fboId, int w, int h, const ImageTypeSpec &spec) {
         return std::unique_ptr<Image>(
             new FrameBufferManager::Reference(w, h, spec, manager,
@@ -312,7 +435,7 @@ public:
 }
 
 ImageTypeSpec Image::getSpec(int channels, DataType dtype, StorageType stype) {
-    aa_assert(stype == StorageType::GPU_OPENGL || stype == StorageType::GPU_OPENGL_EXTERNAL);
+    aa_assert(isCompatible(stype));
     return ImageTypeSpec {
         channels,
         dtype,
@@ -322,7 +445,8 @@ ImageTypeSpec Image::getSpec(int channels, DataType dtype, StorageType stype) {
 
 bool Image::isCompatible(ImageTypeSpec::StorageType storageType) {
     return storageType == StorageType::GPU_OPENGL ||
-        storageType == StorageType::GPU_OPENGL_EXTERNAL;
+        storageType == StorageType::GPU_OPENGL_EXTERNAL ||
+        storageType == StorageType::GPU_OPENGL_ARRAY;
 }
 
 Image &Image::castFrom(::accelerated::Image &image) {
@@ -331,7 +455,11 @@ Image &Image::castFrom(::accelerated::Image &image) {
 }
 
 std::unique_ptr<Image::Factory> Image::createFactory(Processor &p) {
-    return std::unique_ptr<Image::Factory>(new GpuImageFactory(p));
+    return std::unique_ptr<Image::Factory>(new GpuImageFactory(p, nullptr));
+}
+
+std::unique_ptr<Image::Factory> Image::createFactory(Processor &p, Processor &uploadProcessor) {
+    return std::unique_ptr<Image::Factory>(new GpuImageFactory(p, &uploadProcessor));
 }
 
 Image::Image(int w, int h, const ImageTypeSpec &spec) :
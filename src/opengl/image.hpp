@@ -5,10 +5,17 @@
 namespace accelerated {
 namespace opengl {
 struct FrameBuffer;
+struct TextureRegion;
 class Image : public ::accelerated::Image {
 public:
     /** Get OpenGL texture ID for this image */
     virtual int getTextureId() const = 0;
+    /**
+     * The part of the texture (getTextureId) this image covers. ROIs share
+     * the texture of their parent and can be used as inputs to operations
+     * without copying
+     */
+    virtual TextureRegion getTextureRegion() const = 0;
     /** Can this image be read directly or in GL ES an adapter required? */
     virtual bool supportsDirectRead() const = 0;
     /** Can this image be written directly or is an adapter required? */
@@ -40,8 +47,22 @@ public:
      */
     virtual void setInterpolation(Interpolation i) = 0;
 
+    /**
+     * Enable streaming writes: writeRaw copies the input data so the
+     * caller's buffer can be reused as soon as writeRaw returns, and the
+     * upload goes through a ring of pixel unpack buffers so that it can
+     * overlap with rendering. Off by default.
+     */
+    virtual void setStreamingWrites(bool enabled) = 0;
+
     virtual FrameBuffer &getFrameBuffer() = 0;
 
+    /**
+     * Number of layers in a texture array image (see Factory::createArray),
+     * 1 for other images
+     */
+    virtual int getLayerCount() const = 0;
+
     class Factory : public ::accelerated::Image::Factory {
     public:
         /**
@@ -79,11 +100,37 @@ public:
          */
         virtual std::unique_ptr<Image> wrapScreen(int w, int h) = 0;
 
+        /**
+         * Create a batch of images of size w x h stored as the layers of a
+         * GL_TEXTURE_2D_ARRAY. The standard operations process all layers
+         * in a single task, drawing each output layer from the same layer
+         * of the inputs, which must have at least as many layers.
+         *
+         * To the CPU, the layers are stacked vertically: the resulting
+         * Image has the size w x (h * layers) and layer i is the rows
+         * [i*h, (i+1)*h) of the data read or written. Only data types that
+         * support direct reads (see supportsDirectRead) can be read, and
+         * ROIs and compute shaders are not supported.
+         */
+        template <class T, int Channels> std::unique_ptr<Image> createArray(int w, int h, int layers) {
+            return createArray(w, h, layers, Channels, ImageTypeSpec::getType<T>());
+        }
+        virtual std::unique_ptr<Image> createArray(int w, int h, int layers, int channels, DataType dtype) = 0;
+
         virtual std::unique_ptr<Image> wrapTexture(int textureId, int w, int h, const ImageTypeSpec &spec) = 0;
         virtual std::unique_ptr<Image> wrapFrameBuffer(int frameBufferId, int w, int h, const ImageTypeSpec &spec) = 0;
     };
 
     static std::unique_ptr<Factory> createFactory(Processor &processor);
+    /**
+     * Factory whose image writes (texture uploads) run in the context of
+     * uploadProcessor, which must share GL objects with the context of the
+     * processor (see createSharedEGLProcessor). Unlike with the plain
+     * factory, writes are not ordered with the operations enqueued to the
+     * processor: wait for the Future returned by the write before using the
+     * image. Reads and all other operations still run in the processor
+     */
+    static std::unique_ptr<Factory> createFactory(Processor &processor, Processor &uploadProcessor);
     static Image &castFrom(::accelerated::Image &image);
     static bool isCompatible(ImageTypeSpec::StorageType stype);
 
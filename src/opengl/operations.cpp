@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <sstream>
@@ -19,11 +20,40 @@ typedef ::accelerated::operations::fixedConvolution2D::Spec FixedConvolution2DSp
 typedef ::accelerated::operations::pixelwiseAffineCombination::Spec PixelwiseAffineCombinationSpec;
 typedef ::accelerated::operations::channelwiseAffine::Spec ChannelwiseAffineSpec;
 using ::accelerated::operations::Function;
+using ::accelerated::operations::MultiOutputFunction;
+using ::accelerated::operations::ParameterizedFunction;
 
 void checkSpec(const ImageTypeSpec &spec) {
     aa_assert(Image::isCompatible(spec.storageType));
 }
 
+std::string describeSpec(const ImageTypeSpec &spec) {
+    std::ostringstream oss;
+    oss << spec.channels << "x";
+    switch (spec.dataType) {
+        #define X(type, name) case name: oss << std::string(#name).substr(std::string(#name).rfind(':') + 1); break;
+        ACCELERATED_IMAGE_FOR_EACH_NAMED_TYPE(X)
+        #undef X
+    }
+    return oss.str();
+}
+
+// name of the operation in the GPU timing statistics
+std::string describeOperation(const std::string &name, const std::vector<ImageTypeSpec> &inputs, const std::vector<ImageTypeSpec> &outputs) {
+    std::ostringstream oss;
+    oss << name << " ";
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        if (i > 0) oss << ", ";
+        oss << describeSpec(inputs.at(i));
+    }
+    if (!inputs.empty()) oss << " ";
+    oss << "->";
+    for (std::size_t i = 0; i < outputs.size(); ++i) {
+        oss << (i > 0 ? ", " : " ") << describeSpec(outputs.at(i));
+    }
+    return oss.str();
+}
+
 Shader<NAry>::Builder defaultNAryBuilder(std::string fragmentShaderBody, const std::vector<ImageTypeSpec> &inSpecs, const ImageTypeSpec &outSpec) {
     return [fragmentShaderBody, inSpecs, outSpec]() {
         std::unique_ptr< Shader<NAry> > shader(new Shader<NAry>);
@@ -47,7 +77,7 @@ Shader<NAry>::Builder defaultNAryBuilder(std::string fragmentShaderBody, const s
                 auto interpolation = input.getInterpolation();
                 if (border != Image::Border::UNDEFINED) pipeline.setTextureBorder(i, border);
                 if (interpolation != Image::Interpolation::UNDEFINED) pipeline.setTextureInterpolation(i, interpolation);
-                textureBinders->at(i) = &pipeline.bindTexture(i, input.getTextureId());
+                textureBinders->at(i) = &pipeline.bindTexture(i, input.getTextureId(), input.getTextureRegion());
                 textureBinders->at(i)->bind();
             }
             pipeline.call(output.getFrameBuffer());
@@ -58,6 +88,328 @@ Shader<NAry>::Builder defaultNAryBuilder(std::string fragmentShaderBody, const s
     };
 }
 
+Shader<MultiOutputNAry>::Builder multiOutputBuilder(std::string fragmentShaderBody, const std::vector<ImageTypeSpec> &inSpecs, const std::vector<ImageTypeSpec> &outSpecs) {
+    return [fragmentShaderBody, inSpecs, outSpecs]() {
+        std::unique_ptr< Shader<MultiOutputNAry> > shader(new Shader<MultiOutputNAry>);
+
+        shader->resources = GlslPipeline::create(fragmentShaderBody.c_str(), inSpecs, outSpecs);
+        GlslPipeline &pipeline = reinterpret_cast<GlslPipeline&>(*shader->resources);
+
+        auto textureBinders = std::shared_ptr< std::vector<Binder::Target*> >(new std::vector<Binder::Target*>);
+        textureBinders->resize(inSpecs.size(), nullptr);
+
+        shader->function = [&pipeline, inSpecs, outSpecs, textureBinders](Image **inputs, int n, Image **outputs, int nOutputs) {
+            aa_assert(n == int(inSpecs.size()));
+            aa_assert(nOutputs == int(outSpecs.size()) && nOutputs > 0);
+
+            std::vector<int> outputTextureIds;
+            const int width = outputs[0]->width, height = outputs[0]->height;
+            for (int i = 0; i < nOutputs; ++i) {
+                auto &output = *outputs[i];
+                aa_assert(output == outSpecs.at(i));
+                aa_assert(output.width == width && output.height == height);
+                aa_assert(output.getTextureRegion().isFull() && "ROIs are not supported as multiple render targets");
+                outputTextureIds.push_back(output.getTextureId());
+            }
+
+            Binder binder(pipeline);
+            for (std::size_t i = 0; i < inSpecs.size(); ++i) {
+                auto &input = *inputs[i];
+                aa_assert(input == inSpecs.at(i));
+                auto border = input.getBorder();
+                auto interpolation = input.getInterpolation();
+                if (border != Image::Border::UNDEFINED) pipeline.setTextureBorder(i, border);
+                if (interpolation != Image::Interpolation::UNDEFINED) pipeline.setTextureInterpolation(i, interpolation);
+                textureBinders->at(i) = &pipeline.bindTexture(i, input.getTextureId(), input.getTextureRegion());
+                textureBinders->at(i)->bind();
+            }
+            pipeline.call(outputTextureIds, width, height);
+            for (auto *b : *textureBinders) b->unbind();
+        };
+
+        return shader;
+    };
+}
+
+// Numeric spec parameters are either baked into the shader source as
+// constants or, for parameterized functions, read from a uniform array so
+// that changing them does not require a new program
+constexpr const char *PARAMETER_UNIFORM = "u_parameters";
+
+std::string parameterDeclaration(int n) {
+    std::ostringstream oss;
+    oss << "uniform vec4 " << PARAMETER_UNIFORM << "[" << ((n + 3) / 4) << "];\n";
+    return oss.str();
+}
+
+std::string uniformParameter(int index) {
+    std::ostringstream oss;
+    oss << PARAMETER_UNIFORM << "[" << (index / 4) << "]." << "xyzw"[index % 4];
+    return oss.str();
+}
+
+std::vector<double> getParameters(const FixedConvolution2DSpec &spec) {
+    std::vector<double> r;
+    for (const auto &row : spec.kernel) r.insert(r.end(), row.begin(), row.end());
+    r.push_back(spec.bias);
+    return r;
+}
+
+std::vector<double> getParameters(const PixelwiseAffineCombinationSpec &spec) {
+    std::vector<double> r;
+    for (const auto &mat : spec.linear)
+        for (const auto &row : mat) r.insert(r.end(), row.begin(), row.end());
+    r.insert(r.end(), spec.bias.begin(), spec.bias.end());
+    return r;
+}
+
+std::vector<double> getParameters(const ChannelwiseAffineSpec &spec) {
+    return { spec.scale, spec.bias };
+}
+
+std::vector<double> getParameters(const RescaleSpec &spec) {
+    return { spec.xScale, spec.yScale, spec.xTranslation, spec.yTranslation };
+}
+
+// shared between the caller (setParameters) and the GL thread, but only
+// accessed in the GL thread
+struct UniformParameters {
+    std::vector<float> values;
+    int location = -1;
+    bool changed = true;
+
+    void set(const std::vector<double> &parameters) {
+        aa_assert(values.empty() || values.size() == ((parameters.size() + 3) / 4) * 4);
+        values.clear();
+        values.insert(values.end(), parameters.begin(), parameters.end());
+        values.resize(((parameters.size() + 3) / 4) * 4, 0);
+        changed = true;
+    }
+
+    // the program must be bound
+    void upload() {
+        if (!changed) return;
+        glUniform4fv(location, GLsizei(values.size() / 4), values.data());
+        changed = false;
+    }
+};
+
+Shader<NAry>::Builder withUniformParameters(const Shader<NAry>::Builder &builder, std::shared_ptr<UniformParameters> parameters) {
+    return [builder, parameters]() {
+        auto shader = builder();
+        GlslPipeline &pipeline = reinterpret_cast<GlslPipeline&>(*shader->resources);
+        parameters->location = glGetUniformLocation(pipeline.getId(), PARAMETER_UNIFORM);
+        aa_assert(parameters->location >= 0);
+        auto function = shader->function;
+        shader->function = [function, parameters, &pipeline](Image **inputs, int n, Image &output) {
+            {
+                Binder binder(pipeline);
+                parameters->upload();
+            }
+            function(inputs, n, output);
+        };
+        return shader;
+    };
+}
+
+/**
+ * Declares "fetchInput(ivec2 pixel, ivec2 inSize)", a texelFetch from
+ * u_texture that implements the border mode of the spec, since texelFetch
+ * ignores the wrap mode of the texture. Requires "kernelOffset"
+ */
+std::string borderTexelFetchDeclaration(const FixedConvolution2DSpec &spec, const std::string &vtype) {
+    // GLSL % is undefined for negative operands: shift by a multiple of the
+    // period, which is at least 1 pixel, large enough to make them positive
+    const int shift = std::max(0, -std::min(spec.getKernelXOffset(), spec.getKernelYOffset()));
+
+    std::ostringstream oss;
+    oss << vtype << " fetchInput(ivec2 c, ivec2 inSize) {\n";
+    switch (spec.border) {
+        case Image::Border::ZERO:
+            oss << "    if (any(lessThan(c, ivec2(0))) || any(greaterThanEqual(c, inSize))) return " << vtype << "(0);\n";
+            break;
+        case Image::Border::REPEAT:
+            oss << "    c = (c + inSize * " << shift << ") % inSize;\n";
+            break;
+        case Image::Border::MIRROR:
+            oss << "    c = (c + 2 * inSize * " << shift << ") % (2 * inSize);\n";
+            oss << "    c = min(c, 2 * inSize - 1 - c);\n";
+            break;
+        case Image::Border::UNDEFINED:
+            // out-of-bounds reads are not allowed but a clamp is cheap
+            // insurance against undefined texelFetch results
+        case Image::Border::CLAMP:
+            oss << "    c = clamp(c, ivec2(0), inSize - 1);\n";
+            break;
+    }
+    oss << "    return " << vtype << "(texelFetch(u_texture, c, 0));\n";
+    oss << "}\n";
+    return oss.str();
+}
+
+/**
+ * Fully unrolled convolution accumulating to the given variable, using
+ * fetchInput and "base". Zero taps are skipped and taps with the same
+ * absolute kernel value share a single multiplication
+ */
+std::string unrolledConvolutionTaps(const std::vector< std::vector<double> > &kernel, const std::string &accumulator) {
+    struct Group {
+        float weight;
+        std::vector<std::string> positive, negative;
+    };
+    std::vector<Group> groups;
+
+    for (std::size_t i = 0; i < kernel.size(); ++i) {
+        for (std::size_t j = 0; j < kernel.at(i).size(); ++j) {
+            const float k = kernel.at(i).at(j);
+            if (k == 0) continue;
+
+            std::ostringstream tap;
+            tap << "fetchInput(base + ivec2(" << j << ", " << i << "), inSize)";
+
+            auto group = groups.begin();
+            while (group != groups.end() && group->weight != std::fabs(k)) ++group;
+            if (group == groups.end()) {
+                groups.push_back(Group { std::fabs(k), {}, {} });
+                group = groups.end() - 1;
+            }
+            (k > 0 ? group->positive : group->negative).push_back(tap.str());
+        }
+    }
+
+    std::ostringstream oss;
+    for (const auto &group : groups) {
+        // a group with only negative taps is added with a negative weight
+        const bool flip = group.positive.empty();
+        const auto &plus = flip ? group.negative : group.positive;
+        const auto &minus = flip ? group.positive : group.negative;
+        oss << accumulator << (flip ? " -= " : " += ");
+        if (group.weight != 1) oss << "float(" << group.weight << ") * ";
+        oss << "(";
+        for (std::size_t t = 0; t < plus.size(); ++t) {
+            if (t > 0) oss << " + ";
+            oss << plus.at(t);
+        }
+        for (const auto &tap : minus) oss << " - " << tap;
+        oss << ");\n";
+    }
+    return oss.str();
+}
+
+// for blur-like kernels: kernels with negative weights (e.g., derivatives)
+// are computed exactly with texelFetch
+bool canUseLinearSampling(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec) {
+    if (!isLinearFilterable(inSpec)) return false;
+    #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+    // no GL_CLAMP_TO_BORDER
+    if (spec.border == Image::Border::ZERO) return false;
+    #endif
+    for (const auto &row : spec.kernel)
+        for (double k : row) if (k < 0) return false;
+    return true;
+}
+
+/**
+ * Linear sampling trick: 2x2 blocks and pairs of adjacent taps with
+ * positive weights are replaced by a single bilinear texture() fetch at a
+ * fractional offset (2x2 blocks only if they are separable, i.e., rank 1).
+ * The merged taps are set to zero in the kernel, the rest should be
+ * handled with unrolledConvolutionTaps. Requires "base" and "inSize" and
+ * LINEAR interpolation on u_texture. The results are not exact since GPUs
+ * use limited precision (typically 8 bits) for the interpolation weights
+ */
+std::string linearSampledConvolutionTaps(std::vector< std::vector<double> > &kernel, const std::string &vtype, const std::string &accumulator) {
+    const int h = kernel.size();
+    auto k = [&kernel](int i, int j) -> double {
+        if (i >= int(kernel.size()) || j >= int(kernel.at(i).size())) return 0;
+        return kernel.at(i).at(j);
+    };
+
+    std::ostringstream oss;
+    bool any = false;
+    auto sample = [&](int i, int j, double a, double b, double c, double d) {
+        // weights of (i, j), (i, j+1), (i+1, j) and (i+1, j+1)
+        const double w = a + b + c + d;
+        if (!any) {
+            oss << "vec2 baseCoord = vec2(base) + 0.5;\n";
+            oss << "vec2 invInSize = 1.0 / vec2(inSize);\n";
+            any = true;
+        }
+        oss << accumulator << " += float(" << float(w) << ") * "
+            << vtype << "(texture(u_texture, (baseCoord + vec2("
+            << float(j + (b + d) / w) << ", " << float(i + (c + d) / w)
+            << ")) * invInSize));\n";
+    };
+
+    for (int i = 0; i < h; ++i) {
+        for (int j = 0; j < int(kernel.at(i).size()); ++j) {
+            const double a = k(i, j);
+            if (a <= 0) continue;
+            const double b = k(i, j + 1), c = k(i + 1, j), d = k(i + 1, j + 1);
+            if (b > 0 && c > 0 && d > 0 && std::fabs(a*d - b*c) <= 1e-6 * std::max(a*d, b*c)) {
+                sample(i, j, a, b, c, d);
+                kernel.at(i).at(j + 1) = kernel.at(i + 1).at(j) = kernel.at(i + 1).at(j + 1) = 0;
+            } else if (b > 0) {
+                sample(i, j, a, b, 0, 0);
+                kernel.at(i).at(j + 1) = 0;
+            } else if (c > 0) {
+                sample(i, j, a, 0, c, 0);
+                kernel.at(i + 1).at(j) = 0;
+            } else {
+                continue;
+            }
+            kernel.at(i).at(j) = 0;
+        }
+    }
+    return oss.str();
+}
+
+// as "kernel", requires KERNEL_SZ
+std::string constantKernelDeclaration(const FixedConvolution2DSpec &spec) {
+    std::ostringstream oss;
+    oss << "const float kernel[KERNEL_SZ] = float[KERNEL_SZ](\n";
+    for (std::size_t i = 0; i < spec.kernel.size(); ++i) {
+        if (i > 0) oss << ",\n";
+        for (std::size_t j = 0; j < spec.kernel.at(i).size(); ++j) {
+            if (j > 0) oss << ", ";
+            oss << "float(" << spec.kernel.at(i).at(j) << ")";
+        }
+    }
+    oss << "\n);\n";
+    return oss.str();
+}
+
+Shader<NAry>::Builder computeShaderBuilder(std::string computeShaderBody, const std::vector<ImageTypeSpec> &inSpecs, const ImageTypeSpec &outSpec, int groupWidth, int groupHeight) {
+    return [computeShaderBody, inSpecs, outSpec, groupWidth, groupHeight]() {
+        std::unique_ptr< Shader<NAry> > shader(new Shader<NAry>);
+
+        shader->resources = GlslComputeShader::create(computeShaderBody.c_str(), inSpecs, outSpec, groupWidth, groupHeight);
+        GlslComputeShader &program = reinterpret_cast<GlslComputeShader&>(*shader->resources);
+
+        shader->function = [&program, inSpecs, outSpec](Image **inputs, int n, Image &output) {
+            aa_assert(n == int(inSpecs.size()));
+            aa_assert(output == outSpec);
+
+            Binder binder(program);
+            std::vector<Binder::Target*> textureBinders;
+            for (std::size_t i = 0; i < inSpecs.size(); ++i) {
+                auto &input = *inputs[i];
+                aa_assert(input == inSpecs.at(i));
+                auto border = input.getBorder();
+                auto interpolation = input.getInterpolation();
+                if (border != Image::Border::UNDEFINED) program.setTextureBorder(i, border);
+                if (interpolation != Image::Interpolation::UNDEFINED) program.setTextureInterpolation(i, interpolation);
+                textureBinders.push_back(&program.bindTexture(i, input.getTextureId(), input.getTextureRegion()));
+                textureBinders.back()->bind();
+            }
+            program.call(output.getTextureId(), output.getTextureRegion());
+            for (auto *b : textureBinders) b->unbind();
+        };
+
+        return shader;
+    };
+}
+
 namespace impl {
 Shader<NAry>::Builder fill(const FillSpec &spec, const ImageTypeSpec &imageSpec) {
     aa_assert(!spec.value.empty());
@@ -77,7 +429,7 @@ Shader<NAry>::Builder fill(const FillSpec &spec, const ImageTypeSpec &imageSpec)
     return defaultNAryBuilder(fragmentShaderBody, {}, imageSpec);
 }
 
-Shader<Unary>::Builder rescale(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+Shader<Unary>::Builder rescale(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec, bool uniformParameters = false) {
     std::string fragmentShaderBody;
     {
         // ((v_texCoord * u_outSize - 0.5) * alpha + trans * texSize + 0.5) / texSize
@@ -92,9 +444,15 @@ Shader<Unary>::Builder rescale(const RescaleSpec &spec, const ImageTypeSpec &inS
 
         std::ostringstream oss;
         const auto swiz = glsl::swizzleSubset(inSpec.channels);
-        oss << "const vec2 scale = vec2(" << spec.xScale << ", " << spec.yScale << ");\n"
-            << "const vec2 trans = vec2(" << spec.xTranslation << ", " << spec.yTranslation << ");\n"
-            << "void main() {\n"
+        if (uniformParameters) {
+            oss << parameterDeclaration(4)
+                << "#define scale " << PARAMETER_UNIFORM << "[0].xy\n"
+                << "#define trans " << PARAMETER_UNIFORM << "[0].zw\n";
+        } else {
+            oss << "const vec2 scale = vec2(" << spec.xScale << ", " << spec.yScale << ");\n"
+                << "const vec2 trans = vec2(" << spec.xTranslation << ", " << spec.yTranslation << ");\n";
+        }
+        oss << "void main() {\n"
             << "vec2 pixCenterOffset = 0.5 * (1.0 / vec2(textureSize(u_texture, 0)) - scale / vec2(u_outSize));\n"
             << "outValue = " << getGlslVecType(outSpec)
             << "(texture(u_texture, scale * v_texCoord + trans + pixCenterOffset)."
@@ -117,12 +475,17 @@ Shader<Unary>::Builder rescale(const RescaleSpec &spec, const ImageTypeSpec &inS
         pipeline.setTextureBorder(0, spec.border);
         pipeline.setTextureInterpolation(0, spec.interpolation);
 
-        shader->function = [&pipeline, inSpec, outSpec](Image &input, Image &output) {
+        shader->function = [&pipeline, inSpec, outSpec, spec](Image &input, Image &output) {
             aa_assert(input == inSpec);
             aa_assert(output == outSpec);
 
+            const auto region = input.getTextureRegion();
+            // texture() clamps the coordinates to the edges of an ROI
+            aa_assert((region.isFull() || spec.border == Image::Border::CLAMP || spec.border == Image::Border::UNDEFINED)
+                && "ROI inputs of rescale only support Border::CLAMP");
+
             Binder binder(pipeline);
-            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId()));
+            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId(), region));
             pipeline.call(output.getFrameBuffer());
         };
 
@@ -185,7 +548,7 @@ Shader<Unary>::Builder swizzle(const SwizzleSpec &spec, const ImageTypeSpec &inS
             aa_assert(output == outSpec);
 
             Binder binder(pipeline);
-            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId()));
+            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId(), input.getTextureRegion()));
             pipeline.call(output.getFrameBuffer());
         };
 
@@ -193,7 +556,7 @@ Shader<Unary>::Builder swizzle(const SwizzleSpec &spec, const ImageTypeSpec &inS
     };
 }
 
-Shader<NAry>::Builder pixelwiseAffineCombination(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+Shader<NAry>::Builder pixelwiseAffineCombination(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec, bool uniformParameters = false) {
 
     const int nInputs = spec.linear.size();
     std::string fragmentShaderBody;
@@ -203,6 +566,9 @@ Shader<NAry>::Builder pixelwiseAffineCombination(const PixelwiseAffineCombinatio
         const auto swiz = glsl::swizzleSubset(outSpec.channels);
 
         aa_assert(!spec.linear.empty());
+        // with uniform parameters, the matrices are defined in main()
+        std::ostringstream matrices;
+        int parameterIndex = 0;
         for (int i = 0; i < nInputs; ++i) {
             const auto &mat = spec.linear.at(i);
 
@@ -210,31 +576,53 @@ Shader<NAry>::Builder pixelwiseAffineCombination(const PixelwiseAffineCombinatio
             aa_assert(inSpec.channels == int(mat.at(0).size()));
             // TODO: could use smaller mat or dot product for different
             // special cases for perhaps improved performance
-            oss << "const mat4 m" << i << " = mat4(";
+            matrices << (uniformParameters ? "" : "const ") << "mat4 m" << i << " = mat4(";
             for (int col = 0; col < 4; ++col) {
-                oss << "vec4(";
+                matrices << "vec4(";
                 for (int row = 0; row < 4; ++row) {
-                    if (row > 0) oss << ", ";
-                    if (row < int(mat.size()) && col < int(mat.at(row).size()))
-                        oss << mat.at(row).at(col);
-                    else
-                        oss << "0";
+                    if (row > 0) matrices << ", ";
+                    if (row < int(mat.size()) && col < int(mat.at(row).size())) {
+                        if (uniformParameters)
+                            matrices << uniformParameter(parameterIndex + row * int(mat.at(row).size()) + col);
+                        else
+                            matrices << mat.at(row).at(col);
+                    } else {
+                        matrices << "0";
+                    }
                 }
-                oss << ")";
-                if (col < 3) oss << ",";
-                oss << "\n";
+                matrices << ")";
+                if (col < 3) matrices << ",";
+                matrices << "\n";
             }
-            oss << ");\n";
+            matrices << ");\n";
+            parameterIndex += int(mat.size() * mat.at(0).size());
         }
 
-        oss << "void main() {\n";
         const std::string vtype = glsl::floatVecType(outSpec.channels);
+        if (uniformParameters) {
+            const int nParameters = parameterIndex + int(spec.bias.size());
+            oss << parameterDeclaration(nParameters);
+            oss << "void main() {\n";
+            oss << matrices.str();
+        } else {
+            oss << matrices.str();
+            oss << "void main() {\n";
+        }
         oss << vtype << " v = ";
         if (spec.bias.empty()) {
             oss << vtype << "(0)";
         } else {
             aa_assert(outSpec.channels == int(spec.bias.size()));
-            oss << glsl::wrapToFloatVec(spec.bias);
+            if (uniformParameters) {
+                oss << vtype << "(";
+                for (int c = 0; c < outSpec.channels; ++c) {
+                    if (c > 0) oss << ", ";
+                    oss << uniformParameter(parameterIndex + c);
+                }
+                oss << ")";
+            } else {
+                oss << glsl::wrapToFloatVec(spec.bias);
+            }
         }
         oss << ";\n";
         for (int i = 0; i < nInputs; ++i) {
@@ -256,17 +644,20 @@ Shader<NAry>::Builder pixelwiseAffineCombination(const PixelwiseAffineCombinatio
     return defaultNAryBuilder(fragmentShaderBody, inSpecs, outSpec);
 }
 
-Shader<NAry>::Builder channelwiseAffine(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+Shader<NAry>::Builder channelwiseAffine(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec, bool uniformParameters = false) {
     std::string fragmentShaderBody;
     {
         std::ostringstream oss;
         const auto swiz = glsl::swizzleSubset(inSpec.channels);
 
+        if (uniformParameters) oss << parameterDeclaration(2);
         oss << "void main() {\n";
         oss << "outValue = " << getGlslVecType(outSpec) << "(";
-        if (std::fabs(spec.scale - 1.0) > 1e-10) oss << "float(" << spec.scale << ") * ";
+        if (uniformParameters) oss << uniformParameter(0) << " * ";
+        else if (std::fabs(spec.scale - 1.0) > 1e-10) oss << "float(" << spec.scale << ") * ";
         oss << "vec4(texelFetch(u_texture, ivec2(v_texCoord * vec2(u_outSize)), 0))." << swiz << "\n";
-        if (std::fabs(spec.bias) > 1e-10) oss << " + float(" << spec.bias << ")";
+        if (uniformParameters) oss << " + " << uniformParameter(1);
+        else if (std::fabs(spec.bias) > 1e-10) oss << " + float(" << spec.bias << ")";
         oss << ");\n";
         oss << "}\n";
 
@@ -276,78 +667,173 @@ Shader<NAry>::Builder channelwiseAffine(const ChannelwiseAffineSpec &spec, const
     return defaultNAryBuilder(fragmentShaderBody, { inSpec }, outSpec);
 }
 
-Shader<Unary>::Builder fixedConvolution2D(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+Shader<Unary>::Builder fixedConvolution2D(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec, bool uniformParameters = false) {
     aa_assert(!spec.kernel.empty());
 
+    const bool linearSampling = !uniformParameters && canUseLinearSampling(spec, inSpec);
+
     std::string fragmentShaderBody;
     {
         std::ostringstream oss;
 
         const int kernelH = spec.kernel.size();
         const int kernelW = spec.kernel.at(0).size();
+        const auto vtype = glsl::floatVecType(outSpec.channels);
 
-        oss << "#define KERNEL_H " << kernelH << "\n";
-        oss << "#define KERNEL_W " << kernelW << "\n";
-        oss << "#define KERNEL_SZ " << (kernelH * kernelW)  << "\n";
-        oss << "const float kernel[KERNEL_SZ] = float[KERNEL_SZ](\n";
-        for (int i = 0; i < kernelH; ++i) {
-            if (i > 0) oss << ",\n";
-            for (int j = 0; j < kernelW; ++j) {
-                if (j > 0) oss << ", ";
-                oss << "float(" << spec.kernel.at(i).at(j) << ")";
+        if (uniformParameters) {
+            // kernel values followed by the bias
+            oss << parameterDeclaration(kernelH * kernelW + 1);
+        }
+        // input pixel of the first tap = output pixel * stride + kernelOffset
+        oss << "const ivec2 stride = ivec2(" << spec.xStride << ", " << spec.yStride << ");\n";
+        oss << "const ivec2 kernelOffset = ivec2(" << spec.getKernelXOffset() << ", " << spec.getKernelYOffset() << ");\n";
+        oss << borderTexelFetchDeclaration(spec, vtype);
+
+        oss << "void main() {\n";
+        oss << "ivec2 inSize = textureSize(u_texture, 0);\n";
+        oss << "ivec2 base = ivec2(v_texCoord * vec2(u_outSize)) * stride + kernelOffset;\n";
+        if (uniformParameters) {
+            oss << vtype << " v = " << vtype << "(" << uniformParameter(kernelH * kernelW) << ");\n";
+            for (int i = 0; i < kernelH; ++i) {
+                for (int j = 0; j < kernelW; ++j) {
+                    oss << "v += " << uniformParameter(i * kernelW + j) << " * "
+                        << "fetchInput(base + ivec2(" << j << ", " << i << "), inSize);\n";
+                }
+            }
+        } else {
+            oss << vtype << " v = " << vtype << "(" << spec.bias << ");\n";
+            auto kernel = spec.kernel;
+            if (linearSampling) {
+                // the bilinear taps would clamp to the edges of an ROI
+                const bool exactForRegions = spec.border != Image::Border::CLAMP && spec.border != Image::Border::UNDEFINED;
+                if (exactForRegions) {
+                    oss << "if (aa_isRegion(u_texture)) {\n"
+                        << unrolledConvolutionTaps(spec.kernel, "v")
+                        << "} else {\n";
+                }
+                oss << linearSampledConvolutionTaps(kernel, vtype, "v");
+                oss << unrolledConvolutionTaps(kernel, "v");
+                if (exactForRegions) oss << "}\n";
+            } else {
+                oss << unrolledConvolutionTaps(kernel, "v");
             }
         }
-        oss << "\n);\n";
+        oss << "outValue = " << getGlslVecType(outSpec) << "(v);\n";
+        oss << "}\n";
 
-        const auto vtype = glsl::floatVecType(outSpec.channels);
+        fragmentShaderBody = oss.str();
+    }
+
+    return [fragmentShaderBody, spec, inSpec, outSpec, linearSampling]() {
+        std::unique_ptr< Shader<Unary> > shader(new Shader<Unary>);
+        shader->resources = GlslPipeline::create(fragmentShaderBody.c_str(), { inSpec }, outSpec);
+        GlslPipeline &pipeline = reinterpret_cast<GlslPipeline&>(*shader->resources);
+        if (linearSampling) {
+            // fetchInput handles the border for texelFetch, the sampler for
+            // the bilinear taps
+            pipeline.setTextureInterpolation(0, Image::Interpolation::LINEAR);
+            pipeline.setTextureBorder(0, spec.border == Image::Border::UNDEFINED ? Image::Border::CLAMP : spec.border);
+        }
+
+        shader->function = [&pipeline](Image &input, Image &output) {
+            Binder binder(pipeline);
+            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId(), input.getTextureRegion()));
+            pipeline.call(output.getFrameBuffer());
+        };
+
+        return shader;
+    };
+}
+
+/**
+ * Compute shader version of fixedConvolution2D: each work group first
+ * loads the input pixels needed by its output tile to shared memory so that
+ * each of them is fetched once instead of once per kernel element. Returns
+ * an empty builder if the specs are not supported by this implementation
+ */
+Shader<Unary>::Builder tiledConvolution2D(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+    aa_assert(!spec.kernel.empty());
+
+    // 128 invocations is the minimum work group size in GLES 3.1
+    constexpr int TILE_W = 16, TILE_H = 8;
+    // minimum shared memory size in GLES 3.1 divided by the size of a vec4
+    constexpr int MAX_SHARED_ELEMENTS = 16384 / 16;
 
-        // NOTE: this is a recurring problem in many kernels, could make a
-        // suitable helper
+    const int kernelH = spec.kernel.size();
+    const int kernelW = spec.kernel.at(0).size();
+    const int inTileW = (TILE_W - 1) * spec.xStride + kernelW;
+    const int inTileH = (TILE_H - 1) * spec.yStride + kernelH;
 
-        // texCoord = (ix + 0.5) / width_out
-        // => ix = texCoord*width_out - 0.5
-        // targetTexCoord = (ix * xStride + jx + xOffs + 0.5) / width_in
-        //  = ((texCoord*width_out - 0.5) * xStride + jx + xOffs + 0.5) / width_in
-        //  = ((width_out*xStride) * texCoord  + jx + xOffs + 0.5 * (1 - xStride)) / width_in
-        // = (alpha * texCoord + jx + pixelOffset) / width_in
+    if (getGlslImageFormat(outSpec).empty() ||
+        inSpec.storageType != ImageTypeSpec::StorageType::GPU_OPENGL ||
+        inTileW * inTileH > MAX_SHARED_ELEMENTS) return {};
 
-        const float xOffs = spec.getKernelXOffset() + 0.5 * (1 - spec.xStride);
-        const float yOffs = spec.getKernelYOffset() + 0.5 * (1 - spec.yStride);
+    std::string computeShaderBody;
+    {
+        std::ostringstream oss;
+        const auto vtype = glsl::floatVecType(outSpec.channels);
 
-        oss << "const vec2 stride = vec2(" << spec.xStride << ", " << spec.yStride << ");\n";
-        oss << "const vec2 pixelOffset = vec2(" << xOffs << ", " << yOffs << ");\n";
+        oss << "#define KERNEL_H " << kernelH << "\n";
+        oss << "#define KERNEL_W " << kernelW << "\n";
+        oss << "#define KERNEL_SZ " << (kernelH * kernelW)  << "\n";
+        oss << "#define IN_TILE_W " << inTileW << "\n";
+        oss << "#define IN_TILE_SZ " << (inTileW * inTileH) << "\n";
+        oss << constantKernelDeclaration(spec);
+        oss << "const ivec2 stride = ivec2(" << spec.xStride << ", " << spec.yStride << ");\n";
+        oss << "const ivec2 kernelOffset = ivec2(" << spec.getKernelXOffset() << ", " << spec.getKernelYOffset() << ");\n";
+        oss << "shared " << vtype << " tile[IN_TILE_SZ];\n";
+        // texelFetch also works with ROI inputs, for all border modes
+        oss << borderTexelFetchDeclaration(spec, vtype);
 
         oss << "void main() {\n";
-        oss << "vec2 alpha = stride * vec2(u_outSize);\n";
+        oss << "ivec2 inSize = textureSize(u_texture, 0);\n";
+        oss << "ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) * stride + kernelOffset;\n";
+        oss << "int groupSize = int(gl_WorkGroupSize.x * gl_WorkGroupSize.y);\n";
+        oss << "for (int idx = int(gl_LocalInvocationIndex); idx < IN_TILE_SZ; idx += groupSize) {\n";
+        oss << "    tile[idx] = fetchInput(tileOrigin + ivec2(idx % IN_TILE_W, idx / IN_TILE_W), inSize);\n";
+        oss << "}\n";
+        oss << "barrier();\n";
+        oss << "ivec2 outCoord = ivec2(gl_GlobalInvocationID.xy);\n";
+        oss << "if (outCoord.x >= u_outSize.x || outCoord.y >= u_outSize.y) return;\n";
+        oss << "ivec2 base = ivec2(gl_LocalInvocationID.xy) * stride;\n";
         oss << vtype << " v = " << vtype << "(" << spec.bias << ");\n";
         oss << "for (int i = 0; i < KERNEL_H; i++) {\n";
         oss << "for (int j = 0; j < KERNEL_W; j++) {\n";
-        oss << "    float k = kernel[uint(i * KERNEL_W + j)];\n";
-        oss << "    vec2 coord = (alpha * v_texCoord + (vec2(j, i) + pixelOffset)) / vec2(textureSize(u_texture, 0));\n";
-        oss << "    v += k * " << vtype << "(texture(u_texture, coord));\n";
+        oss << "    v += kernel[i * KERNEL_W + j] * tile[(base.y + i) * IN_TILE_W + base.x + j];\n";
         oss << "}\n";
         oss << "}\n";
-        oss << "outValue = " << getGlslVecType(outSpec) << "(v);\n";
+        oss << "storeOutValue(outCoord, " << getGlslVecType(outSpec) << "(v));\n";
         oss << "}\n";
 
-        fragmentShaderBody = oss.str();
+        computeShaderBody = oss.str();
     }
 
-    return [fragmentShaderBody, spec, inSpec, outSpec]() {
+    return [computeShaderBody, spec, inSpec, outSpec]() {
         std::unique_ptr< Shader<Unary> > shader(new Shader<Unary>);
-        shader->resources = GlslPipeline::create(fragmentShaderBody.c_str(), { inSpec }, outSpec);
-        GlslPipeline &pipeline = reinterpret_cast<GlslPipeline&>(*shader->resources);
-        pipeline.setTextureBorder(0, spec.border);
+        shader->resources = GlslComputeShader::create(computeShaderBody.c_str(), { inSpec }, outSpec, TILE_W, TILE_H);
+        GlslComputeShader &program = reinterpret_cast<GlslComputeShader&>(*shader->resources);
 
-        shader->function = [&pipeline, spec](Image &input, Image &output) {
-            Binder binder(pipeline);
-            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId()));
-            pipeline.call(output.getFrameBuffer());
+        shader->function = [&program](Image &input, Image &output) {
+            Binder binder(program);
+            Binder inputBinder(program.bindTexture(0, input.getTextureId(), input.getTextureRegion()));
+            program.call(output.getTextureId(), output.getTextureRegion());
         };
 
         return shader;
     };
 }
+
+// choose between two implementations on the GL thread, when the context
+// is known
+template <class F> typename Shader<F>::Builder computeIfSupported(
+    const typename Shader<F>::Builder &compute,
+    const typename Shader<F>::Builder &fallback)
+{
+    if (!compute) return fallback;
+    return [compute, fallback]() {
+        return supportsComputeShaders() ? compute() : fallback();
+    };
+}
 }
 
 class GpuFactory : public Factory {
@@ -355,30 +841,41 @@ public:
     // used to enable convenient weak_ptr
     struct Data {
         Processor &processor;
+        // if set, shaders are built in this (shared) context
+        Processor *workerProcessor;
         bool debug = false;
-        Data(Processor &processor) : processor(processor) {}
+        bool computeShaders = true;
+        bool gpuTiming = false;
+        std::shared_ptr<GpuTimer> timer;
+        Data(Processor &processor, Processor *workerProcessor) :
+            processor(processor), workerProcessor(workerProcessor), timer(GpuTimer::create()) {}
     };
 private:
     std::shared_ptr<Data> data;
 
-    class ShaderWrapper {
+    template <class F> class ShaderWrapper {
     private:
-        typedef Shader<NAry> S;
+        typedef Shader<F> S;
         std::weak_ptr<Data> data;
         std::shared_ptr< S > shader;
 
     public:
-        ShaderWrapper(std::weak_ptr<Data> data) : data(data) {}
+        // resolved when the shader built in a worker context can be used
+        Future ready;
+
+        ShaderWrapper(std::weak_ptr<Data> data) : data(data), ready(Future::instantlyResolved()) {}
 
         void initialize(std::unique_ptr<S> s) {
             std::shared_ptr<S> tmp = std::move(s);
             auto d = data.lock();
             aa_assert(d);
             if (d->debug) {
-                // TODO: hacky
-                auto &p = reinterpret_cast<GlslPipeline&>(*tmp->resources);
-                log_debug("vertex shader:\n%s", p.getVertexShaderSource().c_str());
-                log_debug("fragment shader:\n%s", p.getFragmentShaderSource().c_str());
+                if (auto *p = dynamic_cast<GlslProgram*>(tmp->resources.get())) {
+                    log_debug("vertex shader:\n%s", p->getVertexShaderSource().c_str());
+                    log_debug("fragment shader:\n%s", p->getFragmentShaderSource().c_str());
+                } else if (auto *c = dynamic_cast<GlslComputeShader*>(tmp->resources.get())) {
+                    log_debug("compute shader:\n%s", c->getComputeShaderSource().c_str());
+                }
             }
             std::atomic_store(&shader, tmp);
         }
@@ -397,77 +894,328 @@ private:
             }
         }
 
-        NAry &get() {
+        F &get() {
             // should never be called at the same time with other actions
-            std::shared_ptr<S> tmp = std::atomic_load(&shader);
-            aa_assert(tmp && tmp->function);
+            std::shared_ptr<S> tmp = load();
+            aa_assert(tmp->function);
             return tmp->function;
         }
+
+        void warmUp() {
+            std::shared_ptr<S> tmp = load();
+            // other kinds of resources (custom wrapNAry builders) are only
+            // built, not drawn
+            if (auto *p = dynamic_cast<GlslPipeline*>(tmp->resources.get())) {
+                p->warmUp();
+            } else if (auto *c = dynamic_cast<GlslComputeShader*>(tmp->resources.get())) {
+                c->warmUp();
+            }
+        }
+
+    private:
+        std::shared_ptr<S> load() {
+            std::shared_ptr<S> tmp = std::atomic_load(&shader);
+            if (!tmp) {
+                log_debug("waiting for a shader being built in the worker context");
+                ready.wait();
+                tmp = std::atomic_load(&shader);
+            }
+            aa_assert(tmp);
+            return tmp;
+        }
+    };
+
+    // a Function that can be recognized by warmUp
+    struct ShaderFunction {
+        Function function;
+        std::function<void()> warmUp;
+
+        Future operator()(::accelerated::Image **inputs, int nInputs, ::accelerated::Image &output) const {
+            return function(inputs, nInputs, output);
+        }
     };
 
+    template <class F> std::shared_ptr< ShaderWrapper<F> > build(const typename Shader<F>::Builder &builder) {
+        std::shared_ptr< ShaderWrapper<F> > wrapper(new ShaderWrapper<F>(data));
+        if (data->workerProcessor == nullptr) {
+            data->processor.enqueue([builder, wrapper]() { wrapper->initialize(builder()); });
+            return wrapper;
+        }
+
+        // Compile & link in the worker context and hand the shader over to
+        // the rendering context once the GPU has finished with its objects
+        Processor &worker = *data->workerProcessor;
+        std::shared_ptr< std::unique_ptr< Shader<F> > > built(new std::unique_ptr< Shader<F> >);
+        std::shared_ptr< std::function<bool(bool)> > fence(new std::function<bool(bool)>);
+        worker.enqueue([builder, built, fence]() {
+            *built = builder();
+            *fence = insertFence();
+        });
+        wrapper->ready = pollInGlThread(worker, [wrapper, built, fence](bool block) -> bool {
+            if (!(*fence)(block)) return false;
+            wrapper->initialize(std::move(*built));
+            return true;
+        });
+        return wrapper;
+    }
+
 public:
-    GpuFactory(Processor &processor) : data(new Data(processor)) {}
+    GpuFactory(Processor &processor, Processor *workerProcessor) : data(new Data(processor, workerProcessor)) {}
+
+    ~GpuFactory() {
+        // Functions created by this factory stop measuring after this
+        if (data->gpuTiming) {
+            std::shared_ptr<GpuTimer> timer = data->timer;
+            data->processor.enqueue([timer]() { timer->destroy(); });
+        }
+    }
 
     void debugLogShaders(bool enabled) {
         data->debug = enabled;
     }
 
+    void useComputeShaders(bool enabled) final {
+        data->computeShaders = enabled;
+    }
+
+    void enableGpuTiming(bool enabled) final {
+        data->gpuTiming = enabled;
+    }
+
+    std::vector<GpuTimingStatistics> getGpuTimingStatistics() final {
+        // the results of the latest timed calls become available in the
+        // next call. Not waited for: this may be called in the GL thread
+        std::shared_ptr<GpuTimer> timer = data->timer;
+        if (data->gpuTiming) data->processor.enqueue([timer]() { timer->collect(); });
+        return timer->getStatistics();
+    }
+
     Function wrapShader(
         const std::string &fragmentShaderBody,
         const std::vector<ImageTypeSpec> &inputs,
         const ImageTypeSpec &output) final {
-        return wrapNAry(defaultNAryBuilder(fragmentShaderBody, inputs, output));
+        return wrapNamed(defaultNAryBuilder(fragmentShaderBody, inputs, output),
+            describeOperation("wrapShader", inputs, { output }));
     };
 
+    Function wrapComputeShader(
+        const std::string &computeShaderBody,
+        const std::vector<ImageTypeSpec> &inputs,
+        const ImageTypeSpec &output,
+        int workGroupWidth,
+        int workGroupHeight) final
+    {
+        return wrapNamed(computeShaderBuilder(computeShaderBody, inputs, output, workGroupWidth, workGroupHeight),
+            describeOperation("wrapComputeShader", inputs, { output }));
+    }
+
     Function wrapNAry(const Shader<NAry>::Builder &builder) final {
-        std::shared_ptr<ShaderWrapper> wrapper(new ShaderWrapper(data));
-        data->processor.enqueue([builder, wrapper]() { wrapper->initialize(builder()); });
-        return ::accelerated::operations::sync::wrap<Image>([wrapper](Image **inputs, int nInputs, Image &output) {
-            wrapper->get()(inputs, nInputs, output);
+        return wrapNamed(builder, "wrapNAry");
+    }
+
+    Future warmUp(const std::vector<Function> &functions) final {
+        std::vector< std::function<void()> > warmUps;
+        for (const auto &f : functions) {
+            const auto *shaderFunction = f.target<ShaderFunction>();
+            if (shaderFunction == nullptr) {
+                log_warn("warmUp: skipping a function not created by this factory");
+                continue;
+            }
+            warmUps.push_back(shaderFunction->warmUp);
+        }
+
+        // resolved when the GPU has also executed the draws
+        Processor &processor = data->processor;
+        std::shared_ptr< std::function<bool(bool)> > fence(new std::function<bool(bool)>);
+        processor.enqueue([warmUps, fence]() {
+            for (const auto &w : warmUps) w();
+            *fence = insertFence();
+        });
+        return pollInGlThread(processor, [fence](bool block) -> bool {
+            return (*fence)(block);
+        });
+    }
+
+    MultiOutputFunction wrapMultiOutputShader(
+        const std::string &fragmentShaderBody,
+        const std::vector<ImageTypeSpec> &inputs,
+        const std::vector<ImageTypeSpec> &outputs) final
+    {
+        for (const auto &spec : inputs) checkSpec(spec);
+        for (const auto &spec : outputs) checkSpec(spec);
+        const auto builder = multiOutputBuilder(fragmentShaderBody, inputs, outputs);
+        auto wrapper = build<MultiOutputNAry>(builder);
+        const auto timer = getTimer();
+        const std::string name = describeOperation("wrapMultiOutputShader", inputs, outputs);
+        return ::accelerated::operations::sync::wrapMultiOutput<Image>([wrapper, timer, name](Image **inputs, int nInputs, Image **outputs, int nOutputs) {
+            auto &f = wrapper->get();
+            if (!timer) return f(inputs, nInputs, outputs, nOutputs);
+            timer->time(name, [&]() { f(inputs, nInputs, outputs, nOutputs); });
         }, data->processor);
     }
 
     Function create(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
         checkSpec(inSpec);
         checkSpec(outSpec);
-        return wrap<Unary>(impl::fixedConvolution2D(spec, inSpec, outSpec));
+        auto fragment = impl::fixedConvolution2D(spec, inSpec, outSpec);
+        const std::string name = convolutionName(spec, inSpec, outSpec);
+        if (!data->computeShaders) return wrapNamed(convertToNAry<Unary>(fragment), name);
+        return wrapNamed(convertToNAry<Unary>(impl::computeIfSupported<Unary>(impl::tiledConvolution2D(spec, inSpec, outSpec), fragment)), name);
     }
 
     Function create(const FillSpec &spec, const ImageTypeSpec &imageSpec) final {
         checkSpec(imageSpec);
-        return wrapNAry(impl::fill(spec, imageSpec));
+        return wrapNamed(impl::fill(spec, imageSpec), describeOperation("fill", {}, { imageSpec }));
     }
 
     Function create(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
         checkSpec(inSpec);
         checkSpec(outSpec);
-        return wrap<Unary>(impl::rescale(spec, inSpec, outSpec));
+        return wrapNamed(convertToNAry<Unary>(impl::rescale(spec, inSpec, outSpec)), describeOperation("rescale", { inSpec }, { outSpec }));
     }
 
     Function create(const SwizzleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
         checkSpec(inSpec);
         checkSpec(outSpec);
-        return wrap<Unary>(impl::swizzle(spec, inSpec, outSpec));
+        return wrapNamed(convertToNAry<Unary>(impl::swizzle(spec, inSpec, outSpec)), describeOperation("swizzle", { inSpec }, { outSpec }));
     }
 
     Function create(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
         checkSpec(inSpec);
         checkSpec(outSpec);
-        return wrapNAry(impl::pixelwiseAffineCombination(spec, inSpec, outSpec));
+        return wrapNamed(impl::pixelwiseAffineCombination(spec, inSpec, outSpec), describeOperation("pixelwiseAffineCombination", { inSpec }, { outSpec }));
     }
 
     Function create(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
         checkSpec(inSpec);
         checkSpec(outSpec);
-        return wrapNAry(impl::channelwiseAffine(spec, inSpec, outSpec));
+        return wrapNamed(impl::channelwiseAffine(spec, inSpec, outSpec), describeOperation("channelwiseAffine", { inSpec }, { outSpec }));
+    }
+
+    ParameterizedFunction<FixedConvolution2DSpec> createParameterized(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return wrapParameterized(spec, convertToNAry<Unary>(impl::fixedConvolution2D(spec, inSpec, outSpec, true)),
+            convolutionName(spec, inSpec, outSpec));
+    }
+
+    ParameterizedFunction<PixelwiseAffineCombinationSpec> createParameterized(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return wrapParameterized(spec, impl::pixelwiseAffineCombination(spec, inSpec, outSpec, true),
+            describeOperation("pixelwiseAffineCombination", { inSpec }, { outSpec }));
+    }
+
+    ParameterizedFunction<ChannelwiseAffineSpec> createParameterized(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return wrapParameterized(spec, impl::channelwiseAffine(spec, inSpec, outSpec, true),
+            describeOperation("channelwiseAffine", { inSpec }, { outSpec }));
+    }
+
+    ParameterizedFunction<RescaleSpec> createParameterized(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return wrapParameterized(spec, convertToNAry<Unary>(impl::rescale(spec, inSpec, outSpec, true)),
+            describeOperation("rescale", { inSpec }, { outSpec }));
+    }
+
+private:
+    std::shared_ptr<GpuTimer> getTimer() const {
+        if (!data->gpuTiming) return {};
+        return data->timer;
+    }
+
+    Function wrapNamed(const Shader<NAry>::Builder &builder, const std::string &name) {
+        auto wrapper = build<NAry>(builder);
+        const auto timer = getTimer();
+        return ShaderFunction {
+            ::accelerated::operations::sync::wrap<Image>([wrapper, timer, name](Image **inputs, int nInputs, Image &output) {
+                auto &f = wrapper->get();
+                if (!timer) return f(inputs, nInputs, output);
+                timer->time(name, [&]() { f(inputs, nInputs, output); });
+            }, data->processor),
+            [wrapper]() { wrapper->warmUp(); }
+        };
+    }
+
+    static std::string convolutionName(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+        std::ostringstream oss;
+        oss << "fixedConvolution2D " << spec.kernel.size() << "x" << spec.kernel.at(0).size();
+        return describeOperation(oss.str(), { inSpec }, { outSpec });
+    }
+
+    template <class Spec> ParameterizedFunction<Spec> wrapParameterized(const Spec &spec, const Shader<NAry>::Builder &builder, const std::string &name) {
+        std::shared_ptr<UniformParameters> parameters(new UniformParameters);
+        parameters->set(getParameters(spec));
+        ParameterizedFunction<Spec> r;
+        r.function = wrapNamed(withUniformParameters(builder, parameters), name);
+        Processor &processor = data->processor;
+        r.setParameters = [parameters, &processor](const Spec &newSpec) -> Future {
+            const auto values = getParameters(newSpec);
+            // ordered with respect to the Function calls
+            return ::accelerated::operations::sync::enqueue(processor, [parameters, values]() {
+                parameters->set(values);
+            });
+        };
+        return r;
     }
 };
 }
 
 std::unique_ptr<Factory> createFactory(Processor &processor) {
-    return std::unique_ptr<Factory>(new GpuFactory(processor));
+    return std::unique_ptr<Factory>(new GpuFactory(processor, nullptr));
+}
+
+std::unique_ptr<Factory> createFactory(Processor &processor, Processor &workerProcessor) {
+    return std::unique_ptr<Factory>(new GpuFactory(processor, &workerProcessor));
+}
+}
+
+namespace {
+class GpuCompletionProcessor final : public Processor {
+private:
+    Processor &glProcessor;
+    WaitPolicy waitPolicy;
+
+public:
+    GpuCompletionProcessor(Processor &glProcessor) : glProcessor(glProcessor) {}
+
+    Future enqueue(const std::function<void()> &op) final {
+        return enqueue(op, CancellationToken::current());
+    }
+
+    Future enqueue(const std::function<void()> &op, const CancellationToken &token) final {
+        std::shared_ptr< std::function<bool(bool)> > fence(new std::function<bool(bool)>);
+        std::shared_ptr<Promise> promise = Promise::create(waitPolicy);
+        glProcessor.enqueue([op, fence]() {
+            op();
+            *fence = insertFence();
+        }, token);
+
+        // the GL processor is FIFO so the op has either run or been dropped
+        // by the time this is first polled
+        pollInGlThread(glProcessor, [fence, token, promise](bool block) -> bool {
+            if (!*fence) {
+                aa_assert(token.isCancelled());
+                promise->cancel();
+                return true;
+            }
+            if (!(*fence)(block)) return false;
+            promise->resolve();
+            return true;
+        });
+        return promise->getFuture();
+    }
+
+    void setDefaultWaitPolicy(const WaitPolicy &policy) final {
+        waitPolicy = policy;
+    }
+};
 }
 
+std::unique_ptr<Processor> createGpuCompletionProcessor(Processor &glProcessor) {
+    return std::unique_ptr<Processor>(new GpuCompletionProcessor(glProcessor));
 }
 }
 }
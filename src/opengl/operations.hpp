@@ -12,6 +12,7 @@ typedef std::function< void(Image **inputs, int nInputs, Image &output) > NAry;
 typedef std::function< void(Image &output) > Nullary;
 typedef std::function< void(Image &input, Image &output) > Unary;
 typedef std::function< void(Image &a, Image &b, Image &output) > Binary;
+typedef std::function< void(Image **inputs, int nInputs, Image **outputs, int nOutputs) > MultiOutputNAry;
 
 template <class F> struct Shader {
     /** Will be invoked in the GL thread */
@@ -25,6 +26,15 @@ template <class F> struct Shader {
     typedef std::function< std::unique_ptr<Shader<F>>() > Builder;
 };
 
+struct GpuTimingStatistics {
+    std::string name;
+    /** number of results included in the statistics */
+    int count = 0;
+    double minMilliseconds = 0;
+    double meanMilliseconds = 0;
+    double p95Milliseconds = 0;
+};
+
 class Factory : public ::accelerated::operations::StandardFactory {
 public:
     /**
@@ -38,14 +48,73 @@ public:
         return wrapNAry(convertToNAry<T>(builder));
     }
 
+    /**
+     * Wrap a fragment shader body (see GlslPipeline) that reads the inputs
+     * u_texture (or u_texture1, u_texture2, ...) and writes outValue.
+     *
+     * So that any input can be an ROI (see GlslPipeline), each input
+     * sampler name is a macro that expands to the sampler and the uniforms
+     * of its region. The input samplers can therefore only be passed to
+     * texture(sampler, coord), textureLod (not with external textures),
+     * texelFetch and textureSize. Other texture functions, like
+     * textureOffset, textureGrad, texelFetchOffset or textureProj, texture
+     * with a bias argument, and passing the samplers to user-defined
+     * functions no longer compile
+     */
     virtual ::accelerated::operations::Function wrapShader(
         const std::string &fragmentShaderBody,
         const std::vector<ImageTypeSpec> &inputs,
         const ImageTypeSpec &output) = 0;
 
+    /**
+     * Wrap a compute shader (see GlslComputeShader for the variables
+     * available in the body). The input samplers have the same
+     * restrictions as in wrapShader. Requires OpenGL 4.3 or OpenGL ES 3.1
+     */
+    virtual ::accelerated::operations::Function wrapComputeShader(
+        const std::string &computeShaderBody,
+        const std::vector<ImageTypeSpec> &inputs,
+        const ImageTypeSpec &output,
+        int workGroupWidth,
+        int workGroupHeight) = 0;
+
+    /**
+     * Like wrapShader, but renders to several output images of the same size
+     * in a single pass (multiple render targets). In the shader body, the
+     * outputs are called outValue0, outValue1, ... instead of outValue.
+     * The size of the outputs is available as u_outSize as usual
+     */
+    virtual ::accelerated::operations::MultiOutputFunction wrapMultiOutputShader(
+        const std::string &fragmentShaderBody,
+        const std::vector<ImageTypeSpec> &inputs,
+        const std::vector<ImageTypeSpec> &outputs) = 0;
+
     virtual void debugLogShaders(bool enabled) = 0;
 
-private:
+    /**
+     * Use compute shader implementations of the standard operations, where
+     * available, if the GL context supports them. Enabled by default. Only
+     * affects operations created after the call
+     */
+    virtual void useComputeShaders(bool enabled) = 0;
+
+    /**
+     * Measure the GPU time of each call of the operations created after
+     * this with GL_TIME_ELAPSED queries (GL_EXT_disjoint_timer_query on
+     * OpenGL ES). The results are collected without stalling, during later
+     * calls or getGpuTimingStatistics, so they appear there a few calls late.
+     * Disabled by default
+     */
+    virtual void enableGpuTiming(bool enabled) = 0;
+
+    /**
+     * GPU times per operation name and image specs, e.g.,
+     * "fixedConvolution2D 3x3 1xUFIXED8 -> 1xFLOAT32", over the latest
+     * results. Can be called in any thread
+     */
+    virtual std::vector<GpuTimingStatistics> getGpuTimingStatistics() = 0;
+
+protected:
     template <class T> static Shader<NAry>::Builder convertToNAry(const typename Shader<T>::Builder &otherAryBuilder) {
         return [otherAryBuilder]() {
            auto otherAry = otherAryBuilder();
@@ -58,8 +127,75 @@ private:
 };
 
 std::unique_ptr<Factory> createFactory(Processor &processor);
+
+/**
+ * Factory whose shader programs are compiled and linked in the context of
+ * workerProcessor, which must share GL objects with the context of the
+ * (rendering) processor, e.g., one created with createSharedEGLProcessor.
+ * The operations still run in the processor. Their first call waits for
+ * the build if it has not finished yet, which otherwise does not stall the
+ * rendering thread
+ */
+std::unique_ptr<Factory> createFactory(Processor &processor, Processor &workerProcessor);
 }
 
+/**
+ * Linked GL programs are cached as program binaries, keyed by the shader
+ * sources and the GL driver, in memory for the lifetime of the process so
+ * that creating the same operation again (e.g., in another factory or GL
+ * context) does not compile anything. The in-memory cache is limited to
+ * 64 MB, dropping the oldest binaries first. If a directory is set, the binaries
+ * are also stored there and reused across runs. Binaries rejected by the
+ * driver are recompiled. An empty path (the default) disables disk caching
+ */
+void setProgramBinaryCacheDirectory(const std::string &path);
+/** Clear the in-memory program binary cache, but not the files on disk */
+void clearProgramBinaryCache();
+
+struct ProgramCacheStatistics {
+    int compiled = 0;
+    int memoryHits = 0;
+    int diskHits = 0;
+    int rejected = 0;
+};
+
+ProgramCacheStatistics getProgramCacheStatistics();
+
+/**
+ * When the GL state cache is enabled, the GL bindings set by this library
+ * (programs, vertex arrays, frame buffers, viewports, textures and
+ * samplers) are tracked and GL calls that would not change them are
+ * skipped. Bindings are also no longer reset after each operation.
+ *
+ * The cache is enabled automatically in the contexts created by the GL
+ * processors of this library. When using Processor::createQueue in an
+ * existing GL thread, it is disabled by default. If enabled there, call
+ * invalidateStateCache() whenever other code may have changed the bindings.
+ * These functions must be called in the GL thread
+ */
+void setStateCacheEnabled(bool enabled);
+void invalidateStateCache();
+
+struct StateCacheStatistics {
+    long issued = 0;
+    long skipped = 0;
+};
+
+/** GL calls issued and skipped by the state cache in the current thread */
+StateCacheStatistics getStateCacheStatistics();
+
+/**
+ * Wrap a GL processor so that the Futures returned by enqueue resolve only
+ * after the GPU has finished executing the GL commands issued by the task,
+ * not when they have been submitted. Implemented with fences that the GL
+ * processor polls between its other tasks, i.e., without glFinish.
+ *
+ * Pass the result to operations::createFactory to get GPU completion
+ * semantics for operations, e.g., before handing a texture to another
+ * context or API. Image factories should use the wrapped processor directly.
+ */
+std::unique_ptr<Processor> createGpuCompletionProcessor(Processor &glProcessor);
+
 enum class GLFWProcessorMode {
     /** Prefer ASYNC but fall back to SYNC if that's not available (on Mac) */
     AUTO,
@@ -97,5 +233,26 @@ std::unique_ptr<Processor> createGLFWWindow(int w, int h,
     GLFWProcessorMode mode = GLFWProcessorMode::AUTO,
     void **glfwWindowOutput = nullptr);
 
+/**
+ * Create a processor with a GL (or GLES 3, if compiled with OpenGL ES)
+ * context but no window, using EGL. Uses the Mesa surfaceless platform
+ * if available so that no display server is needed (e.g., in containers
+ * and CI with Mesa llvmpipe), and a surfaceless context or a dummy pbuffer
+ * otherwise. There is no default frame buffer, so wrapScreen cannot be
+ * used. The commands are executed in a worker thread. Only available if
+ * compiled with WITH_EGL
+ */
+std::unique_ptr<Processor> createEGLProcessor();
+
+/**
+ * Create another EGL processor, with its own thread, whose context shares
+ * GL objects (textures, buffers, programs) with the context of the given
+ * processor, which must have been created with createEGLProcessor. Use as
+ * the worker processor of operations::createFactory and
+ * Image::createFactory to compile shaders and upload textures without
+ * blocking the rendering thread. Must be destroyed before eglProcessor
+ */
+std::unique_ptr<Processor> createSharedEGLProcessor(Processor &eglProcessor);
+
 }
 }
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "adapters.hpp"
+#include "operations.hpp"
+#include "../log.hpp"
+
+namespace accelerated {
+namespace opengl {
+namespace {
+struct ProgramBinary {
+    GLenum format;
+    std::vector<std::uint8_t> data;
+};
+
+// total size of the in-memory binaries. The oldest ones are dropped first
+constexpr std::size_t MAX_MEMORY_BYTES = 64 << 20;
+
+// process-wide: GL program objects cannot be shared between (unrelated)
+// contexts, but their binaries can
+struct ProgramBinaryCache {
+    std::mutex mutex;
+    std::string directory;
+    std::map< std::string, std::shared_ptr<const ProgramBinary> > binaries;
+    std::deque<std::string> insertionOrder;
+    std::size_t totalBytes = 0;
+    ProgramCacheStatistics statistics;
+
+    // call with the mutex locked
+    void insert(const std::string &key, const std::shared_ptr<const ProgramBinary> &binary) {
+        erase(key);
+        binaries[key] = binary;
+        insertionOrder.push_back(key);
+        totalBytes += binary->data.size();
+        while (totalBytes > MAX_MEMORY_BYTES && insertionOrder.size() > 1) {
+            erase(insertionOrder.front());
+        }
+    }
+
+    void erase(const std::string &key) {
+        auto itr = binaries.find(key);
+        if (itr == binaries.end()) return;
+        totalBytes -= itr->second->data.size();
+        binaries.erase(itr);
+        insertionOrder.erase(std::find(insertionOrder.begin(), insertionOrder.end(), key));
+    }
+
+    void clear() {
+        binaries.clear();
+        insertionOrder.clear();
+        totalBytes = 0;
+    }
+
+    static ProgramBinaryCache &instance() {
+        static ProgramBinaryCache cache;
+        return cache;
+    }
+};
+
+std::string glString(GLenum name) {
+    const GLubyte *s = glGetString(name);
+    return s == nullptr ? "" : reinterpret_cast<const char*>(s);
+}
+
+// binaries are only valid for the exact same driver
+std::string programKey(const char *vs, const char *fs) {
+    std::string key = glString(GL_VENDOR);
+    for (const auto &part : { glString(GL_RENDERER), glString(GL_VERSION), std::string(vs), std::string(fs) }) {
+        key.push_back('\0');
+        key += part;
+    }
+    return key;
+}
+
+std::string binaryFileName(const std::string &directory, const std::string &key) {
+    std::ostringstream oss;
+    oss << directory << "/accelerated-arrays-program-" << std::hex << std::hash<std::string>{}(key) << ".bin";
+    return oss.str();
+}
+
+// File format: key length (uint64), key, binary format (uint32), binary.
+// The full key is stored to detect hash collisions
+std::shared_ptr<const ProgramBinary> readBinaryFile(const std::string &fileName, const std::string &key) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file) return {};
+
+    std::uint64_t keyLength = 0;
+    file.read(reinterpret_cast<char*>(&keyLength), sizeof(keyLength));
+    if (!file || keyLength != key.size()) return {};
+    std::string fileKey(key.size(), '\0');
+    file.read(&fileKey[0], keyLength);
+    if (!file || fileKey != key) return {};
+
+    std::uint32_t format = 0;
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    std::shared_ptr<ProgramBinary> binary(new ProgramBinary { GLenum(format), {} });
+    binary->data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (binary->data.empty()) return {};
+    return binary;
+}
+
+void writeBinaryFile(const std::string &fileName, const std::string &key, const ProgramBinary &binary) {
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        log_warn("could not write program binary cache file %s", fileName.c_str());
+        return;
+    }
+    const std::uint64_t keyLength = key.size();
+    const std::uint32_t format = binary.format;
+    file.write(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+    file.write(key.data(), key.size());
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(reinterpret_cast<const char*>(binary.data.data()), binary.data.size());
+}
+
+bool supportsProgramBinaries() {
+    GLint nFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+    return nFormats > 0;
+}
+
+std::shared_ptr<const ProgramBinary> findBinary(const std::string &key) {
+    auto &cache = ProgramBinaryCache::instance();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto itr = cache.binaries.find(key);
+    if (itr != cache.binaries.end()) {
+        cache.statistics.memoryHits++;
+        return itr->second;
+    }
+    if (cache.directory.empty()) return {};
+
+    auto binary = readBinaryFile(binaryFileName(cache.directory, key), key);
+    if (binary) {
+        cache.statistics.diskHits++;
+        cache.insert(key, binary);
+    }
+    return binary;
+}
+
+void storeBinary(const std::string &key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::shared_ptr<ProgramBinary> binary(new ProgramBinary);
+    binary->data.resize(length);
+    glGetProgramBinary(program, length, nullptr, &binary->format, binary->data.data());
+    checkError(__FUNCTION__);
+
+    auto &cache = ProgramBinaryCache::instance();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.insert(key, binary);
+    if (!cache.directory.empty()) {
+        writeBinaryFile(binaryFileName(cache.directory, key), key, *binary);
+    }
+}
+
+GLuint loadBinary(const ProgramBinary &binary) {
+    const GLuint program = glCreateProgram();
+    aa_assert(program);
+    checkError(__FUNCTION__);
+    glProgramBinary(program, binary.format, binary.data.data(), GLsizei(binary.data.size()));
+    // an unsupported format is an error (GL_INVALID_ENUM) but not fatal here
+    const GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        log_warn("glProgramBinary produced glError (0x%x)", error);
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    if (linkStatus != GL_TRUE) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+}
+
+int getCachedProgram(const char *vs, const char *fs, const std::function<int(bool retrievable)> &build) {
+    if (!supportsProgramBinaries()) {
+        auto &cache = ProgramBinaryCache::instance();
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            cache.statistics.compiled++;
+        }
+        return build(false);
+    }
+
+    const std::string key = programKey(vs, fs);
+    auto binary = findBinary(key);
+    if (binary) {
+        const GLuint program = loadBinary(*binary);
+        if (program != 0) {
+            LOG_TRACE("loaded GL program %d from a cached binary", program);
+            return program;
+        }
+        log_warn("GL driver rejected a cached program binary, recompiling");
+        auto &cache = ProgramBinaryCache::instance();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.statistics.rejected++;
+        cache.erase(key);
+    }
+
+    const GLuint program = build(true);
+    {
+        auto &cache = ProgramBinaryCache::instance();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.statistics.compiled++;
+    }
+    storeBinary(key, program);
+    return program;
+}
+
+void setProgramBinaryCacheDirectory(const std::string &path) {
+    auto &cache = ProgramBinaryCache::instance();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.directory = path;
+}
+
+void clearProgramBinaryCache() {
+    auto &cache = ProgramBinaryCache::instance();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.clear();
+}
+
+ProgramCacheStatistics getProgramCacheStatistics() {
+    auto &cache = ProgramBinaryCache::instance();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.statistics;
+}
+}
+}
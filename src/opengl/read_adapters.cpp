@@ -1,7 +1,8 @@
 #include <cstring>
+#include <sstream>
 
 #include "read_adapters.hpp"
-#include "glsl_helpers.hpp"
+#include "adapters.hpp"
 #include "operations.hpp"
 #include "../log.hpp"
 
@@ -16,68 +17,100 @@ struct Adapter {
     std::unique_ptr<::accelerated::Image> buffer;
     ::accelerated::operations::Function function;
 
-    bool setRepackFunction(const Image &image) {
+    bool setCopyFunction(const Image &image) {
         if (buffer->size() == image.size()) return false;
         cpuBuffer.resize(buffer->size());
-        const int origRowWidth = image.width * image.bytesPerPixel();
-        const int bufRowWidth = buffer->width * buffer->bytesPerPixel();
-        aa_assert(origRowWidth < bufRowWidth);
-        log_debug("repacking to rows of %d bytes from rows of length %d", origRowWidth, bufRowWidth);
-
-        cpuFunction = [this, origRowWidth, bufRowWidth](std::uint8_t *out) {
-            const int nRows = buffer->height;
-
-            //for (const auto &el : cpuBuffer) LOG_TRACE("cpu-buffer-unpacked: %d", int(el));
-
-            int inOffset = 0, outOffset = 0;
-            for (int i = 0; i < nRows; ++i) {
-                std::memcpy(out + outOffset, cpuBuffer.data() + inOffset, origRowWidth);
-                outOffset += origRowWidth;
-                inOffset += bufRowWidth;
-            }
-            //for (const auto &el : cpuBuffer) LOG_TRACE("cpu-buffer-packed: %d", int(el));
-            aa_assert(inOffset == int(buffer->size()));
+        const std::size_t layers = image.getLayerCount();
+        const std::size_t size = image.size() / layers;
+        const std::size_t paddedSize = buffer->size() / layers;
+        aa_assert(size < paddedSize);
+        log_debug("reading %zu bytes from a padded buffer of %zu bytes", image.size(), buffer->size());
+
+        cpuFunction = [this, size, paddedSize, layers](std::uint8_t *out) {
+            // the padding is at the end of each layer
+            for (std::size_t i = 0; i < layers; ++i)
+                std::memcpy(out + i * size, cpuBuffer.data() + i * paddedSize, size);
         };
         return true;
     }
 };
 
-operations::Shader<Unary>::Builder createFunction(const Image &img, int targetChannels, int &targetWidth) {
-    int origChannelsPerRow = img.channels * img.width;
-
-    // only support these atm
-    aa_assert(targetChannels > img.channels);
-    aa_assert(targetChannels % img.channels == 0); // TODO
-
-    targetWidth = origChannelsPerRow / targetChannels;
-    if (origChannelsPerRow % targetChannels != 0) {
-        targetWidth++;
+/**
+ * GLSL expression for the raw bits of the channel value "x" as it would be
+ * returned by glReadPixels with getCpuType, in the lowest bytes of an uint
+ */
+std::string channelBitsExpression(ImageTypeSpec::DataType dataType) {
+    typedef ImageTypeSpec::DataType DataType;
+    switch (dataType) {
+        case DataType::UINT8:
+        case DataType::UINT16:
+        case DataType::UINT32:
+        case DataType::SINT8:
+        case DataType::SINT16:
+        case DataType::SINT32:
+            // two's complement for signed values, truncated later
+            return "uint(x)";
+        case DataType::FLOAT32: return "floatBitsToUint(x)";
+        case DataType::FLOAT16: return "packHalf2x16(vec2(x, 0.0))";
+        case DataType::UFIXED8: return "uint(round(clamp(x, 0.0, 1.0) * 255.0))";
+        case DataType::UFIXED16: return "uint(round(clamp(x, 0.0, 1.0) * 65535.0))";
+        case DataType::SFIXED8: return "uint(int(round(clamp(x, -1.0, 1.0) * 127.0)))";
+        case DataType::SFIXED16: return "uint(int(round(clamp(x, -1.0, 1.0) * 32767.0)))";
+        // stored as 32-bit floats, which cannot represent the maximum values
+        case DataType::UFIXED32: return "x >= 1.0 ? 0xffffffffu : uint(max(x, 0.0) * 4294967296.0)";
+        case DataType::SFIXED32: return "x >= 1.0 ? 0x7fffffffu : uint(int(max(x, -1.0) * 2147483648.0))";
     }
+    aa_assert(false);
+    return "";
+}
+
+/**
+ * Packs the image bytes, in the tightly packed CPU layout, into the pixels
+ * of an RGBA8 texture with the given width, which can always be read with
+ * glReadPixels. The remaining bytes of the last row are zero
+ */
+operations::Shader<Unary>::Builder createFunction(const Image &img, int targetWidth) {
+    const int bytesPerChannel = img.bytesPerChannel();
+    aa_assert(bytesPerChannel == 1 || bytesPerChannel == 2 || bytesPerChannel == 4);
+    const int channelsPerTexel = 4 / bytesPerChannel;
 
     std::string fragmentShaderBody;
     {
         std::ostringstream oss;
-        const auto swiz = glsl::swizzleSubset(img.channels);
+        // 32-bit channels do not fit the default mediump
+        oss << "precision highp int;\n";
+        oss << "#define CHANNELS " << img.channels << "\n";
+        oss << "uint channelBits(int index, ivec2 size) {\n";
+        oss << "    int pixel = index / CHANNELS;\n";
+        oss << "    if (pixel >= size.x * size.y) return 0u;\n";
+        oss << "    " << getGlslScalarType(img) << " x = texelFetch(u_texture, ivec2(pixel % size.x, pixel / size.x), 0)[index % CHANNELS];\n";
+        oss << "    return " << channelBitsExpression(img.dataType) << ";\n";
+        oss << "}\n";
         oss << "void main() {\n";
+        oss << "ivec2 size = textureSize(u_texture, 0);\n";
         oss << "ivec2 outCoord = ivec2(v_texCoord * vec2(u_outSize));\n";
-        int ratio = targetChannels / img.channels;
-        oss << "int x0 = outCoord.x * " << ratio << ";\n";
-        // target should be UFIXED8
-        oss << "outValue = " << glsl::floatVecType(targetChannels) << "(";
-        for (int i = 0; i < ratio; ++i) {
-            if (i > 0) oss << ",\n";
-            oss << "texelFetch(u_texture, " << "ivec2(x0 + " << i << ", outCoord.y)" << ", 0)." << swiz;
+        oss << "int index = (outCoord.y * " << targetWidth << " + outCoord.x) * " << channelsPerTexel << ";\n";
+        oss << "uvec4 bytes;\n";
+        for (int i = 0; i < channelsPerTexel; ++i) {
+            oss << "uint bits" << i << " = channelBits(index + " << i << ", size);\n";
+            // little endian
+            for (int b = 0; b < bytesPerChannel; ++b) {
+                oss << "bytes[" << (i * bytesPerChannel + b) << "] = (bits" << i << " >> " << (8 * b) << ") & 255u;\n";
+            }
         }
-        oss << ");\n";
+        // exact in the UNORM8 conversion
+        oss << "outValue = vec4(bytes) / 255.0;\n";
         oss << "}\n";
         fragmentShaderBody = oss.str();
     }
 
     ImageTypeSpec spec = img;
     ImageTypeSpec outSpec {
-        targetChannels,
-        img.dataType,
-        ImageTypeSpec::StorageType::GPU_OPENGL
+        4,
+        ImageTypeSpec::DataType::UFIXED8,
+        img.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY
+            ? ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY
+            : ImageTypeSpec::StorageType::GPU_OPENGL
     };
 
     return [fragmentShaderBody, spec, outSpec]() {
@@ -87,7 +120,7 @@ operations::Shader<Unary>::Builder createFunction(const Image &img, int targetCh
 
         shader->function = [&pipeline](Image &input, Image &output) {
             Binder binder(pipeline);
-            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId()));
+            Binder inputBinder(pipeline.bindTexture(0, input.getTextureId(), input.getTextureRegion()));
             pipeline.call(output.getFrameBuffer());
         };
 
@@ -104,46 +137,51 @@ std::function<Future(std::uint8_t*)> createReadAdpater(
 {
     std::shared_ptr<Adapter> adapter(new Adapter);
 
-    ImageTypeSpec::DataType targetDataType = image.dataType;
-    int targetChannels = image.channels;
-
-    #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
-        aa_assert(image.bytesPerChannel() != 2);
-        #ifdef ACCELERATED_ARRAYS_MAX_COMPATIBILITY_READS
-            aa_assert(image.bytesPerChannel() == 1);
-            targetChannels = 4;
-        #endif
-        #ifndef ACCELERATED_ARRAYS_DODGY_READS
-        aa_assert(!ImageTypeSpec::isSigned(image.dataType));
-        #endif
-    #else
-        if (image.channels == 2) targetChannels = 4;
-    #endif
-    aa_assert(targetDataType == image.dataType); // TODO
-
-    int targetWidth;
-    adapter->function = opFactory.wrap<Unary>(createFunction(image, targetChannels, targetWidth));
+    // RGBA8 texels of the same width as the image: the row count does not
+    // matter since the packed layout is contiguous. Texture arrays are
+    // packed to an array with the same number of layers, one layer at a time
+    const int layers = image.getLayerCount();
+    const std::size_t nTexels = (image.size() / layers + 3) / 4;
+    const int targetWidth = image.width;
+    const int targetHeight = int((nTexels + targetWidth - 1) / targetWidth);
+
+    adapter->function = opFactory.wrap<Unary>(createFunction(image, targetWidth));
     aa_assert(adapter->function);
 
-    adapter->buffer = imageFactory.create(
-        targetWidth,
-        image.height,
-        targetChannels,
-        targetDataType);
+    if (image.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY) {
+        adapter->buffer = imageFactory.createArray(
+            targetWidth,
+            targetHeight,
+            layers,
+            4,
+            ImageTypeSpec::DataType::UFIXED8);
+    } else {
+        adapter->buffer = imageFactory.create(
+            targetWidth,
+            targetHeight,
+            4,
+            ImageTypeSpec::DataType::UFIXED8);
+    }
 
-    if (adapter->setRepackFunction(image)) {
-        log_warn("image read dimensions not optimal, need CPU repacking");
+    if (adapter->setCopyFunction(image)) {
+        LOG_TRACE("image size not divisible to RGBA8 rows, reading with a CPU copy");
     }
 
     return [adapter, &image, &processor](std::uint8_t *outData) -> Future {
         // aa_assert(adapter->buffer->supportsDirectRead());
         ::accelerated::operations::callUnary(adapter->function, image, *adapter->buffer);
-        // no need to wait if single-threaded
         if (adapter->cpuFunction) {
-            adapter->buffer->readRaw(adapter->cpuBuffer.data());
-            return processor.enqueue([adapter, outData]() {
+            // read to the CPU buffer and copy when the read has finished
+            std::shared_ptr< std::function<bool(bool)> > poll(new std::function<bool(bool)>);
+            return pollInGlThread(processor, [adapter, outData, poll](bool block) -> bool {
+                if (!*poll) {
+                    auto &fb = Image::castFrom(*adapter->buffer).getFrameBuffer();
+                    *poll = fb.readPixelsAsync(adapter->cpuBuffer.data());
+                }
+                if (!(*poll)(block)) return false;
                 LOG_TRACE("CPU copy");
                 adapter->cpuFunction(outData);
+                return true;
             });
         } else {
             return adapter->buffer->readRaw(outData);
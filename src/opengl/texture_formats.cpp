@@ -47,6 +47,7 @@ int getTextureInternalFormat(const ImageTypeSpec &spec) {
             case ImageTypeSpec::DataType::UINT32: X(GL_R32UI);
             case ImageTypeSpec::DataType::SINT32: X(GL_R32I);
             case ImageTypeSpec::DataType::FLOAT32: X(GL_R32F);
+            case ImageTypeSpec::DataType::FLOAT16: X(GL_R16F);
             case ImageTypeSpec::DataType::UFIXED8: X(GL_R8);
             case ImageTypeSpec::DataType::SFIXED8: X(GL_R8_SNORM);
         #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
@@ -70,6 +71,7 @@ int getTextureInternalFormat(const ImageTypeSpec &spec) {
             case ImageTypeSpec::DataType::UINT32: X(GL_RG32UI);
             case ImageTypeSpec::DataType::SINT32: X(GL_RG32I);
             case ImageTypeSpec::DataType::FLOAT32: X(GL_RG32F);
+            case ImageTypeSpec::DataType::FLOAT16: X(GL_RG16F);
             case ImageTypeSpec::DataType::UFIXED8: X(GL_RG8);
             case ImageTypeSpec::DataType::SFIXED8: X(GL_RG8_SNORM);
         #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
@@ -93,6 +95,7 @@ int getTextureInternalFormat(const ImageTypeSpec &spec) {
             case ImageTypeSpec::DataType::UINT32: X(GL_RGB32UI);
             case ImageTypeSpec::DataType::SINT32: X(GL_RGB32I);
             case ImageTypeSpec::DataType::FLOAT32: X(GL_RGB32F);
+            case ImageTypeSpec::DataType::FLOAT16: X(GL_RGB16F);
             case ImageTypeSpec::DataType::UFIXED8: X(GL_RGB8);
             case ImageTypeSpec::DataType::SFIXED8: X(GL_RGB8_SNORM);
         #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
@@ -116,6 +119,7 @@ int getTextureInternalFormat(const ImageTypeSpec &spec) {
             case ImageTypeSpec::DataType::UINT32: X(GL_RGBA32UI);
             case ImageTypeSpec::DataType::SINT32: X(GL_RGBA32I);
             case ImageTypeSpec::DataType::FLOAT32: X(GL_RGBA32F);
+            case ImageTypeSpec::DataType::FLOAT16: X(GL_RGBA16F);
             case ImageTypeSpec::DataType::UFIXED8: X(GL_RGBA8);
             case ImageTypeSpec::DataType::SFIXED8: X(GL_RGBA8_SNORM);
         #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
@@ -174,6 +178,7 @@ std::string getGlslPrecision(const ImageTypeSpec &spec) {
         case ImageTypeSpec::DataType::UINT32: X("highp");
         case ImageTypeSpec::DataType::SINT32: X("highp");
         case ImageTypeSpec::DataType::FLOAT32: X("highp");
+        case ImageTypeSpec::DataType::FLOAT16: X("mediump");
         case ImageTypeSpec::DataType::UFIXED8: X("lowp");
         case ImageTypeSpec::DataType::SFIXED8: X("lowp");
         case ImageTypeSpec::DataType::UFIXED16: X("highp");
@@ -193,12 +198,13 @@ std::string getGlslSamplerType(const ImageTypeSpec &spec) {
         return "samplerExternalOES";
     }
 
+    const std::string suffix = spec.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY ? "Array" : "";
     if (ImageTypeSpec::isIntegerType(spec.dataType)) {
-        if (ImageTypeSpec::isSigned(spec.dataType)) return "isampler2D";
-        return "usampler2D";
+        if (ImageTypeSpec::isSigned(spec.dataType)) return "isampler2D" + suffix;
+        return "usampler2D" + suffix;
     }
 
-    return "sampler2D";
+    return "sampler2D" + suffix;
 }
 
 std::string getGlslScalarType(const ImageTypeSpec &spec) {
@@ -221,6 +227,65 @@ std::string getGlslVecType(const ImageTypeSpec &spec) {
     return oss.str();
 }
 
+std::string getGlslImageFormat(const ImageTypeSpec &spec) {
+    if (spec.storageType != ImageTypeSpec::StorageType::GPU_OPENGL) return "";
+    if (spec.channels == 1) {
+        switch (spec.dataType) {
+            case ImageTypeSpec::DataType::UINT32: return "r32ui";
+            case ImageTypeSpec::DataType::SINT32: return "r32i";
+            case ImageTypeSpec::DataType::FLOAT32: return "r32f";
+            default: break;
+        }
+    }
+    else if (spec.channels == 4) {
+        switch (spec.dataType) {
+            case ImageTypeSpec::DataType::UINT8: return "rgba8ui";
+            case ImageTypeSpec::DataType::SINT8: return "rgba8i";
+            case ImageTypeSpec::DataType::UINT16: return "rgba16ui";
+            case ImageTypeSpec::DataType::SINT16: return "rgba16i";
+            case ImageTypeSpec::DataType::UINT32: return "rgba32ui";
+            case ImageTypeSpec::DataType::SINT32: return "rgba32i";
+            case ImageTypeSpec::DataType::FLOAT32: return "rgba32f";
+            case ImageTypeSpec::DataType::FLOAT16: return "rgba16f";
+            case ImageTypeSpec::DataType::UFIXED8: return "rgba8";
+            case ImageTypeSpec::DataType::SFIXED8: return "rgba8_snorm";
+            default: break;
+        }
+    }
+    return "";
+}
+
+std::string getGlslImageType(const ImageTypeSpec &spec) {
+    if (ImageTypeSpec::isIntegerType(spec.dataType)) {
+        if (ImageTypeSpec::isSigned(spec.dataType)) return "iimage2D";
+        return "uimage2D";
+    }
+    return "image2D";
+}
+
+bool isLinearFilterable(const ImageTypeSpec &spec) {
+    if (spec.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_EXTERNAL) return false;
+    switch (spec.dataType) {
+        case ImageTypeSpec::DataType::UFIXED8:
+        case ImageTypeSpec::DataType::SFIXED8:
+        case ImageTypeSpec::DataType::UFIXED16:
+        case ImageTypeSpec::DataType::SFIXED16:
+        case ImageTypeSpec::DataType::FLOAT16:
+            return true;
+        // stored as 32-bit floats, which require OES_texture_float_linear
+        case ImageTypeSpec::DataType::FLOAT32:
+        case ImageTypeSpec::DataType::UFIXED32:
+        case ImageTypeSpec::DataType::SFIXED32:
+        #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
+            return false;
+        #else
+            return true;
+        #endif
+        default:
+            return false;
+    }
+}
+
 int getReadPixelFormat(const ImageTypeSpec &spec) {
     #define X(x) LOG_TRACE("getReadPixelFormat:%s", #x); return x
     if (ImageTypeSpec::isIntegerType(spec.dataType)) {
@@ -266,6 +331,7 @@ int getCpuType(const ImageTypeSpec &spec) {
         case ImageTypeSpec::DataType::UINT32: X(GL_UNSIGNED_INT);
         case ImageTypeSpec::DataType::SINT32: X(GL_INT);
         case ImageTypeSpec::DataType::FLOAT32: X(GL_FLOAT);
+        case ImageTypeSpec::DataType::FLOAT16: X(GL_HALF_FLOAT);
         // check these...
         case ImageTypeSpec::DataType::UFIXED8: X(GL_UNSIGNED_BYTE);
         case ImageTypeSpec::DataType::SFIXED8: X(GL_BYTE);
@@ -283,6 +349,8 @@ int getBindType(const ImageTypeSpec &spec) {
     if (spec.storageType == ImageTypeSpec::StorageType::GPU_OPENGL) {
         LOG_TRACE("getBindType:GL_TEXTURE_2D");
         return GL_TEXTURE_2D;
+    } else if (spec.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY) {
+        return GL_TEXTURE_2D_ARRAY;
     } else if (spec.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_EXTERNAL) {
     #ifdef ACCELERATED_ARRAYS_USE_OPENGL_ES
         LOG_TRACE("getBindType:GL_TEXTURE_EXTERNAL_OES");
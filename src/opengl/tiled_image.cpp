@@ -0,0 +1,541 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "adapters.hpp"
+#include "gl_state.hpp"
+#include "operations.hpp"
+#include "tiled_image.hpp"
+#include "../log.hpp"
+
+namespace accelerated {
+namespace opengl {
+namespace {
+typedef TiledImage::Rect Rect;
+
+/** The tiling of an image along one axis */
+struct Axis {
+    int coreBegin, coreEnd;
+    int texBegin, texEnd;
+};
+
+std::vector<Axis> layoutAxis(int size, int halo, int maxTileSize) {
+    int n = 1;
+    if (size > maxTileSize) {
+        const int maxCore = maxTileSize - 2 * halo;
+        n = (size + maxCore - 1) / maxCore;
+    }
+    // balanced core sizes
+    std::vector<Axis> tiles;
+    for (int i = 0; i < n; ++i) {
+        Axis a;
+        a.coreBegin = int(long(size) * i / n);
+        a.coreEnd = int(long(size) * (i + 1) / n);
+        a.texBegin = std::max(a.coreBegin - halo, 0);
+        a.texEnd = std::min(a.coreEnd + halo, size);
+        aa_assert(a.texEnd - a.texBegin <= maxTileSize);
+        tiles.push_back(a);
+    }
+    return tiles;
+}
+
+Rect intersect(const Rect &a, const Rect &b) {
+    const int x0 = std::max(a.x0, b.x0), y0 = std::max(a.y0, b.y0);
+    const int x1 = std::min(a.x0 + a.width, b.x0 + b.width);
+    const int y1 = std::min(a.y0 + a.height, b.y0 + b.height);
+    return Rect { x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0) };
+}
+
+class TiledImageImplementation final : public TiledImage {
+private:
+    Processor &processor;
+    const int halo;
+    // tile-local regions rendered by the operations, created on first use
+    std::map< std::array<int, 5>, std::unique_ptr<::accelerated::Image> > regions;
+
+public:
+    const std::vector<Axis> xTiles, yTiles;
+    std::vector< std::unique_ptr<opengl::Image> > tiles;
+
+    TiledImageImplementation(int w, int h, const ImageTypeSpec &spec, Processor &processor, ::accelerated::Image::Factory &tileFactory, int halo, int maxTileSize) :
+        TiledImage(w, h, spec),
+        processor(processor),
+        halo(halo),
+        xTiles(layoutAxis(w, halo, maxTileSize)),
+        yTiles(layoutAxis(h, halo, maxTileSize))
+    {
+        for (const auto &y : yTiles) {
+            for (const auto &x : xTiles) {
+                auto tile = tileFactory.create(x.texEnd - x.texBegin, y.texEnd - y.texBegin, channels, dataType);
+                tiles.push_back(std::unique_ptr<opengl::Image>(&opengl::Image::castFrom(*tile.release())));
+            }
+        }
+        LOG_TRACE("created a %dx%d tiled image with %zu tiles", w, h, tiles.size());
+    }
+
+    static TiledImageImplementation &castFrom(::accelerated::Image &image) {
+        return static_cast<TiledImageImplementation&>(TiledImage::castFrom(image));
+    }
+
+    int getHalo() const final {
+        return halo;
+    }
+
+    int getTileCount() const final {
+        return int(tiles.size());
+    }
+
+    Rect getTileRect(int index) const final {
+        const Axis &x = xTiles.at(index % xTiles.size());
+        const Axis &y = yTiles.at(index / xTiles.size());
+        return Rect { x.texBegin, y.texBegin, x.texEnd - x.texBegin, y.texEnd - y.texBegin };
+    }
+
+    Rect getTileCore(int index) const final {
+        const Axis &x = xTiles.at(index % xTiles.size());
+        const Axis &y = yTiles.at(index / xTiles.size());
+        return Rect { x.coreBegin, y.coreBegin, x.coreEnd - x.coreBegin, y.coreEnd - y.coreBegin };
+    }
+
+    opengl::Image &getTile(int index) final {
+        return *tiles.at(index);
+    }
+
+    int tileIndex(int xTile, int yTile) const {
+        return yTile * int(xTiles.size()) + xTile;
+    }
+
+    /** A region of a tile, in the tile-local coordinates */
+    ::accelerated::Image &getRegion(int index, const Rect &r) {
+        opengl::Image &tile = getTile(index);
+        if (r.x0 == 0 && r.y0 == 0 && r.width == tile.width && r.height == tile.height) return tile;
+        auto &roi = regions[{ index, r.x0, r.y0, r.width, r.height }];
+        if (!roi) roi = tile.createROI(r.x0, r.y0, r.width, r.height);
+        return *roi;
+    }
+
+    bool hasSameTiling(const TiledImageImplementation &other) const {
+        if (width != other.width || height != other.height || tiles.size() != other.tiles.size()) return false;
+        for (int i = 0; i < getTileCount(); ++i) {
+            const Rect a = getTileRect(i), b = other.getTileRect(i);
+            if (a.x0 != b.x0 || a.y0 != b.y0 || a.width != b.width || a.height != b.height) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Copy the cores of the tiles to the halos of their neighbors. Must be
+     * called in the GL thread
+     */
+    void syncHalos() {
+        for (int i = 0; i < getTileCount(); ++i) {
+            const Rect dst = getTileRect(i);
+            const GLuint dstFbo = GLuint(tiles[i]->getFrameBuffer().getId());
+            for (int j = 0; j < getTileCount(); ++j) {
+                if (j == i) continue;
+                const Rect r = intersect(dst, getTileCore(j));
+                if (r.width == 0 || r.height == 0) continue;
+                const Rect src = getTileRect(j);
+                glState::bindFramebuffer(dstFbo);
+                glState::bindReadFramebuffer(GLuint(tiles[j]->getFrameBuffer().getId()));
+                glBlitFramebuffer(
+                    r.x0 - src.x0, r.y0 - src.y0, r.x0 - src.x0 + r.width, r.y0 - src.y0 + r.height,
+                    r.x0 - dst.x0, r.y0 - dst.y0, r.x0 - dst.x0 + r.width, r.y0 - dst.y0 + r.height,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            }
+        }
+        if (!glState::keepBindings()) glState::bindFramebuffer(0);
+        checkError(__FUNCTION__);
+    }
+
+    Future readRaw(std::uint8_t *outputData) final {
+        // each tile is read like a normal image, through a read adapter if
+        // its data type cannot be read directly
+        std::shared_ptr< std::vector< std::vector<std::uint8_t> > > buffers(
+            new std::vector< std::vector<std::uint8_t> >(getTileCount()));
+        std::vector<Future> reads;
+        std::vector<Rect> rects, cores;
+        for (int i = 0; i < getTileCount(); ++i) {
+            (*buffers)[i].resize(tiles[i]->size());
+            reads.push_back(tiles[i]->readRaw((*buffers)[i].data()));
+            rects.push_back(getTileRect(i));
+            cores.push_back(getTileCore(i));
+        }
+        const std::size_t pixelSize = bytesPerPixel();
+        const int w = width;
+
+        return pollInGlThread(processor, [buffers, reads, rects, cores, pixelSize, w, outputData](bool block) -> bool {
+            for (Future read : reads) {
+                if (block) read.wait();
+                else if (!read.isReady()) return false;
+            }
+            for (std::size_t i = 0; i < buffers->size(); ++i) {
+                const Rect &r = rects[i], &c = cores[i];
+                for (int y = c.y0; y < c.y0 + c.height; ++y) {
+                    std::memcpy(
+                        outputData + (std::size_t(y) * w + c.x0) * pixelSize,
+                        (*buffers)[i].data() + (std::size_t(y - r.y0) * r.width + c.x0 - r.x0) * pixelSize,
+                        c.width * pixelSize);
+                }
+            }
+            return true;
+        });
+    }
+
+    Future writeRaw(const std::uint8_t *inputData) final {
+        const std::size_t pixelSize = bytesPerPixel();
+        std::shared_ptr< std::vector< std::vector<std::uint8_t> > > staging(
+            new std::vector< std::vector<std::uint8_t> >(tiles.size()));
+        std::vector<opengl::Image*> tilePtrs;
+        for (int i = 0; i < getTileCount(); ++i) {
+            const Rect r = getTileRect(i);
+            auto &buf = staging->at(i);
+            buf.resize(tiles[i]->size());
+            for (int y = 0; y < r.height; ++y) {
+                std::memcpy(
+                    buf.data() + std::size_t(y) * r.width * pixelSize,
+                    inputData + (std::size_t(r.y0 + y) * width + r.x0) * pixelSize,
+                    r.width * pixelSize);
+            }
+            tilePtrs.push_back(tiles[i].get());
+        }
+
+        return processor.enqueue([staging, tilePtrs]() {
+            for (std::size_t i = 0; i < tilePtrs.size(); ++i) {
+                tilePtrs[i]->getFrameBuffer().writePixels(staging->at(i).data());
+            }
+        });
+    }
+
+    std::unique_ptr<::accelerated::Image> createROI(int x0, int y0, int roiWidth, int roiHeight) final {
+        (void)x0; (void)y0; (void)roiWidth; (void)roiHeight;
+        aa_assert(false && "not supported");
+        return {};
+    }
+};
+
+class TiledImageFactory final : public ::accelerated::Image::Factory {
+private:
+    Processor &processor;
+    std::unique_ptr<Image::Factory> tileFactory;
+    const int halo;
+    int maxTileSize;
+
+public:
+    TiledImageFactory(Processor &processor, int halo, int maxTileSize) :
+        processor(processor),
+        tileFactory(Image::createFactory(processor)),
+        halo(halo),
+        maxTileSize(maxTileSize)
+    {
+        if (this->maxTileSize <= 0) {
+            GLint maxSize = 0;
+            processor.enqueue([&maxSize]() {
+                glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+            }).wait();
+            this->maxTileSize = maxSize;
+            log_debug("GL_MAX_TEXTURE_SIZE = %d", maxSize);
+        }
+        aa_assert(halo >= 0 && 2 * halo < this->maxTileSize);
+    }
+
+    ImageTypeSpec getSpec(int channels, ImageTypeSpec::DataType dtype) final {
+        return TiledImage::getSpec(channels, dtype);
+    }
+
+    std::unique_ptr<::accelerated::Image> create(int w, int h, int channels, ImageTypeSpec::DataType dtype) final {
+        return std::unique_ptr<::accelerated::Image>(new TiledImageImplementation(w, h,
+            getSpec(channels, dtype), processor, *tileFactory, halo, maxTileSize));
+    }
+};
+}
+
+TiledImage::TiledImage(int w, int h, const ImageTypeSpec &spec) :
+    ::accelerated::Image(w, h, spec) {}
+
+ImageTypeSpec TiledImage::getSpec(int channels, DataType dtype) {
+    return ImageTypeSpec {
+        channels,
+        dtype,
+        StorageType::GPU_OPENGL_TILED
+    };
+}
+
+TiledImage &TiledImage::castFrom(::accelerated::Image &image) {
+    aa_assert(image.storageType == StorageType::GPU_OPENGL_TILED);
+    return static_cast<TiledImage&>(image);
+}
+
+std::unique_ptr<::accelerated::Image::Factory> TiledImage::createFactory(Processor &processor, int halo, int maxTileSize) {
+    return std::unique_ptr<::accelerated::Image::Factory>(new TiledImageFactory(processor, halo, maxTileSize));
+}
+
+namespace operations {
+namespace {
+typedef ::accelerated::operations::fill::Spec FillSpec;
+typedef ::accelerated::operations::rescale::Spec RescaleSpec;
+typedef ::accelerated::operations::swizzle::Spec SwizzleSpec;
+typedef ::accelerated::operations::fixedConvolution2D::Spec FixedConvolution2DSpec;
+typedef ::accelerated::operations::pixelwiseAffineCombination::Spec PixelwiseAffineCombinationSpec;
+typedef ::accelerated::operations::channelwiseAffine::Spec ChannelwiseAffineSpec;
+using ::accelerated::operations::Function;
+using ::accelerated::operations::ParameterizedFunction;
+
+void checkSpec(const ImageTypeSpec &spec) {
+    aa_assert(spec.storageType == ImageTypeSpec::StorageType::GPU_OPENGL_TILED);
+}
+
+ImageTypeSpec tileSpec(const ImageTypeSpec &spec) {
+    return Image::getSpec(spec.channels, spec.dataType);
+}
+
+/** Run the operation on each tile, including the halos */
+Function tilewise(const Function &f) {
+    return [f](::accelerated::Image **inputs, int nInputs, ::accelerated::Image &output) -> Future {
+        auto &out = TiledImageImplementation::castFrom(output);
+        std::vector<TiledImageImplementation*> ins;
+        for (int i = 0; i < nInputs; ++i) {
+            ins.push_back(&TiledImageImplementation::castFrom(*inputs[i]));
+            aa_assert(ins.back()->hasSameTiling(out) && "pixelwise operations require identical tiling");
+        }
+        Future result = Future::instantlyResolved();
+        std::vector<::accelerated::Image*> tileInputs(nInputs);
+        for (int t = 0; t < out.getTileCount(); ++t) {
+            for (int i = 0; i < nInputs; ++i) tileInputs[i] = &ins[i]->getTile(t);
+            result = f(tileInputs.data(), nInputs, out.getTile(t));
+        }
+        return result;
+    };
+}
+
+/** The range [first, second] of input pixels read for output pixel o along one axis */
+typedef std::function< std::pair<int, int>(int o) > InputRange;
+
+/** Output pixels [outBegin, outEnd) whose inputs are all in the same input tile */
+struct Segment {
+    int outBegin, outEnd;
+    int inTile;
+};
+
+std::vector<Segment> splitAxis(int begin, int end, const std::vector<Axis> &inTiles, int inSize, const InputRange &range) {
+    const auto fits = [&](int o, const Axis &a) {
+        const auto in = range(o);
+        // the border is handled by the tiles at the image boundaries
+        const int first = std::min(std::max(in.first, 0), inSize - 1);
+        const int last = std::max(std::min(in.second, inSize - 1), 0);
+        return first >= a.texBegin && last < a.texEnd;
+    };
+
+    std::vector<Segment> segments;
+    int cur = begin;
+    while (cur < end) {
+        Segment best { cur, cur, -1 };
+        for (int t = 0; t < int(inTiles.size()); ++t) {
+            if (!fits(cur, inTiles[t])) continue;
+            int e = cur + 1;
+            while (e < end && fits(e, inTiles[t])) ++e;
+            if (e > best.outEnd) best = Segment { cur, e, t };
+        }
+        aa_assert(best.inTile >= 0 && "the halo of the tiled image is too small for this operation");
+        segments.push_back(best);
+        cur = best.outEnd;
+    }
+    return segments;
+}
+
+/** A part of an output tile core rendered from a single input tile */
+struct Piece {
+    Rect out;
+    Rect inTexture;
+};
+
+typedef std::function< Future(const Piece &piece, ::accelerated::Image &input, ::accelerated::Image &output) > PieceRenderer;
+
+/**
+ * Render the cores of the output tiles piece by piece and then update the
+ * halos of the output
+ */
+Function neighborhoodOperation(Processor &processor, const InputRange &xRange, const InputRange &yRange, const PieceRenderer &render) {
+    return [&processor, xRange, yRange, render](::accelerated::Image **inputs, int nInputs, ::accelerated::Image &output) -> Future {
+        aa_assert(nInputs == 1); (void)nInputs;
+        auto &in = TiledImageImplementation::castFrom(*inputs[0]);
+        auto &out = TiledImageImplementation::castFrom(output);
+
+        Future result = Future::instantlyResolved();
+        for (int oy = 0; oy < int(out.yTiles.size()); ++oy) {
+            const Axis &ya = out.yTiles[oy];
+            const auto ySegments = splitAxis(ya.coreBegin, ya.coreEnd, in.yTiles, in.height, yRange);
+            for (int ox = 0; ox < int(out.xTiles.size()); ++ox) {
+                const Axis &xa = out.xTiles[ox];
+                const auto xSegments = splitAxis(xa.coreBegin, xa.coreEnd, in.xTiles, in.width, xRange);
+                for (const auto &ys : ySegments) {
+                    for (const auto &xs : xSegments) {
+                        const int inIndex = in.tileIndex(xs.inTile, ys.inTile);
+                        Piece piece {
+                            Rect { xs.outBegin, ys.outBegin, xs.outEnd - xs.outBegin, ys.outEnd - ys.outBegin },
+                            in.getTileRect(inIndex)
+                        };
+                        const Rect local {
+                            piece.out.x0 - xa.texBegin, piece.out.y0 - ya.texBegin,
+                            piece.out.width, piece.out.height
+                        };
+                        result = render(piece, in.getTile(inIndex), out.getRegion(out.tileIndex(ox, oy), local));
+                    }
+                }
+            }
+        }
+
+        if (out.getTileCount() > 1) {
+            TiledImageImplementation *outPtr = &out;
+            result = ::accelerated::operations::sync::enqueue(processor, [outPtr]() {
+                outPtr->syncHalos();
+            });
+        }
+        return result;
+    };
+}
+
+class TiledFactory final : public ::accelerated::operations::StandardFactory {
+private:
+    Processor &processor;
+    // shared with the Functions, which may outlive this
+    std::shared_ptr<Factory> gpuFactory;
+
+public:
+    TiledFactory(Processor &processor) :
+        processor(processor),
+        gpuFactory(createFactory(processor))
+    {
+        // compute shaders cannot render to the tile regions
+        gpuFactory->useComputeShaders(false);
+    }
+
+    Function create(const FillSpec &spec, const ImageTypeSpec &imageSpec) final {
+        checkSpec(imageSpec);
+        return tilewise(gpuFactory->create(spec, tileSpec(imageSpec)));
+    }
+
+    Function create(const SwizzleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return tilewise(gpuFactory->create(spec, tileSpec(inSpec), tileSpec(outSpec)));
+    }
+
+    Function create(const PixelwiseAffineCombinationSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return tilewise(gpuFactory->create(spec, tileSpec(inSpec), tileSpec(outSpec)));
+    }
+
+    Function create(const ChannelwiseAffineSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        return tilewise(gpuFactory->create(spec, tileSpec(inSpec), tileSpec(outSpec)));
+    }
+
+    Function create(const FixedConvolution2DSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        aa_assert(!spec.kernel.empty());
+
+        const int kernelW = spec.kernel.at(0).size(), kernelH = spec.kernel.size();
+        const int xStride = spec.xStride, yStride = spec.yStride;
+        const int xOffset = spec.getKernelXOffset(), yOffset = spec.getKernelYOffset();
+        const InputRange xRange = [xStride, xOffset, kernelW](int o) {
+            return std::make_pair(o * xStride + xOffset, o * xStride + xOffset + kernelW - 1);
+        };
+        const InputRange yRange = [yStride, yOffset, kernelH](int o) {
+            return std::make_pair(o * yStride + yOffset, o * yStride + yOffset + kernelH - 1);
+        };
+
+        // one shader per offset between the output pieces and input tiles,
+        // which are few with regular tilings
+        struct Cache {
+            std::mutex mutex;
+            std::map< std::pair<int, int>, Function > functions;
+        };
+        std::shared_ptr<Cache> cache(new Cache);
+        std::shared_ptr<Factory> factory = gpuFactory;
+        const ImageTypeSpec tileIn = tileSpec(inSpec), tileOut = tileSpec(outSpec);
+
+        const PieceRenderer render = [spec, cache, factory, tileIn, tileOut](const Piece &piece, ::accelerated::Image &input, ::accelerated::Image &output) -> Future {
+            const auto delta = std::make_pair(
+                piece.out.x0 * spec.xStride - piece.inTexture.x0,
+                piece.out.y0 * spec.yStride - piece.inTexture.y0);
+            Function f;
+            {
+                std::lock_guard<std::mutex> lock(cache->mutex);
+                auto &cached = cache->functions[delta];
+                if (!cached) {
+                    auto shifted = spec;
+                    shifted.setOffset(spec.xOffset + delta.first, spec.yOffset + delta.second);
+                    cached = factory->create(shifted, tileIn, tileOut);
+                }
+                f = cached;
+            }
+            return ::accelerated::operations::callUnary(f, input, output);
+        };
+
+        const auto op = neighborhoodOperation(processor, xRange, yRange, render);
+        const auto border = spec.border;
+        return [op, border](::accelerated::Image **inputs, int nInputs, ::accelerated::Image &output) -> Future {
+            aa_assert(nInputs == 1);
+            (void)border;
+            aa_assert(border != Image::Border::REPEAT || TiledImage::castFrom(*inputs[0]).getTileCount() == 1);
+            return op(inputs, nInputs, output);
+        };
+    }
+
+    Function create(const RescaleSpec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) final {
+        checkSpec(inSpec);
+        checkSpec(outSpec);
+        auto parameterized = gpuFactory->createParameterized(spec, tileSpec(inSpec), tileSpec(outSpec));
+        Processor &p = processor;
+
+        return [spec, parameterized, &p](::accelerated::Image **inputs, int nInputs, ::accelerated::Image &output) -> Future {
+            aa_assert(nInputs == 1);
+            auto &in = TiledImage::castFrom(*inputs[0]);
+            aa_assert(spec.border != Image::Border::REPEAT || in.getTileCount() == 1);
+
+            // input pixel coordinate of the center of output pixel o,
+            // c = alpha * o + translation * inSize
+            const double xAlpha = spec.xScale * in.width / output.width;
+            const double yAlpha = spec.yScale * in.height / output.height;
+            const double xTrans = spec.xTranslation * in.width;
+            const double yTrans = spec.yTranslation * in.height;
+            // a pixel of margin against rounding differences with the GPU
+            const InputRange xRange = [xAlpha, xTrans](int o) {
+                const int c = int(std::floor(xAlpha * o + xTrans));
+                return std::make_pair(c - 1, c + 2);
+            };
+            const InputRange yRange = [yAlpha, yTrans](int o) {
+                const int c = int(std::floor(yAlpha * o + yTrans));
+                return std::make_pair(c - 1, c + 2);
+            };
+
+            const PieceRenderer render = [spec, parameterized, xAlpha, yAlpha, xTrans, yTrans](const Piece &piece, ::accelerated::Image &input, ::accelerated::Image &output) -> Future {
+                const Rect &t = piece.inTexture;
+                auto pieceSpec = spec;
+                pieceSpec.setScale(xAlpha * piece.out.width / t.width, yAlpha * piece.out.height / t.height);
+                pieceSpec.setTranslation(
+                    (xAlpha * piece.out.x0 + xTrans - t.x0) / t.width,
+                    (yAlpha * piece.out.y0 + yTrans - t.y0) / t.height);
+                parameterized.setParameters(pieceSpec);
+                return ::accelerated::operations::callUnary(parameterized.function, input, output);
+            };
+
+            return neighborhoodOperation(p, xRange, yRange, render)(inputs, nInputs, output);
+        };
+    }
+};
+}
+
+std::unique_ptr<::accelerated::operations::StandardFactory> createTiledFactory(Processor &processor) {
+    return std::unique_ptr<::accelerated::operations::StandardFactory>(new TiledFactory(processor));
+}
+}
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "image.hpp"
+#include "../standard_ops.hpp"
+
+namespace accelerated {
+namespace opengl {
+/**
+ * A GPU image that may be larger than GL_MAX_TEXTURE_SIZE, stored as a grid
+ * of textures (tiles). Each tile is responsible for a rectangular "core"
+ * region of the image and also stores a halo of the neighboring pixels
+ * around it so that operations reading a neighborhood of each pixel, like
+ * convolutions and rescaling, can be executed tile by tile. Use the
+ * operations created by operations::createTiledFactory, which keep the
+ * halos up to date.
+ *
+ * The whole image is read and written at once. writeRaw copies the input
+ * data, which can be reused as soon as writeRaw returns. ROIs are not
+ * supported.
+ */
+class TiledImage : public ::accelerated::Image {
+public:
+    struct Rect {
+        int x0, y0, width, height;
+    };
+
+    /** Width of the halo stored around the core of each tile */
+    virtual int getHalo() const = 0;
+    /** Number of tiles, which are in row-major order */
+    virtual int getTileCount() const = 0;
+    /** Pixels stored in the tile: the core and the halo, clipped to the image */
+    virtual Rect getTileRect(int index) const = 0;
+    /** Pixels the tile is responsible for. The cores of the tiles do not overlap */
+    virtual Rect getTileCore(int index) const = 0;
+    /** The texture of the tile, of the size of getTileRect(index) */
+    virtual opengl::Image &getTile(int index) = 0;
+
+    /**
+     * The halo must be at least the radius of the convolution kernels
+     * (or, in rescale, the sampling footprint) of the operations applied to
+     * the images. A maxTileSize of 0 means GL_MAX_TEXTURE_SIZE.
+     */
+    static std::unique_ptr<::accelerated::Image::Factory> createFactory(Processor &processor, int halo = 16, int maxTileSize = 0);
+    static TiledImage &castFrom(::accelerated::Image &image);
+    static ImageTypeSpec getSpec(int channels, DataType dtype);
+
+protected:
+    TiledImage(int w, int h, const ImageTypeSpec &spec);
+};
+
+namespace operations {
+/**
+ * Standard operations for TiledImages. Pixelwise operations (fill, swizzle,
+ * affine transforms) require all images to have the same size and tiling.
+ * Convolutions and rescale support any input and output sizes as long as
+ * the halo of the input is wide enough, but Border::REPEAT is only
+ * supported for images consisting of a single tile.
+ */
+std::unique_ptr<::accelerated::operations::StandardFactory> createTiledFactory(Processor &processor);
+}
+}
+}
@@ -1,6 +1,7 @@
 #include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -19,6 +20,7 @@ private:
     struct Task {
         std::unique_ptr<Promise> promise;
         std::function<void()> func;
+        CancellationToken token;
     };
 
     std::deque< Task > tasks;
@@ -26,6 +28,7 @@ private:
     std::condition_variable emptyCondition, subscribeCondition;
     bool shouldQuit = false;
     int nSubscribed = 0;
+    WaitPolicy waitPolicy;
 
     bool process(bool many, bool waitForData) {
         bool any = false;
@@ -39,13 +42,21 @@ private:
             if (shouldQuit || tasks.empty()) {
                 break;
             }
-            auto task = std::move(tasks.front());
-            tasks.pop_front();
-            lock.unlock();
-
-            task.func();
-            task.promise->resolve();
-            any = true;
+            {
+                auto task = std::move(tasks.front());
+                tasks.pop_front();
+                lock.unlock();
+
+                if (task.token.isCancelled()) {
+                    task.promise->cancel();
+                } else {
+                    task.func();
+                    task.promise->resolve();
+                }
+                any = true;
+                // the task must be destroyed before re-locking: the
+                // destructors of its captures may enqueue new tasks
+            }
 
             lock.lock();
         } while (many);
@@ -67,10 +78,15 @@ public:
     }
 
     Future enqueue(const std::function<void()> &op) final {
+        return enqueue(op, CancellationToken {});
+    }
+
+    Future enqueue(const std::function<void()> &op, const CancellationToken &token) final {
         Task task;
-        task.promise = Promise::create();
+        task.promise = Promise::create(waitPolicy);
         auto future = task.promise->getFuture();
         task.func = op;
+        task.token = token;
 
         {
             std::lock_guard<std::mutex> lock(mutex);
@@ -80,6 +96,10 @@ public:
         return future;
     }
 
+    void setDefaultWaitPolicy(const WaitPolicy &policy) final {
+        waitPolicy = policy;
+    }
+
     void waitUntilNSubscribed(int n) {
         // hacky
         std::unique_lock<std::mutex> lock(mutex);
@@ -94,12 +114,16 @@ public:
     void processUntilDestroyed() final { process(true, true); }
 };
 
+thread_local const Processor *currentThreadPool = nullptr;
+
 struct ThreadPool : Processor {
 private:
     std::vector< std::thread > pool;
     std::unique_ptr<QueueImplementation> queue;
 
-    void work() {
+    void work(const ThreadPoolSpec &spec, int index) {
+        spec.applyToCurrentThread(index);
+        currentThreadPool = this;
         queue->processUntilDestroyed();
     }
 
@@ -110,16 +134,28 @@ public:
         for (auto &thread : pool) thread.join();
     }
 
-    ThreadPool(int nThreads) : queue(new QueueImplementation) {
-        aa_assert(nThreads > 0);
-        for (int i = 0; i < nThreads; ++i) {
-            pool.emplace_back([this]{ work(); });
+    ThreadPool(const ThreadPoolSpec &spec) : queue(new QueueImplementation) {
+        aa_assert(spec.nThreads > 0);
+        for (int i = 0; i < spec.nThreads; ++i) {
+            pool.emplace_back([this, spec, i]{ work(spec, i); });
         }
     }
 
     Future enqueue(const std::function<void()> &op) final {
         return queue->enqueue(op);
     }
+
+    Future enqueue(const std::function<void()> &op, const CancellationToken &token) final {
+        return queue->enqueue(op, token);
+    }
+
+    void setDefaultWaitPolicy(const WaitPolicy &policy) final {
+        queue->setDefaultWaitPolicy(policy);
+    }
+
+    bool inWorkerThread() const final {
+        return currentThreadPool == this;
+    }
 };
 
 struct InstantProcessor : Processor {
@@ -127,6 +163,13 @@ struct InstantProcessor : Processor {
         op();
         return Future::instantlyResolved();
     }
+
+    Future enqueue(const std::function<void()> &op, const CancellationToken &token) final {
+        if (!token.isCancelled()) return enqueue(op);
+        auto promise = Promise::create();
+        promise->cancel();
+        return promise->getFuture();
+    }
 };
 }
 
@@ -135,7 +178,23 @@ std::unique_ptr<Processor> Processor::createInstant() {
 }
 
 std::unique_ptr<Processor> Processor::createThreadPool(int nThreads) {
-    return std::unique_ptr<Processor>(new ThreadPool(nThreads));
+    return createThreadPool(ThreadPoolSpec {}.setThreads(nThreads));
+}
+
+std::unique_ptr<Processor> Processor::createThreadPool(const ThreadPoolSpec &spec) {
+    return std::unique_ptr<Processor>(new ThreadPool(spec));
+}
+
+std::vector< std::unique_ptr<Processor> > Processor::createNumaThreadPools(const ThreadPoolSpec &spec) {
+    std::vector< std::unique_ptr<Processor> > pools;
+    for (int node : ThreadPoolSpec::numaNodes()) {
+        ThreadPoolSpec nodeSpec = spec;
+        nodeSpec.cpus = ThreadPoolSpec::numaNodeCpus(node);
+        if (!spec.name.empty()) nodeSpec.name = spec.name + "n" + std::to_string(node) + "-";
+        pools.push_back(createThreadPool(nodeSpec));
+    }
+    if (pools.empty()) pools.push_back(createThreadPool(spec));
+    return pools;
 }
 
 std::unique_ptr<Queue> Processor::createQueue() {
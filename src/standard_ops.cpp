@@ -1,5 +1,6 @@
 #include "standard_ops.hpp"
 #include <map>
+#include <memory>
 #include <string>
 
 namespace accelerated {
@@ -7,6 +8,11 @@ namespace operations {
 
 StandardFactory::~StandardFactory() = default;
 
+Future StandardFactory::warmUp(const std::vector<Function> &functions) {
+    (void)functions;
+    return Future::instantlyResolved();
+}
+
 Function fill::Spec::build(const ImageTypeSpec &outSpec) {
     aa_assert(factory != nullptr);
     return factory->create(*this, outSpec);
@@ -30,6 +36,53 @@ DEF_FUNC(pixelwiseAffineCombination)
 
 #undef DEF_FUNC
 
+#define DEF_PARAMETERIZED_FUNC(x) \
+    ParameterizedFunction<x::Spec> x::Spec::buildParameterized(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) { \
+        aa_assert(factory != nullptr); \
+        return factory->createParameterized(*this, inSpec, outSpec); \
+    } \
+    ParameterizedFunction<x::Spec> x::Spec::buildParameterized(const ImageTypeSpec &spec) { return buildParameterized(spec, spec); }
+
+DEF_PARAMETERIZED_FUNC(fixedConvolution2D)
+DEF_PARAMETERIZED_FUNC(pixelwiseAffineCombination)
+DEF_PARAMETERIZED_FUNC(channelwiseAffine)
+DEF_PARAMETERIZED_FUNC(rescale)
+
+#undef DEF_PARAMETERIZED_FUNC
+
+namespace {
+// Fallback for factories that do not override createParameterized: the
+// returned Function calls the latest built Function. Since calling a
+// Function only enqueues its body, replacing it does not affect the calls
+// made before setParameters, but unlike in the CPU and OpenGL
+// implementations, the change is not recorded in CommandLists
+template <class Spec> ParameterizedFunction<Spec> rebuildOnChange(StandardFactory &factory, const Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
+    auto current = std::make_shared<Function>(factory.create(spec, inSpec, outSpec));
+    ParameterizedFunction<Spec> r;
+    r.function = [current](Image **inputs, int nInputs, Image &output) -> Future {
+        return (*current)(inputs, nInputs, output);
+    };
+    StandardFactory *f = &factory;
+    r.setParameters = [f, current, inSpec, outSpec](const Spec &newSpec) -> Future {
+        *current = f->create(newSpec, inSpec, outSpec);
+        return Future::instantlyResolved();
+    };
+    return r;
+}
+}
+
+#define DEF_DEFAULT_PARAMETERIZED(x) \
+    ParameterizedFunction<x::Spec> StandardFactory::createParameterized(const x::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) { \
+        return rebuildOnChange(*this, spec, inSpec, outSpec); \
+    }
+
+DEF_DEFAULT_PARAMETERIZED(fixedConvolution2D)
+DEF_DEFAULT_PARAMETERIZED(pixelwiseAffineCombination)
+DEF_DEFAULT_PARAMETERIZED(channelwiseAffine)
+DEF_DEFAULT_PARAMETERIZED(rescale)
+
+#undef DEF_DEFAULT_PARAMETERIZED
+
 Function StandardFactory::create(const pixelwiseAffine::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec) {
     pixelwiseAffineCombination::Spec comboSpec;
     comboSpec.factory = spec.factory;
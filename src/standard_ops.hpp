@@ -13,6 +13,22 @@ struct Builder {
     StandardFactory *factory = nullptr;
 };
 
+/**
+ * A Function whose numeric parameters (kernel weights, matrices, scale,
+ * bias, etc.) can be changed without building a new Function. In the
+ * OpenGL implementation, they are shader uniforms so that the same program
+ * serves all specs that only differ in these values.
+ */
+template <class Spec> struct ParameterizedFunction {
+    Function function;
+    /**
+     * Use the numeric parameters of the given spec in the calls made after
+     * this. Its other properties (kernel size, strides, borders, number of
+     * inputs, whether it has a bias, etc.) must match the original spec
+     */
+    std::function< Future(const Spec &spec) > setParameters;
+};
+
 namespace copy {
     struct Spec : Builder {
         Function build(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
@@ -98,6 +114,8 @@ namespace fixedConvolution2D {
 
         Function build(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
         Function build(const ImageTypeSpec &spec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &spec);
     };
 }
 
@@ -165,6 +183,8 @@ namespace pixelwiseAffineCombination {
 
         Function build(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
         Function build(const ImageTypeSpec &spec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &spec);
     };
 }
 
@@ -190,6 +210,8 @@ namespace channelwiseAffine {
 
         Function build(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
         Function build(const ImageTypeSpec &spec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &spec);
     };
 }
 
@@ -236,6 +258,8 @@ namespace rescale {
 
         Function build(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
         Function build(const ImageTypeSpec &spec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+        ParameterizedFunction<Spec> buildParameterized(const ImageTypeSpec &spec);
     };
 }
 
@@ -302,6 +326,21 @@ struct StandardFactory : Builder {
     virtual Function create(const pixelwiseAffine::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
     virtual Function create(const copy::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
 
+    // by default, these build a new Function when the parameters change
+    virtual ParameterizedFunction<fixedConvolution2D::Spec> createParameterized(const fixedConvolution2D::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+    virtual ParameterizedFunction<pixelwiseAffineCombination::Spec> createParameterized(const pixelwiseAffineCombination::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+    virtual ParameterizedFunction<channelwiseAffine::Spec> createParameterized(const channelwiseAffine::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+    virtual ParameterizedFunction<rescale::Spec> createParameterized(const rescale::Spec &spec, const ImageTypeSpec &inSpec, const ImageTypeSpec &outSpec);
+
+    /**
+     * Finish any lazy initialization of the given Functions, created by this
+     * factory, so that their first calls are as fast as the later ones. In
+     * OpenGL, waits for the shader programs to be built and draws each of
+     * them once to a 1x1 image since drivers may defer the final compilation
+     * to the first draw. The default implementation does nothing
+     */
+    virtual Future warmUp(const std::vector<Function> &functions);
+
 
 private:
     template <class T> inline T &&setFactory(T &&t) { t.factory = this; return std::move(t); }
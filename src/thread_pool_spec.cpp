@@ -0,0 +1,136 @@
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#include "future.hpp"
+#include "log.hpp"
+
+namespace accelerated {
+namespace {
+// unlike std::stol, does not throw on malformed input
+bool parseLong(const std::string &s, long &value) {
+    const char *begin = s.c_str();
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtol(begin, &end, 10);
+    if (end == begin || errno != 0) return false;
+    while (*end == ' ' || *end == '\n') end++;
+    return *end == '\0';
+}
+
+// parses the Linux sysfs "cpulist" format, e.g., "0-3,8,10-11".
+// Empty if malformed
+std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::istringstream iss(list);
+    std::string range;
+    while (std::getline(iss, range, ',')) {
+        if (range.empty() || range[0] == '\n') continue;
+        const auto dash = range.find('-');
+        long first, last;
+        if (!parseLong(range.substr(0, dash), first)) return {};
+        if (dash == std::string::npos) last = first;
+        else if (!parseLong(range.substr(dash + 1), last)) return {};
+        if (first < 0 || last < first) return {};
+        for (long i = first; i <= last; ++i) cpus.push_back(int(i));
+    }
+    return cpus;
+}
+
+bool readFirstLine(const std::string &path, std::string &line) {
+    std::ifstream file(path);
+    if (!file) return false;
+    return bool(std::getline(file, line));
+}
+
+std::string numaNodeCpuListPath(int node) {
+    return "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+}
+}
+
+void ThreadPoolSpec::applyToCurrentThread(int workerIndex) const {
+#if defined(__linux__)
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pinEachThread) {
+            CPU_SET(cpus.at(workerIndex % cpus.size()), &set);
+        } else {
+            for (int cpu : cpus) CPU_SET(cpu, &set);
+        }
+        // pid 0 = the calling thread (not the whole process) on Linux
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            log_warn("failed to set affinity of worker thread %d", workerIndex);
+        }
+    }
+    if (!name.empty()) {
+        // names are limited to 16 bytes, including the terminating null
+        const std::string fullName = (name + std::to_string(workerIndex)).substr(0, 15);
+        pthread_setname_np(pthread_self(), fullName.c_str());
+    }
+    if (niceness != 0) {
+        const int tid = int(syscall(SYS_gettid));
+        if (setpriority(PRIO_PROCESS, tid, niceness) != 0) {
+            log_warn("failed to set niceness %d for worker thread %d", niceness, workerIndex);
+        }
+    }
+#else
+    if (!cpus.empty() || niceness != 0) {
+        log_warn("thread affinity and priority are not supported on this platform");
+    }
+    #if defined(__APPLE__)
+    if (!name.empty()) pthread_setname_np((name + std::to_string(workerIndex)).c_str());
+    #endif
+#endif
+}
+
+std::vector<int> ThreadPoolSpec::fastestCpus() {
+    std::vector<int> fastest;
+    long maxFreq = 0;
+    // the CPU ids are not necessarily contiguous (e.g., offline CPUs)
+    std::string line;
+    if (!readFirstLine("/sys/devices/system/cpu/online", line)) return {};
+    for (int cpu : parseCpuList(line)) {
+        long freq;
+        if (!readFirstLine("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/cpuinfo_max_freq", line) ||
+            !parseLong(line, freq)) {
+            return {};
+        }
+        if (freq > maxFreq) {
+            maxFreq = freq;
+            fastest.clear();
+        }
+        if (freq == maxFreq) fastest.push_back(cpu);
+    }
+    return fastest;
+}
+
+std::vector<int> ThreadPoolSpec::numaNodeCpus(int node) {
+    std::string line;
+    if (!readFirstLine(numaNodeCpuListPath(node), line)) return {};
+    return parseCpuList(line);
+}
+
+std::vector<int> ThreadPoolSpec::numaNodes() {
+    // the node ids are not necessarily contiguous
+    std::string line;
+    if (!readFirstLine("/sys/devices/system/node/online", line)) return {};
+    return parseCpuList(line);
+}
+
+int ThreadPoolSpec::numaNodeCount() {
+    return int(numaNodes().size());
+}
+}
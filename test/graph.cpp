@@ -0,0 +1,60 @@
+#include <catch2/catch.hpp>
+
+#include "cpu/image.hpp"
+#include "cpu/operations.hpp"
+#include "graph.hpp"
+
+TEST_CASE( "Graph", "[accelerated-arrays]" ) {
+    using namespace accelerated;
+    typedef std::int32_t Type;
+
+    for (int useThreadPool = 0; useThreadPool < 2; ++useThreadPool) {
+        auto processor = useThreadPool ? Processor::createThreadPool(2) : Processor::createInstant();
+        auto factory = cpu::Image::createFactory();
+        auto ops = cpu::operations::createFactory(*processor);
+
+        int nAddCalls = 0;
+        auto addOne = operations::sync::wrap<cpu::Image>([&nAddCalls](cpu::Image **inputs, int nInputs, cpu::Image &output) {
+            aa_assert(nInputs == 1); (void)nInputs;
+            nAddCalls++;
+            for (int y = 0; y < output.height; ++y)
+                for (int x = 0; x < output.width; ++x)
+                    output.set<Type>(x, y, inputs[0]->get<Type>(x, y) + 1);
+        }, *processor);
+        auto sum = ops->affineCombination()
+            .addLinearPart({{ 1 }})
+            .addLinearPart({{ 1 }})
+            .build(factory->getSpec<Type, 1>());
+
+        auto input = factory->create<Type, 1>(4, 3);
+        auto output = factory->createLike(*input);
+        input->write(std::vector<Type>(12, 10)).wait();
+
+        auto graph = operations::Graph::create(*factory);
+        auto &a = graph->createIntermediateLike(*input);
+        auto &b = graph->createIntermediateLike(*input);
+        auto &c = graph->createIntermediateLike(*input);
+        auto &d = graph->createIntermediateLike(*input);
+        auto &unused = graph->createIntermediateLike(*input);
+
+        graph->call(addOne, { input.get() }, a); // 11
+        graph->call(addOne, { &a }, unused); // pruned
+        graph->call(addOne, { &a }, b); // 12
+        graph->call(addOne, { &b }, c); // 13
+        graph->call(addOne, { &unused }, d); // pruned
+        graph->call(addOne, { &c }, d); // 14
+        graph->call(sum, { input.get(), &d }, *output); // 10 + 14
+
+        REQUIRE(graph->liveCallCount() == 5);
+        REQUIRE(nAddCalls == 0);
+
+        auto &outCpu = cpu::Image::castFrom(*output);
+        for (int itr = 0; itr < 2; ++itr) {
+            graph->run().wait();
+            REQUIRE(outCpu.get<Type>(3, 2) == 24);
+        }
+        REQUIRE(nAddCalls == 8);
+        // a chain only needs two alternating intermediate buffers
+        REQUIRE(graph->intermediateBytes() == 2 * input->size());
+    }
+}
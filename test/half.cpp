@@ -0,0 +1,87 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "half.hpp"
+#include "cpu/image.hpp"
+#include "cpu/operations.hpp"
+
+TEST_CASE( "Half float conversions", "[accelerated-arrays]" ) {
+    using namespace accelerated;
+    REQUIRE(sizeof(Half) == 2);
+
+    REQUIRE(Half(1.0).bits == 0x3c00);
+    REQUIRE(Half(-2.0).bits == 0xc000);
+    REQUIRE(Half(0.0).bits == 0);
+    REQUIRE(Half(65504.0).bits == 0x7bff);
+    REQUIRE(float(Half::fromBits(0x3555)) == Approx(0.33325195));
+
+    // overflow, infinity and NaN
+    REQUIRE(Half(1e6).bits == 0x7c00);
+    REQUIRE(std::isinf(float(Half(-std::numeric_limits<float>::infinity()))));
+    REQUIRE(std::isnan(float(Half(std::numeric_limits<float>::quiet_NaN()))));
+
+    // subnormals
+    const float smallest = std::ldexp(1.0f, -24);
+    REQUIRE(Half(smallest).bits == 1);
+    REQUIRE(float(Half::fromBits(1)) == smallest);
+    REQUIRE(float(Half::fromBits(0x03ff)) == std::ldexp(1023.0f, -24));
+
+    // round to nearest even: 1 + 2^-11 is halfway between 1 and 1 + 2^-10
+    REQUIRE(Half(1.0 + std::ldexp(1.0, -11)).bits == 0x3c00);
+    REQUIRE(Half(1.0 + 3 * std::ldexp(1.0, -11)).bits == 0x3c02);
+
+    auto c = Half(0.5) * Half(0.5) + Half(1.0);
+    REQUIRE(c == Half(1.25));
+    REQUIRE(-c == Half(-1.25));
+    REQUIRE(std::abs(-c) == 1.25f);
+
+    // every non-NaN half survives a round trip through float
+    for (std::uint32_t b = 0; b < 0x10000; ++b) {
+        const Half h = Half::fromBits(std::uint16_t(b));
+        const float f = h;
+        if (std::isnan(f)) continue;
+        REQUIRE(Half(f) == h);
+    }
+}
+
+TEST_CASE( "Half float bulk conversions", "[accelerated-arrays]" ) {
+    using namespace accelerated;
+    std::vector<float> values;
+    for (int i = 0; i < 37; ++i) values.push_back(std::ldexp(float(i - 18) / 7.0f, i % 20 - 10));
+    values.push_back(1e-7);
+    values.push_back(1e5);
+
+    std::vector<Half> halfs(values.size());
+    convertFloatToHalf(values.data(), halfs.data(), values.size());
+    std::vector<float> back(values.size());
+    convertHalfToFloat(halfs.data(), back.data(), values.size());
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(halfs[i] == Half(values[i]));
+        REQUIRE(back[i] == float(Half(values[i])));
+    }
+}
+
+TEST_CASE( "Half float images", "[accelerated-arrays]" ) {
+    using namespace accelerated;
+    auto processor = Processor::createInstant();
+    auto factory = cpu::Image::createFactory();
+    auto ops = cpu::operations::createFactory(*processor);
+
+    auto input = factory->create<Half, 2>(9, 3);
+    auto output = factory->create<float, 2>(9, 3);
+    REQUIRE(input->bytesPerChannel() == 2);
+
+    std::vector<Half> data;
+    for (int i = 0; i < 9 * 3 * 2; ++i) data.push_back(Half(i * 0.25 - 3));
+    input->write(data).wait();
+    REQUIRE(cpu::Image::castFrom(*input).get<float>(1, 0, 1) == Approx(-2.25));
+
+    auto affine = ops->channelwiseAffine(2, 1).build(*input, *output);
+    operations::callUnary(affine, *input, *output).wait();
+    auto &out = cpu::Image::castFrom(*output);
+    for (int i = 0; i < 9 * 3 * 2; ++i) {
+        REQUIRE(out.get<float>((i / 2) % 9, i / 18, i % 2) == Approx(2 * (i * 0.25 - 3) + 1));
+    }
+}
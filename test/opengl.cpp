@@ -1,10 +1,21 @@
 #include <catch2/catch.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 
+#include "cpu/image.hpp"
+#include "cpu/operations.hpp"
 #include "opengl/operations.hpp"
 #include "opengl/image.hpp"
 #include "opengl/adapters.hpp"
+#include "opengl/tiled_image.hpp"
+#include "opengl_processor.hpp"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
 
 #ifdef TEST_OPENGL_WITH_VISIBLE_WINDOW
 #include <chrono>
@@ -14,7 +25,7 @@
 
 TEST_CASE( "manual OpenGL", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
-    auto processor = opengl::createGLFWProcessor();
+    auto processor = createTestGLProcessor();
     processor->enqueue([]() {
         GLuint texId, fbId;
         glGenTextures(1, &texId);
@@ -38,7 +49,7 @@ TEST_CASE( "manual OpenGL", "[accelerated-arrays-opengl]" ) {
 
 TEST_CASE( "adapters", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
-    auto processor = opengl::createGLFWProcessor();
+    auto processor = createTestGLProcessor();
     for (bool leak : { true, false }) {
         processor->enqueue([leak]() {
             auto fb = opengl::FrameBuffer::create(640, 400, opengl::Image::getSpec(4, ImageTypeSpec::DataType::UINT8));
@@ -50,7 +61,7 @@ TEST_CASE( "adapters", "[accelerated-arrays-opengl]" ) {
 
 TEST_CASE( "fixed-point image", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
-    auto processor = opengl::createGLFWProcessor();
+    auto processor = createTestGLProcessor();
     auto factory = opengl::Image::createFactory(*processor);
 
     REQUIRE(factory->getSpec<std::uint8_t, 2>().storageType == ImageTypeSpec::StorageType::GPU_OPENGL);
@@ -102,7 +113,7 @@ TEST_CASE( "fixed-point image", "[accelerated-arrays-opengl]" ) {
 #ifndef ACCELERATED_ARRAYS_USE_OPENGL_ES
 TEST_CASE( "signed fixed-point image", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
-    auto processor = opengl::createGLFWProcessor();
+    auto processor = createTestGLProcessor();
     auto factory = opengl::Image::createFactory(*processor);
 
     typedef std::int8_t IntType;
@@ -131,7 +142,7 @@ TEST_CASE( "signed fixed-point image", "[accelerated-arrays-opengl]" ) {
 }
 TEST_CASE( "16-bit integer image", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
-    auto processor = opengl::createGLFWProcessor();
+    auto processor = createTestGLProcessor();
     auto factory = opengl::Image::createFactory(*processor);
 
     typedef std::int16_t Type;
@@ -154,7 +165,7 @@ TEST_CASE( "16-bit integer image", "[accelerated-arrays-opengl]" ) {
 
 TEST_CASE( "32-bit integer image", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
-    auto processor = opengl::createGLFWProcessor();
+    auto processor = createTestGLProcessor();
     auto factory = opengl::Image::createFactory(*processor);
 
     typedef std::int32_t Type;
@@ -176,7 +187,7 @@ TEST_CASE( "32-bit integer image", "[accelerated-arrays-opengl]" ) {
 
 TEST_CASE( "float image", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
-    auto processor = opengl::createGLFWProcessor();
+    auto processor = createTestGLProcessor();
     auto factory = opengl::Image::createFactory(*processor);
 
     typedef float Type;
@@ -196,6 +207,853 @@ TEST_CASE( "float image", "[accelerated-arrays-opengl]" ) {
     REQUIRE(std::fabs(outBuf.back() - (-3.14159)) < 1e-5);
 }
 
+TEST_CASE( "half-float image", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+
+    typedef Half Type;
+    auto image = factory->create<Type, 4>(20, 30);
+    auto image2 = factory->create<Type, 2>(7, 3);
+
+    std::vector<Type> inBuf, outBuf;
+    inBuf.resize(image->numberOfScalars(), Half(3.14159));
+    image->write(inBuf);
+    image->read(outBuf).wait();
+    REQUIRE(outBuf[0] == Half(3.14159));
+
+    auto ops = opengl::operations::createFactory(*processor);
+    auto affine = ops->channelwiseAffine(-2, 0.5).build(*image);
+    operations::callUnary(affine, *image, *image).wait();
+    image->read(outBuf).wait();
+    REQUIRE(outBuf.back() == Half(-2 * float(Half(3.14159)) + 0.5));
+
+    // 2-channel images are read through the packing shader
+    inBuf.clear();
+    for (int i = 0; i < 7 * 3 * 2; ++i) inBuf.push_back(Half((i - 20) / 3.0));
+    image2->write(inBuf);
+    image2->read(outBuf).wait();
+    REQUIRE(outBuf == inBuf);
+}
+
+TEST_CASE( "asynchronous reads", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createFactory(*processor);
+
+    // 2 channels: uses the read adapter, 4 channels: direct read. Not 3
+    // channels, which are not color-renderable in OpenGL ES
+    for (int channels : { 2, 4 }) {
+        auto image = factory->create(30, 20, channels, ImageTypeSpec::DataType::UINT8);
+
+        constexpr int N_READS = 5;
+        std::vector< std::vector<std::uint8_t> > outBufs(N_READS);
+        std::vector< Future > reads;
+        for (int i = 0; i < N_READS; ++i) {
+            auto fill = ops->fill(std::vector<double>(channels, 10 + i)).build(*image);
+            operations::callNullary(fill, *image);
+            reads.push_back(image->read(outBufs.at(i)));
+        }
+
+        for (auto &f : reads) f.wait();
+        for (int i = 0; i < N_READS; ++i) {
+            REQUIRE(int(outBufs.at(i).front()) == 10 + i);
+            REQUIRE(int(outBufs.at(i).back()) == 10 + i);
+        }
+    }
+}
+
+TEST_CASE( "packed reads", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    typedef ImageTypeSpec::DataType DataType;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+
+    std::vector<DataType> dataTypes = {
+        DataType::UINT8, DataType::SINT8,
+        DataType::UINT16, DataType::SINT16,
+        DataType::UINT32, DataType::SINT32,
+        DataType::FLOAT32,
+        DataType::UFIXED8, DataType::SFIXED8
+    };
+    #ifndef ACCELERATED_ARRAYS_USE_OPENGL_ES
+    // stored as half floats in OpenGL ES
+    dataTypes.push_back(DataType::UFIXED16);
+    dataTypes.push_back(DataType::SFIXED16);
+    #endif
+
+    // 2-channel images are read through the GPU packing adapter. The
+    // byte count of the first size is not divisible to RGBA8 rows
+    for (auto dataType : dataTypes) {
+        for (auto size : { std::make_pair(3, 5), std::make_pair(4, 2) }) {
+            auto image = factory->create(size.first, size.second, 2, dataType);
+            const int bytesPerChannel = image->bytesPerChannel();
+
+            std::vector<std::uint8_t> inBuf(image->size()), outBuf(image->size(), 0);
+            for (std::size_t i = 0; i < inBuf.size(); ++i) inBuf[i] = std::uint8_t(i * 89 + 7);
+            for (std::size_t i = 0; i < inBuf.size(); i += bytesPerChannel) {
+                std::uint8_t &msb = inBuf[i + bytesPerChannel - 1];
+                if (dataType == DataType::FLOAT32) {
+                    float f = float(int(i) - 20) * 0.25f;
+                    std::memcpy(&inBuf[i], &f, sizeof(f));
+                } else if (ImageTypeSpec::isFixedPoint(dataType) && ImageTypeSpec::isSigned(dataType) && msb == 0x80) {
+                    // the minimum SNORM value -1 is read back as -(max)
+                    msb = 0x81;
+                }
+            }
+            image->writeRaw(inBuf.data());
+            image->readRaw(outBuf.data()).wait();
+            REQUIRE(outBuf == inBuf);
+        }
+    }
+}
+
+TEST_CASE( "streaming writes", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+
+    auto image = factory->create<std::uint8_t, 4>(30, 20);
+    opengl::Image::castFrom(*image).setStreamingWrites(true);
+
+    std::vector<std::uint8_t> inBuf, outBuf;
+    for (int i = 0; i < 5; ++i) {
+        inBuf.clear();
+        inBuf.resize(image->numberOfScalars(), 10 + i);
+        image->write(inBuf);
+        // the input buffer can be reused immediately
+        std::fill(inBuf.begin(), inBuf.end(), 0);
+        image->read(outBuf).wait();
+        REQUIRE(int(outBuf.front()) == 10 + i);
+        REQUIRE(int(outBuf.back()) == 10 + i);
+    }
+}
+
+TEST_CASE( "GPU completion futures", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto gpuProcessor = opengl::createGpuCompletionProcessor(*processor);
+    auto factory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createFactory(*gpuProcessor);
+
+    auto image = factory->create<std::uint8_t, 4>(30, 20);
+    std::vector<std::uint8_t> outBuf;
+    std::vector< Future > fills;
+    for (int i = 0; i < 3; ++i) {
+        auto fill = ops->fill(std::vector<double>(4, 10 + i)).build(*image);
+        fills.push_back(operations::callNullary(fill, *image));
+    }
+    for (auto &f : fills) f.wait();
+    REQUIRE(fills.back().isReady());
+    image->read(outBuf).wait();
+    REQUIRE(int(outBuf.front()) == 12);
+
+    auto token = CancellationToken::create();
+    token.cancel();
+    bool ran = false;
+    auto cancelled = gpuProcessor->enqueue([&ran]() { ran = true; }, token);
+    cancelled.wait();
+    REQUIRE(cancelled.isCancelled());
+    REQUIRE(!ran);
+}
+
+TEST_CASE( "program binary cache", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    opengl::clearProgramBinaryCache();
+
+    // each iteration uses a new GL context
+    auto fillAndRead = []() -> int {
+        auto processor = createTestGLProcessor();
+        auto factory = opengl::Image::createFactory(*processor);
+        auto ops = opengl::operations::createFactory(*processor);
+        auto image = factory->create<std::uint8_t, 4>(8, 6);
+        auto fill = ops->fill({ 1, 2, 3, 123 }).build(*image);
+        operations::callNullary(fill, *image);
+        std::vector<std::uint8_t> outBuf;
+        image->read(outBuf).wait();
+        return int(outBuf.back());
+    };
+
+    const auto initial = opengl::getProgramCacheStatistics();
+    REQUIRE(fillAndRead() == 123);
+    const auto compiled = opengl::getProgramCacheStatistics();
+    REQUIRE(compiled.compiled > initial.compiled);
+
+    REQUIRE(fillAndRead() == 123);
+    const auto cached = opengl::getProgramCacheStatistics();
+    if (cached.memoryHits == compiled.memoryHits) {
+        WARN("program binaries not supported by the GL driver");
+        return;
+    }
+    REQUIRE(cached.compiled == compiled.compiled);
+
+#ifndef _WIN32
+    char dirTemplate[] = "/tmp/accelerated-arrays-test-XXXXXX";
+    const char *dir = mkdtemp(dirTemplate);
+    REQUIRE(dir != nullptr);
+    opengl::setProgramBinaryCacheDirectory(dir);
+    opengl::clearProgramBinaryCache();
+    REQUIRE(fillAndRead() == 123); // compile and write to disk
+    opengl::clearProgramBinaryCache();
+    REQUIRE(fillAndRead() == 123);
+    opengl::setProgramBinaryCacheDirectory("");
+    const auto fromDisk = opengl::getProgramCacheStatistics();
+
+    if (DIR *d = opendir(dir)) {
+        while (const dirent *entry = readdir(d)) {
+            const std::string name = entry->d_name;
+            if (name != "." && name != "..") unlink((std::string(dir) + "/" + name).c_str());
+        }
+        closedir(d);
+    }
+    REQUIRE(rmdir(dir) == 0);
+
+    REQUIRE(fromDisk.diskHits > cached.diskHits);
+    REQUIRE(fromDisk.rejected == 0);
+#endif
+}
+
+TEST_CASE( "shader warm-up", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createFactory(*processor);
+
+    auto a = factory->create<float, 1>(5, 4);
+    auto b = factory->create<std::uint8_t, 1>(5, 4);
+    auto out = factory->create<float, 1>(5, 4);
+
+    auto fill = ops->fill(2.5).build(*a);
+    auto conv = ops->fixedConvolution2D({{ 0, 1, 0 }, { 1, -4, 1 }, { 0, 1, 0 }})
+        .setBorder(Image::Border::CLAMP).build(*a);
+    // inputs with different sampler types
+    auto sum = ops->wrapShader(R"(
+        void main() {
+            ivec2 c = ivec2(gl_FragCoord.xy);
+            outValue = texelFetch(u_texture1, c, 0).r + float(texelFetch(u_texture2, c, 0).r);
+        })", { *a, *b }, *out);
+
+    ops->warmUp({ fill, conv, sum }).wait();
+
+    operations::callNullary(fill, *a);
+    std::vector<std::uint8_t> bBuf(5 * 4, 3);
+    b->write(bBuf);
+    operations::callUnary(conv, *a, *out);
+    std::vector<float> outBuf;
+    out->read(outBuf).wait();
+    REQUIRE(outBuf.at(7) == 0);
+    operations::callBinary(sum, *a, *b, *out);
+    out->read(outBuf).wait();
+    REQUIRE(outBuf.at(7) == 5.5);
+
+    // not GPU functions: ignored
+    auto cpuOps = cpu::operations::createFactory(*processor);
+    REQUIRE(cpuOps->warmUp({ fill }).isReady());
+}
+
+TEST_CASE( "GPU timing", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createFactory(*processor);
+
+    auto a = factory->create<float, 1>(64, 32);
+    auto b = factory->create<float, 1>(64, 32);
+    auto untimed = ops->fill(1.5).build(*a);
+    ops->enableGpuTiming(true);
+    auto conv = ops->fixedConvolution2D({{ 1, 2, 1 }}).build(*a, *b);
+    auto affine = ops->channelwiseAffine(2, 1).build(*b, *a);
+
+    std::vector<float> outBuf;
+    operations::callNullary(untimed, *a);
+    for (int i = 0; i < 5; ++i) {
+        operations::callUnary(conv, *a, *b);
+        operations::callUnary(affine, *b, *a);
+        // earlier results become available
+        a->read(outBuf).wait();
+    }
+
+    const auto stats = ops->getGpuTimingStatistics();
+    if (stats.empty()) {
+        WARN("GPU timer queries not supported");
+        return;
+    }
+    REQUIRE(stats.size() == 2);
+    // sorted by name
+    REQUIRE(stats.at(0).name == "channelwiseAffine 1xFLOAT32 -> 1xFLOAT32");
+    REQUIRE(stats.at(1).name == "fixedConvolution2D 1x3 1xFLOAT32 -> 1xFLOAT32");
+    for (const auto &s : stats) {
+        REQUIRE(s.count >= 4);
+        REQUIRE(s.minMilliseconds >= 0);
+        REQUIRE(s.minMilliseconds <= s.meanMilliseconds);
+        REQUIRE(s.minMilliseconds <= s.p95Milliseconds);
+    }
+
+    // the last results are collected by getGpuTimingStatistics, in the GL thread
+    processor->enqueue([]() {}).wait();
+    for (const auto &s : ops->getGpuTimingStatistics()) REQUIRE(s.count == 5);
+}
+
+TEST_CASE( "GL state cache", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createFactory(*processor);
+
+    auto a = factory->create<float, 1>(16, 8);
+    auto b = factory->create<float, 1>(16, 8);
+    std::vector<float> inBuf(a->numberOfScalars(), 1), outBuf;
+    a->write(inBuf);
+    auto twice = ops->channelwiseAffine(2, 0).build(*a);
+    auto half = ops->channelwiseAffine(0.5, 0).build(*a);
+
+    // number of tracked GL calls issued for a chain of operations
+    auto countCalls = [&](bool cacheEnabled) -> long {
+        long issued = 0;
+        processor->enqueue([&]() {
+            opengl::setStateCacheEnabled(cacheEnabled);
+            issued = -opengl::getStateCacheStatistics().issued;
+        });
+        for (int i = 0; i < 20; ++i) {
+            operations::callUnary(twice, *a, *b);
+            operations::callUnary(half, *b, *a);
+        }
+        processor->enqueue([&]() {
+            issued += opengl::getStateCacheStatistics().issued;
+        }).wait();
+        return issued;
+    };
+
+    const long uncached = countCalls(false);
+    a->read(outBuf).wait();
+    REQUIRE(outBuf.front() == 1);
+
+    const long cached = countCalls(true);
+    a->read(outBuf).wait();
+    REQUIRE(outBuf.front() == 1);
+    REQUIRE(cached * 2 < uncached);
+}
+
+TEST_CASE( "multiple render targets", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createFactory(*processor);
+
+    auto input = factory->create<float, 2>(8, 4);
+    auto sum = factory->create<float, 1>(8, 4);
+    auto product = factory->create<std::int32_t, 1>(8, 4);
+
+    std::vector<float> inBuf;
+    for (int i = 0; i < int(input->numberOfScalars()); ++i) inBuf.push_back(i % 5);
+    input->write(inBuf);
+
+    auto split = ops->wrapMultiOutputShader(R"(
+        void main() {
+            vec2 v = texture(u_texture, v_texCoord).xy;
+            outValue0 = v.x + v.y;
+            outValue1 = int(v.x * v.y);
+        }
+        )", { *input }, { *sum, *product });
+
+    operations::callMultiOutput(split, { input.get() }, { sum.get(), product.get() }).wait();
+
+    std::vector<float> sumBuf;
+    std::vector<std::int32_t> productBuf;
+    sum->read(sumBuf).wait();
+    product->read(productBuf).wait();
+    for (int i = 0; i < int(sumBuf.size()); ++i) {
+        REQUIRE(sumBuf.at(i) == inBuf.at(2*i) + inBuf.at(2*i + 1));
+        REQUIRE(productBuf.at(i) == int(inBuf.at(2*i) * inBuf.at(2*i + 1)));
+    }
+}
+
+TEST_CASE( "unrolled convolution", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto cpuProcessor = Processor::createInstant();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto cpuFactory = cpu::Image::createFactory();
+    auto ops = opengl::operations::createFactory(*processor);
+    ops->useComputeShaders(false);
+    auto cpuOps = cpu::operations::createFactory(*cpuProcessor);
+
+    auto input = factory->create<float, 2>(13, 7);
+    auto cpuInput = cpuFactory->create<float, 2>(13, 7);
+    std::vector<float> inBuf;
+    for (int i = 0; i < int(input->numberOfScalars()); ++i) inBuf.push_back((i * 37) % 17 - 8);
+    input->write(inBuf);
+    cpuInput->write(inBuf);
+
+    // zero taps and taps with equal or opposite weights
+    const std::vector< std::vector<double> > sobel = {
+        { -1, 0, 1 },
+        { -2, 0, 2 },
+        { -1, 0, 1 }
+    };
+
+    for (auto border : { Image::Border::ZERO, Image::Border::CLAMP, Image::Border::REPEAT }) {
+        for (int stride : { 1, 2 }) {
+            auto spec = ops->fixedConvolution2D(sobel)
+                .setBias(0.25)
+                .setStride(stride)
+                .setOffset(-1, 1)
+                .setBorder(border);
+            const int w = 13 / stride, h = 7 / stride;
+            auto output = factory->create<float, 2>(w, h);
+            auto cpuOutput = cpuFactory->create<float, 2>(w, h);
+            operations::callUnary(spec.build(*input, *output), *input, *output);
+            operations::callUnary(cpuOps->create(spec, *cpuInput, *cpuOutput), *cpuInput, *cpuOutput);
+
+            std::vector<float> result, expected;
+            output->read(result).wait();
+            cpuOutput->read(expected).wait();
+            REQUIRE(result == expected);
+        }
+    }
+}
+
+TEST_CASE( "linear sampling convolution", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto cpuProcessor = Processor::createInstant();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto cpuFactory = cpu::Image::createFactory();
+    auto ops = opengl::operations::createFactory(*processor);
+    ops->useComputeShaders(false);
+    auto cpuOps = cpu::operations::createFactory(*cpuProcessor);
+
+    auto input = factory->create<FixedPoint<std::uint8_t>, 1>(17, 9);
+    auto cpuInput = cpuFactory->create<FixedPoint<std::uint8_t>, 1>(17, 9);
+    std::vector<std::uint8_t> inBuf;
+    for (int i = 0; i < int(input->numberOfScalars()); ++i) inBuf.push_back((i * 97) % 251);
+    input->writeRawFixedPoint(inBuf);
+    cpuInput->writeRawFixedPoint(inBuf);
+
+    // separable 5x5 Gaussian and a non-separable blur
+    const std::vector< std::vector< std::vector<double> > > kernels = {
+        {
+            { 1, 4, 6, 4, 1 },
+            { 4, 16, 24, 16, 4 },
+            { 6, 24, 36, 24, 6 },
+            { 4, 16, 24, 16, 4 },
+            { 1, 4, 6, 4, 1 }
+        },
+        {
+            { 1, 2, 0 },
+            { 3, 1, 1 },
+            { 0, 1, 5 }
+        }
+    };
+
+    std::vector<Image::Border> borders = { Image::Border::CLAMP, Image::Border::REPEAT };
+    #ifndef ACCELERATED_ARRAYS_USE_OPENGL_ES
+    borders.push_back(Image::Border::ZERO);
+    #endif
+
+    for (const auto &kernel : kernels) {
+        double sum = 0;
+        for (const auto &row : kernel) for (double k : row) sum += k;
+        for (auto border : borders) {
+            auto spec = ops->fixedConvolution2D(kernel)
+                .scaleKernelValues(1 / sum)
+                .setBorder(border);
+            auto output = factory->create<float, 1>(17, 9);
+            auto cpuOutput = cpuFactory->create<float, 1>(17, 9);
+            operations::callUnary(spec.build(*input, *output), *input, *output);
+            operations::callUnary(cpuOps->create(spec, *cpuInput, *cpuOutput), *cpuInput, *cpuOutput);
+
+            std::vector<float> result, expected;
+            output->read(result).wait();
+            cpuOutput->read(expected).wait();
+            REQUIRE(result.size() == expected.size());
+            for (std::size_t i = 0; i < result.size(); ++i) {
+                // limited precision of the bilinear weights
+                REQUIRE(std::fabs(result.at(i) - expected.at(i)) < 0.02);
+            }
+        }
+    }
+}
+
+TEST_CASE( "compute shaders", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    bool supported = false;
+    processor->enqueue([&supported]() { supported = opengl::supportsComputeShaders(); }).wait();
+    if (!supported) {
+        WARN("compute shaders not supported, skipping");
+        return;
+    }
+
+    auto factory = opengl::Image::createFactory(*processor);
+    auto fragmentOps = opengl::operations::createFactory(*processor);
+    fragmentOps->useComputeShaders(false);
+    auto computeOps = opengl::operations::createFactory(*processor);
+
+    SECTION("tiled convolution") {
+        auto input = factory->create<float, 4>(37, 21);
+        auto fragmentOut = factory->create<float, 4>(19, 11);
+        auto computeOut = factory->create<float, 4>(19, 11);
+
+        std::vector<float> inBuf;
+        for (int i = 0; i < int(input->numberOfScalars()); ++i) inBuf.push_back((i * 7919) % 101 - 50);
+        input->write(inBuf);
+
+        auto spec = fragmentOps->fixedConvolution2D({
+                { 1, 2, 3, 2, 1 },
+                { 0, -1, 4, -1, 0 },
+                { 1, 0, 0, 0, -1 }
+            })
+            .setStride(2)
+            .setBias(0.5)
+            .setBorder(Image::Border::CLAMP);
+
+        operations::callUnary(spec.build(*input, *fragmentOut), *input, *fragmentOut);
+        auto computeConv = computeOps->create(spec, *input, *computeOut);
+        operations::callUnary(computeConv, *input, *computeOut);
+
+        std::vector<float> expected, result;
+        fragmentOut->read(expected).wait();
+        computeOut->read(result).wait();
+        REQUIRE(expected.size() == result.size());
+        for (std::size_t i = 0; i < expected.size(); ++i) {
+            REQUIRE(std::fabs(expected.at(i) - result.at(i)) < 1e-3);
+        }
+    }
+
+    SECTION("ROI output") {
+        auto input = factory->create<float, 1>(16, 16);
+        std::vector<float> inBuf;
+        for (int i = 0; i < int(input->numberOfScalars()); ++i) inBuf.push_back(i % 7);
+        input->write(inBuf);
+
+        auto spec = fragmentOps->fixedConvolution2D({
+                { 1, 2, 1 },
+                { 0, -1, 0 },
+                { 1, 0, -2 }
+            })
+            .setBorder(Image::Border::CLAMP);
+
+        // the pixels outside the ROI must stay untouched
+        std::vector<float> expected, result;
+        for (auto *ops : { fragmentOps.get(), computeOps.get() }) {
+            auto output = factory->create<float, 1>(16, 16);
+            operations::callNullary(ops->fill(-100.5).build(*output), *output);
+            auto roi = output->createROI(4, 4, 8, 8);
+            operations::callUnary(ops->create(spec, *input, *roi), *input, *roi);
+            output->read(ops == fragmentOps.get() ? expected : result).wait();
+        }
+        REQUIRE(expected.size() == result.size());
+        for (std::size_t i = 0; i < expected.size(); ++i) {
+            REQUIRE(std::fabs(expected.at(i) - result.at(i)) < 1e-3);
+        }
+        REQUIRE(result.at(0) == -100.5);
+        REQUIRE(result.at(5 * 16 + 5) != -100.5);
+    }
+
+    SECTION("reduction") {
+        auto input = factory->create<float, 1>(50, 30);
+        auto output = factory->create<float, 1>(1, 1);
+
+        std::vector<float> inBuf;
+        float sum = 0;
+        for (int i = 0; i < int(input->numberOfScalars()); ++i) {
+            inBuf.push_back(i % 13);
+            sum += inBuf.back();
+        }
+        input->write(inBuf);
+
+        // one work group, partial sums in shared memory
+        auto reduceSum = computeOps->wrapComputeShader(R"(
+            shared float partial[64];
+            void main() {
+                ivec2 size = textureSize(u_texture, 0);
+                int local = int(gl_LocalInvocationIndex);
+                float s = 0.0;
+                for (int i = local; i < size.x * size.y; i += 64) {
+                    s += texelFetch(u_texture, ivec2(i % size.x, i / size.x), 0).x;
+                }
+                partial[local] = s;
+                barrier();
+                for (int n = 32; n > 0; n /= 2) {
+                    if (local < n) partial[local] += partial[local + n];
+                    barrier();
+                }
+                if (local == 0) storeOutValue(ivec2(0, 0), partial[0]);
+            }
+            )", { *input }, *output, 64, 1);
+
+        operations::callUnary(reduceSum, *input, *output).wait();
+        std::vector<float> outBuf;
+        output->read(outBuf).wait();
+        REQUIRE(outBuf.at(0) == sum);
+    }
+}
+
+TEST_CASE( "ROI inputs", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto fragmentOps = opengl::operations::createFactory(*processor);
+    fragmentOps->useComputeShaders(false);
+    auto computeOps = opengl::operations::createFactory(*processor);
+
+    constexpr int W = 23, H = 17, X0 = 5, Y0 = 3, RW = 11, RH = 9;
+    auto image = factory->create<float, 1>(W, H);
+    std::vector<float> inBuf;
+    for (int i = 0; i < W * H; ++i) inBuf.push_back(((i * 37) % 17) / 16.0f);
+    image->write(inBuf);
+
+    // the ROI is sampled without copying, compared to a copy of its pixels
+    auto roi = image->createROI(X0, Y0, RW, RH);
+    std::vector<float> roiBuf;
+    for (int y = 0; y < RH; ++y) for (int x = 0; x < RW; ++x) roiBuf.push_back(inBuf.at((y + Y0) * W + x + X0));
+    auto copy = factory->create<float, 1>(RW, RH);
+    copy->write(roiBuf);
+
+    std::vector<float> result, expected;
+    const auto check = [&](const operations::Function &f, int w, int h, double margin) {
+        auto output = factory->create<float, 1>(w, h);
+        auto expectedOutput = factory->create<float, 1>(w, h);
+        operations::callUnary(f, *roi, *output);
+        operations::callUnary(f, *copy, *expectedOutput);
+        output->read(result).wait();
+        expectedOutput->read(expected).wait();
+        for (int i = 0; i < w * h; ++i) REQUIRE(result.at(i) == Approx(expected.at(i)).margin(margin));
+    };
+
+    const std::vector<Image::Border> borders = {
+        Image::Border::ZERO, Image::Border::CLAMP, Image::Border::REPEAT, Image::Border::MIRROR
+    };
+    for (auto *ops : { fragmentOps.get(), computeOps.get() }) {
+        for (auto border : borders) {
+            auto derivative = ops->fixedConvolution2D({
+                { 1, 2, -1 },
+                { 0, 3, 1 },
+                { -2, 1, 1 }
+            }).setBias(0.5).setBorder(border);
+            check(derivative.build(*roi), RW, RH, 1e-5);
+            check(derivative.setStride(2).build(*roi), RW / 2, RH / 2, 1e-5);
+
+            // linear sampling in the copy, limited precision of the weights
+            auto blur = ops->fixedConvolution2D({
+                { 1, 2, 1 },
+                { 2, 4, 2 },
+                { 1, 2, 1 }
+            }).scaleKernelValues(1 / 16.0).setBorder(border);
+            check(blur.build(*roi), RW, RH, 0.02);
+        }
+    }
+
+    auto rescale = fragmentOps->rescale(0.6).setInterpolation(Image::Interpolation::LINEAR).setBorder(Image::Border::CLAMP);
+    check(rescale.build(*roi), 7, 5, 0.02);
+
+    // two ROIs of the same texture as inputs, and an ROI of an ROI
+    auto other = image->createROI(0, 1, RW, RH);
+    auto inner = roi->createROI(2, 1, RW - 2, RH - 2);
+    auto diff = fragmentOps->affineCombination()
+        .addLinearPart({{ 1 }})
+        .addLinearPart({{ -2 }})
+        .build(*roi);
+    auto output = factory->create<float, 1>(RW, RH);
+    operations::callBinary(diff, *roi, *other, *output);
+    output->read(result).wait();
+    for (int y = 0; y < RH; ++y) for (int x = 0; x < RW; ++x) {
+        REQUIRE(result.at(y * RW + x) == Approx(roiBuf.at(y * RW + x) - 2 * inBuf.at((y + 1) * W + x)));
+    }
+
+    auto innerOutput = factory->create<float, 1>(RW - 2, RH - 2);
+    operations::callUnary(fragmentOps->channelwiseAffine(1).build(*inner), *inner, *innerOutput);
+    innerOutput->read(result).wait();
+    for (int y = 0; y < RH - 2; ++y) for (int x = 0; x < RW - 2; ++x) {
+        REQUIRE(result.at(y * (RW - 2) + x) == roiBuf.at((y + 1) * RW + x + 2));
+    }
+}
+
+TEST_CASE( "tiled images", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    // small tiles to get a grid of them
+    auto factory = opengl::TiledImage::createFactory(*processor, 4, 32);
+    auto gpuFactory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createTiledFactory(*processor);
+    auto gpuOps = opengl::operations::createFactory(*processor);
+    gpuOps->useComputeShaders(false);
+
+    constexpr int W = 70, H = 45;
+    auto input = factory->create<float, 1>(W, H);
+    auto &tiled = opengl::TiledImage::castFrom(*input);
+    REQUIRE(tiled.getTileCount() == 3 * 2);
+    for (int i = 0; i < tiled.getTileCount(); ++i) {
+        REQUIRE(tiled.getTileRect(i).width <= 32);
+        REQUIRE(tiled.getTileRect(i).height <= 32);
+    }
+
+    // the results should be identical to a single texture
+    auto gpuInput = gpuFactory->create<float, 1>(W, H);
+    std::vector<float> inBuf;
+    for (int i = 0; i < W * H; ++i) inBuf.push_back((i * 37) % 17 - 8);
+    input->write(inBuf);
+    gpuInput->write(inBuf);
+
+    std::vector<float> result, expected;
+    input->read(result).wait();
+    REQUIRE(result == inBuf);
+
+    const std::vector< std::vector<double> > kernel = {
+        { 1, 2, -1 },
+        { 0, 3, 1 },
+        { -2, 1, 1 }
+    };
+    for (auto border : { Image::Border::ZERO, Image::Border::CLAMP, Image::Border::MIRROR }) {
+        for (int stride : { 1, 2 }) {
+            auto spec = ops->fixedConvolution2D(kernel).setBias(0.5).setStride(stride).setBorder(border);
+            const int w = W / stride, h = H / stride;
+            auto output = factory->create<float, 1>(w, h);
+            auto gpuOutput = gpuFactory->create<float, 1>(w, h);
+            operations::callUnary(spec.build(*input, *output), *input, *output);
+            operations::callUnary(gpuOps->create(spec, *gpuInput, *gpuOutput), *gpuInput, *gpuOutput);
+            output->read(result).wait();
+            gpuOutput->read(expected).wait();
+            REQUIRE(result == expected);
+
+            // the halos are up to date: a second convolution on the output
+            auto output2 = factory->create<float, 1>(w, h);
+            auto gpuOutput2 = gpuFactory->create<float, 1>(w, h);
+            auto spec2 = ops->fixedConvolution2D(kernel).setBorder(border);
+            operations::callUnary(spec2.build(*output), *output, *output2);
+            operations::callUnary(gpuOps->create(spec2, *gpuOutput, *gpuOutput2), *gpuOutput, *gpuOutput2);
+            output2->read(result).wait();
+            gpuOutput2->read(expected).wait();
+            REQUIRE(result == expected);
+        }
+    }
+
+    // pixelwise
+    auto affine = ops->channelwiseAffine(2, -1).build(*input);
+    auto output = factory->create<float, 1>(W, H);
+    operations::callUnary(affine, *input, *output);
+    output->read(result).wait();
+    for (int i = 0; i < W * H; ++i) REQUIRE(result[i] == 2 * inBuf[i] - 1);
+
+    // rescale
+    for (auto interpolation : { Image::Interpolation::NEAREST, Image::Interpolation::LINEAR }) {
+        auto spec = ops->rescale(0.8, 0.9)
+            .setTranslation(0.1, 0.05)
+            .setInterpolation(interpolation)
+            .setBorder(Image::Border::CLAMP);
+        constexpr int w = 61, h = 37;
+        auto scaled = factory->create<float, 1>(w, h);
+        auto gpuScaled = gpuFactory->create<float, 1>(w, h);
+        operations::callUnary(spec.build(*input, *scaled), *input, *scaled);
+        operations::callUnary(gpuOps->create(spec, *gpuInput, *gpuScaled), *gpuInput, *gpuScaled);
+        scaled->read(result).wait();
+        gpuScaled->read(expected).wait();
+        for (int i = 0; i < w * h; ++i) REQUIRE(result[i] == Approx(expected[i]).margin(1e-3));
+    }
+}
+
+TEST_CASE( "texture arrays", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = createTestGLProcessor();
+    auto factory = opengl::Image::createFactory(*processor);
+    auto ops = opengl::operations::createFactory(*processor);
+
+    constexpr int W = 9, H = 7, LAYERS = 3;
+    auto input = factory->createArray<float, 1>(W, H, LAYERS);
+    REQUIRE(input->width == W);
+    REQUIRE(input->height == H * LAYERS);
+    REQUIRE(opengl::Image::castFrom(*input).getLayerCount() == LAYERS);
+
+    std::vector<float> inBuf;
+    for (int i = 0; i < W * H * LAYERS; ++i) inBuf.push_back((i * 37) % 17 - 8);
+    input->write(inBuf);
+    std::vector<float> result;
+    input->read(result).wait();
+    REQUIRE(result == inBuf);
+
+    // each layer should match the same operation on a separate texture
+    std::vector< std::unique_ptr<Image> > layers;
+    for (int l = 0; l < LAYERS; ++l) {
+        layers.push_back(factory->create<float, 1>(W, H));
+        layers.back()->write(inBuf.data() + l * W * H);
+    }
+    // with a margin for the limited precision of the linear filtering weights
+    const auto checkLayers = [&](const operations::Function &f, const operations::Function &layerF, int w, int h) {
+        auto output = factory->createArray<float, 1>(w, h, LAYERS);
+        operations::callUnary(f, *input, *output);
+        output->read(result).wait();
+        for (int l = 0; l < LAYERS; ++l) {
+            auto layerOutput = factory->create<float, 1>(w, h);
+            operations::callUnary(layerF, *layers.at(l), *layerOutput);
+            std::vector<float> expected;
+            layerOutput->read(expected).wait();
+            for (int i = 0; i < w * h; ++i) REQUIRE(result.at(l * w * h + i) == Approx(expected.at(i)).margin(0.05));
+        }
+    };
+
+    auto conv = ops->fixedConvolution2D({
+        { 1, 2, -1 },
+        { 0, 3, 1 },
+        { -2, 1, 1 }
+    }).setBias(0.5).setBorder(Image::Border::CLAMP);
+    auto spec = factory->getSpec<float, 1>();
+    auto arraySpec = opengl::Image::getSpec(1, ImageTypeSpec::DataType::FLOAT32, ImageTypeSpec::StorageType::GPU_OPENGL_ARRAY);
+    checkLayers(conv.build(arraySpec), conv.build(spec), W, H);
+    checkLayers(conv.setStride(2).build(arraySpec), conv.setStride(2).build(spec), W / 2, H / 2);
+
+    auto rescale = ops->rescale(0.8).setInterpolation(Image::Interpolation::LINEAR).setBorder(Image::Border::CLAMP);
+    checkLayers(rescale.build(arraySpec), rescale.build(spec), 5, 4);
+
+    auto fill = ops->fill(2.5).build(*input);
+    operations::callNullary(fill, *input);
+    input->read(result).wait();
+    REQUIRE(result == std::vector<float>(W * H * LAYERS, 2.5));
+}
+
+#ifdef TEST_OPENGL_WITH_EGL
+TEST_CASE( "shared worker context", "[accelerated-arrays-opengl]" ) {
+    using namespace accelerated;
+    auto processor = opengl::createEGLProcessor();
+    auto worker = opengl::createSharedEGLProcessor(*processor);
+    auto factory = opengl::Image::createFactory(*processor, *worker);
+    auto ops = opengl::operations::createFactory(*processor, *worker);
+
+    auto input = factory->create<float, 1>(20, 10);
+    auto output = factory->create<float, 1>(20, 10);
+
+    // shaders are compiled in the worker thread in the background
+    std::vector<operations::Function> fns;
+    for (int i = 0; i < 5; ++i) {
+        fns.push_back(ops->channelwiseAffine(i + 1, i).build(*input, *output));
+    }
+    // waits for the worker builds
+    ops->warmUp({ fns.front(), fns.back() }).wait();
+
+    std::vector<float> inBuf;
+    for (int i = 0; i < int(input->numberOfScalars()); ++i) inBuf.push_back(i % 7);
+    input->write(inBuf).wait();
+
+    std::vector<float> outBuf;
+    for (int i = 0; i < int(fns.size()); ++i) {
+        operations::callUnary(fns.at(i), *input, *output);
+        output->read(outBuf).wait();
+        REQUIRE(outBuf.front() == inBuf.front() * (i + 1) + i);
+        REQUIRE(outBuf.back() == inBuf.back() * (i + 1) + i);
+    }
+
+    // deleted GL object names are reused for the new images, which must
+    // not confuse the bindings of the upload context
+    for (int i = 0; i < 5; ++i) {
+        auto image = factory->create<float, 1>(20, 10);
+        image->write(std::vector<float>(image->numberOfScalars(), i)).wait();
+        image->read(outBuf).wait();
+        REQUIRE(outBuf == std::vector<float>(image->numberOfScalars(), i));
+    }
+}
+#endif
+
 #ifdef TEST_OPENGL_WITH_VISIBLE_WINDOW
 TEST_CASE( "GLFW draw to window", "[accelerated-arrays-opengl]" ) {
     using namespace accelerated;
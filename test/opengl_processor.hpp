@@ -0,0 +1,12 @@
+#pragma once
+#include "opengl/operations.hpp"
+
+// Headless GL processor for the tests: GLFW by default, EGL if no window
+// system is available (e.g., CI with Mesa llvmpipe)
+inline std::unique_ptr<accelerated::Processor> createTestGLProcessor() {
+#ifdef TEST_OPENGL_WITH_EGL
+    return accelerated::opengl::createEGLProcessor();
+#else
+    return accelerated::opengl::createGLFWProcessor();
+#endif
+}
@@ -1,5 +1,6 @@
 #include <catch2/catch.hpp>
 #include <iostream>
+#include <stdexcept>
 
 #include "cpu/image.hpp"
 #include "cpu/operations.hpp"
@@ -7,6 +8,7 @@
 #ifdef TEST_WITH_OPENGL
 #include "opengl/image.hpp"
 #include "opengl/operations.hpp"
+#include "opengl_processor.hpp"
 #endif
 
 namespace {
@@ -35,7 +37,7 @@ TEST_CASE( "Convolution 2D", "[accelerated-arrays]" ) {
     #ifdef TEST_WITH_OPENGL
 
     items.emplace_back();
-    items.back().processor = opengl::createGLFWProcessor();
+    items.back().processor = createTestGLProcessor();
     items.back().img = opengl::Image::createFactory(*items.back().processor);
     {
         auto gpuOps = opengl::operations::createFactory(*items.back().processor);
@@ -97,7 +99,7 @@ TEST_CASE( "Affine pixel ops & copyFrom", "[accelerated-arrays]" ) {
     #ifdef TEST_WITH_OPENGL
 
     items.emplace_back();
-    items.back().processor = opengl::createGLFWProcessor();
+    items.back().processor = createTestGLProcessor();
     items.back().img = opengl::Image::createFactory(*items.back().processor);
     items.back().ops = opengl::operations::createFactory(*items.back().processor);
 
@@ -162,7 +164,7 @@ TEST_CASE( "Swizzle", "[accelerated-arrays]" ) {
     #ifdef TEST_WITH_OPENGL
 
     items.emplace_back();
-    items.back().processor = opengl::createGLFWProcessor();
+    items.back().processor = createTestGLProcessor();
     items.back().img = opengl::Image::createFactory(*items.back().processor);
     items.back().ops = opengl::operations::createFactory(*items.back().processor);
 
@@ -193,3 +195,155 @@ TEST_CASE( "Swizzle", "[accelerated-arrays]" ) {
         REQUIRE(outCpu.get<Type>(1, 0, 3) == 1);
     }
 }
+
+TEST_CASE( "Command list", "[accelerated-arrays]" ) {
+    std::vector< ProcessorItem > items;
+    items.emplace_back(Processor::createInstant());
+    items.emplace_back(Processor::createThreadPool(1));
+    items.emplace_back(Processor::createThreadPool(5));
+
+    #ifdef TEST_WITH_OPENGL
+
+    items.emplace_back();
+    items.back().processor = createTestGLProcessor();
+    items.back().img = opengl::Image::createFactory(*items.back().processor);
+    items.back().ops = opengl::operations::createFactory(*items.back().processor);
+
+    #endif
+
+    for (auto &it : items) {
+        typedef FixedPoint<std::uint8_t> Type;
+
+        auto inImage = it.img->create<Type, 1>(2, 2);
+        auto midImage = it.img->createLike(*inImage);
+        auto outImage = it.img->createLike(*inImage);
+
+        auto twice = it.ops->channelwiseAffine(2, 0).build(*inImage);
+        auto plusOne = it.ops->channelwiseAffine(1, 1 / 255.0).build(*inImage);
+
+        operations::CommandList list;
+        REQUIRE(list.empty());
+        list.record([&]() {
+            operations::callUnary(twice, *inImage, *midImage);
+            operations::callUnary(plusOne, *midImage, *outImage);
+        });
+        REQUIRE(!list.empty());
+
+        auto checkImage = cpu::Image::createFactory()->createLike(*outImage);
+        auto &outCpu = cpu::Image::castFrom(*checkImage);
+
+        for (int frame = 0; frame < 3; ++frame) {
+            inImage->writeRawFixedPoint(std::vector<std::uint8_t> { 1, 2, 3, std::uint8_t(frame) }).wait();
+            list.submit().wait();
+            outCpu.copyFrom(*outImage).wait();
+            REQUIRE(outCpu.get<Type>(0, 1).value == 7);
+            REQUIRE(outCpu.get<Type>(1, 1).value == 2 * frame + 1);
+        }
+
+        // a throwing callback does not leave the recorder installed
+        REQUIRE_THROWS(list.record([]() { throw std::runtime_error("failed"); }));
+        inImage->writeRawFixedPoint(std::vector<std::uint8_t> { 4, 4, 4, 4 }).wait();
+        operations::callUnary(twice, *inImage, *midImage).wait();
+        outCpu.copyFrom(*midImage).wait();
+        REQUIRE(outCpu.get<Type>(1, 1).value == 8);
+    }
+}
+
+TEST_CASE( "Parameterized functions", "[accelerated-arrays]" ) {
+    std::vector< ProcessorItem > items;
+    items.emplace_back(Processor::createInstant());
+    items.emplace_back(Processor::createThreadPool(1));
+
+    #ifdef TEST_WITH_OPENGL
+
+    items.emplace_back();
+    items.back().processor = createTestGLProcessor();
+    items.back().img = opengl::Image::createFactory(*items.back().processor);
+    items.back().ops = opengl::operations::createFactory(*items.back().processor);
+
+    #endif
+
+    for (auto &it : items) {
+        auto inImage = it.img->create<float, 1>(3, 2);
+        auto outImage = it.img->createLike(*inImage);
+        inImage->write(std::vector<float> { 1, 2, 3, 4, 5, 6 }).wait();
+
+        auto checkImage = cpu::Image::createFactory()->createLike(*outImage);
+        auto &outCpu = cpu::Image::castFrom(*checkImage);
+
+        auto affineSpec = it.ops->channelwiseAffine(2, 1);
+        auto affine = affineSpec.buildParameterized(*inImage);
+        operations::callUnary(affine.function, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == 11);
+
+        affine.setParameters(affineSpec.setScale(-1).setBias(0.5));
+        operations::callUnary(affine.function, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == -4.5);
+
+        auto convSpec = it.ops->fixedConvolution2D({
+                { 0, 0, 0 },
+                { 1, 0, 0 },
+                { 0, 0, 0 }
+            })
+            .setBias(0.25)
+            .setBorder(Image::Border::CLAMP);
+        auto conv = convSpec.buildParameterized(*inImage);
+        operations::callUnary(conv.function, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == 4.25);
+
+        conv.setParameters(convSpec.setKernel({
+                { 0, 0, 0 },
+                { 0, 0, 2 },
+                { 0, 0, 0 }
+            })
+            .setBias(0));
+        operations::callUnary(conv.function, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == 12);
+        REQUIRE(outCpu.get<float>(2, 1) == 12);
+
+        auto comboSpec = it.ops->affineCombination()
+            .addLinearPart({{ 1 }})
+            .addLinearPart({{ 2 }})
+            .setBias({ 0.5 });
+        auto combo = comboSpec.buildParameterized(*inImage);
+        comboSpec.linear.at(1) = {{ -1 }};
+        combo.setParameters(comboSpec);
+        operations::callBinary(combo.function, *inImage, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == 0.5);
+
+        auto rescaleSpec = it.ops->rescale(1)
+            .setInterpolation(Image::Interpolation::NEAREST)
+            .setBorder(Image::Border::CLAMP);
+        auto rescale = rescaleSpec.buildParameterized(*inImage);
+        operations::callUnary(rescale.function, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == 5);
+
+        // shift the output one pixel to the right
+        rescale.setParameters(rescaleSpec.setTranslation(-1.0 / 3, 0));
+        operations::callUnary(rescale.function, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(0, 1) == 4);
+        REQUIRE(outCpu.get<float>(1, 1) == 4);
+        REQUIRE(outCpu.get<float>(2, 1) == 5);
+
+        // parameter changes are ordered with the calls, also when recorded
+        operations::CommandList list;
+        list.record([&]() {
+            affine.setParameters(affineSpec.setScale(1).setBias(0));
+            operations::callUnary(affine.function, *inImage, *outImage);
+            affine.setParameters(affineSpec.setScale(3).setBias(0));
+        });
+        list.submit().wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == 5);
+        operations::callUnary(affine.function, *inImage, *outImage).wait();
+        outCpu.copyFrom(*outImage).wait();
+        REQUIRE(outCpu.get<float>(1, 1) == 15);
+    }
+}
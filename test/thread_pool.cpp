@@ -1,6 +1,7 @@
 #include <catch2/catch.hpp>
 
 #include <atomic>
+#include "cpu/image.hpp"
 #include "cpu/operations.hpp"
 
 TEST_CASE( "Thread pool", "[accelerated-arrays]" ) {
@@ -28,3 +29,113 @@ TEST_CASE( "Thread pool", "[accelerated-arrays]" ) {
         REQUIRE(val.load() == 10);
     }
 }
+
+TEST_CASE( "Cancellation", "[accelerated-arrays]" ) {
+    using namespace accelerated;
+
+    auto processor = Processor::createThreadPool(1);
+    auto blocker = Promise::create();
+    auto blockerFuture = blocker->getFuture();
+    processor->enqueue([blockerFuture]() mutable { blockerFuture.wait(); });
+
+    auto token = CancellationToken::create();
+    std::atomic<int> val;
+    val.store(0);
+    auto cancelled = processor->enqueue([&val]() { val++; }, token);
+    auto notCancelled = processor->enqueue([&val]() { val += 10; });
+
+    auto img = cpu::Image::createFactory()->create<std::uint8_t, 1>(2, 2);
+    auto ops = cpu::operations::createFactory(*processor);
+    auto fill = ops->fill(3).build(*img);
+    auto cancelledOp = operations::callNullary(fill, *img, token);
+
+    token.cancel();
+    blocker->resolve();
+
+    cancelled.wait();
+    notCancelled.wait();
+    cancelledOp.wait();
+    REQUIRE(cancelled.isCancelled());
+    REQUIRE(cancelledOp.isCancelled());
+    REQUIRE(!notCancelled.isCancelled());
+    REQUIRE(val.load() == 10);
+    REQUIRE(cpu::Image::castFrom(*img).get<std::uint8_t>(1, 1) == 0);
+
+    auto instant = Processor::createInstant();
+    auto instantCancelled = instant->enqueue([&val]() { val++; }, token);
+    REQUIRE(instantCancelled.isCancelled());
+    REQUIRE(val.load() == 10);
+}
+
+TEST_CASE( "Wait policy", "[accelerated-arrays]" ) {
+    using namespace accelerated;
+
+    auto processor = Processor::createThreadPool(2);
+    processor->setDefaultWaitPolicy(WaitPolicy::spinThenPark());
+
+    auto blocker = Promise::create();
+    auto blockerFuture = blocker->getFuture();
+    REQUIRE(!blockerFuture.isReady());
+    auto blocked = processor->enqueue([blockerFuture]() mutable { blockerFuture.wait(); });
+
+    std::atomic<int> val;
+    val.store(0);
+    for (int i = 0; i < 100; ++i) {
+        processor->enqueue([&val]() { val++; }).wait();
+        processor->enqueue([&val]() { val++; }).wait(WaitPolicy {}.setSpin(10));
+        processor->enqueue([&val]() { val++; }).wait(WaitPolicy::park());
+    }
+    REQUIRE(val.load() == 300);
+
+    // tiny spin & yield budget: typically runs out and parks
+    blocker->resolve();
+    blocked.wait(WaitPolicy {}.setSpin(1).setYield(1));
+    REQUIRE(blocked.isReady());
+    REQUIRE(Future::instantlyResolved().isReady());
+}
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+
+TEST_CASE( "Thread pool spec", "[accelerated-arrays]" ) {
+    using namespace accelerated;
+
+    // the first CPU this process may run on
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    int firstCpu = 0;
+    while (!CPU_ISSET(firstCpu, &allowed)) firstCpu++;
+
+    auto processor = Processor::createThreadPool(ThreadPoolSpec {}
+        .setThreads(2)
+        .setCpus({ firstCpu }, true)
+        .setName("aa-test-"));
+
+    for (int i = 0; i < 4; ++i) {
+        int cpu = -1;
+        char name[16] = { 0 };
+        processor->enqueue([&cpu, &name]() {
+            cpu = sched_getcpu();
+            pthread_getname_np(pthread_self(), name, sizeof(name));
+        }).wait();
+        REQUIRE(cpu == firstCpu);
+        REQUIRE(std::strncmp(name, "aa-test-", 8) == 0);
+    }
+
+    auto pools = Processor::createNumaThreadPools(ThreadPoolSpec {}.setThreads(1));
+    REQUIRE(pools.size() >= 1);
+    auto factory = cpu::Image::createFactory(*pools.at(0));
+    auto img = factory->create<std::uint8_t, 2>(10, 5);
+    REQUIRE(cpu::Image::castFrom(*img).get<std::uint8_t>(9, 4, 1) == 0);
+
+    // allocating from a worker of the allocator itself does not deadlock
+    std::unique_ptr<Image> fromWorker;
+    pools.at(0)->enqueue([&factory, &fromWorker]() {
+        fromWorker = factory->create<std::uint8_t, 2>(10, 5);
+    }).wait();
+    REQUIRE(cpu::Image::castFrom(*fromWorker).get<std::uint8_t>(9, 4, 1) == 0);
+}
+#endif